@@ -8,9 +8,9 @@
 #include <unistd.h>
 
 
-static int createNonblocking()//创建非阻塞的I/O 
+static int createNonblocking(sa_family_t family)//创建非阻塞的I/O 
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) 
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -20,11 +20,22 @@ static int createNonblocking()//创建非阻塞的I/O
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)//构造函数 
     : loop_(loop)
-    , acceptSocket_(createNonblocking()) // socket()
+    , acceptSocket_(createNonblocking(listenAddr.family())) // socket()
     , acceptChannel_(loop, acceptSocket_.fd())
+    , unixDomain_(listenAddr.isUnix())
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    if (listenAddr.isUnix())
+    {
+        if (!listenAddr.isAbstract())
+        {
+            ::unlink(listenAddr.unixPath().c_str());//上次运行留下的socket文件会让bind失败
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(true);
+    }
     acceptSocket_.bindAddress(listenAddr);// bind()
     //TcpServer::start()会调用Acceptor.listen  
     // 如果有新用户的连接，就要执行一个回调（connfd=》打包成channel=》唤醒subloop）
@@ -42,6 +53,10 @@ Acceptor::~Acceptor()
 void Acceptor::listen()
 {
     listenning_ = true;
+    if (!acceptSocket_.applyOptions(options_, true, unixDomain_))
+    {
+        LOG_ERROR("%s:%s:%d apply socket options to listen fd:%d fail \n", __FILE__, __FUNCTION__, __LINE__, acceptSocket_.fd());
+    }
     acceptSocket_.listen();//listen
     acceptChannel_.enableReading();//acceptChannel_ => Poller
 }
@@ -20,6 +20,10 @@ public:
         newConnectionCallback_ = cb;
     }
 
+    //在listen之前设置，listen时作用到监听socket上
+    void setSocketOptions(const SocketOptions &options) { options_ = options; }
+    SocketOptions effectiveSocketOptions() const { return acceptSocket_.effectiveOptions(); }
+
     bool listenning() const { return listenning_; }
     void listen();
 private:
@@ -28,6 +32,8 @@ private:
     EventLoop *loop_;//Acceptor用的就是用户定义的那个baseLoop，也称作mainLoop
     Socket acceptSocket_; // listenfd
     Channel acceptChannel_;  // listenfd也需要poller监听，poller操作的单位是channel，把listenfd打包成channel
+    const bool unixDomain_;//监听地址是AF_UNIX
     NewConnectionCallback newConnectionCallback_; // 把accpet返回的新clientfd分发给subloop
     bool listenning_;
+    SocketOptions options_;
 };
@@ -0,0 +1,153 @@
+#include "Arena.h"
+#include "Logger.h"
+
+#include <stdlib.h>
+
+Arena::Arena(size_t blockSize)
+    : blockSize_(blockSize)
+    , current_(0)
+    , blockBegin_(nullptr)
+    , ptr_(nullptr)
+    , end_(nullptr)
+    , usedBefore_(0)
+    , cleanups_(nullptr)
+    , allocations_(0)
+    , highWater_(0)
+    , reserved_(0)
+    , totalAllocations_(0)
+    , blockAllocations_(0)
+    , resets_(0)
+{
+}
+
+Arena::~Arena()
+{
+    reset();
+    for (const Block &block : blocks_)
+    {
+        ::free(block.data);
+    }
+}
+
+void Arena::useBlock(size_t index)
+{
+    current_ = index;
+    blockBegin_ = blocks_[index].data;
+    ptr_ = blockBegin_;
+    end_ = blockBegin_ + blocks_[index].size;
+}
+
+//当前块放不下：大的分配单独要一块，小的换到下一块，没有下一块就向malloc要
+void* Arena::allocateSlow(size_t size, size_t align)
+{
+    if (size + align > blockSize_ / 4)
+    {
+        char *data = static_cast<char*>(::malloc(size + align));
+        if (data == nullptr)
+        {
+            LOG_FATAL("Arena::allocate %lu bytes failed \n", static_cast<unsigned long>(size));
+        }
+        large_.push_back(Block{data, size + align});
+        usedBefore_ += size;
+        ++allocations_;
+        add(blockAllocations_, 1);
+        reserved_.store(reserved_.load(std::memory_order_relaxed) + size + align, std::memory_order_relaxed);
+        return alignUp(data, align);
+    }
+
+    usedBefore_ += static_cast<size_t>(ptr_ - blockBegin_);
+    size_t next = blockBegin_ == nullptr ? 0 : current_ + 1;
+    if (next == blocks_.size())
+    {
+        char *data = static_cast<char*>(::malloc(blockSize_));
+        if (data == nullptr)
+        {
+            LOG_FATAL("Arena::allocate block of %lu bytes failed \n", static_cast<unsigned long>(blockSize_));
+        }
+        blocks_.push_back(Block{data, blockSize_});
+        add(blockAllocations_, 1);
+        reserved_.store(reserved_.load(std::memory_order_relaxed) + blockSize_, std::memory_order_relaxed);
+    }
+    useBlock(next);
+
+    //块的起始地址来自malloc，align不超过blockSize_/4时一定放得下
+    char *p = alignUp(ptr_, align);
+    ptr_ = p + size;
+    ++allocations_;
+    return p;
+}
+
+//清理节点也放在arena里，头插，reset时正好按构造的逆序析构
+void Arena::addCleanup(void (*fn)(void*), void *obj)
+{
+    Cleanup *cleanup = static_cast<Cleanup*>(allocate(sizeof(Cleanup), alignof(Cleanup)));
+    cleanup->fn = fn;
+    cleanup->obj = obj;
+    cleanup->next = cleanups_;
+    cleanups_ = cleanup;
+}
+
+void Arena::reset()
+{
+    size_t usedBytes = used();
+    if (usedBytes == 0 && cleanups_ == nullptr)
+    {
+        return;//这一轮没人用，大多数空转的循环走这里
+    }
+
+    //析构函数里还可能从arena分配，先摘下链表
+    while (cleanups_ != nullptr)
+    {
+        Cleanup *cleanup = cleanups_;
+        cleanups_ = nullptr;
+        for (; cleanup != nullptr; cleanup = cleanup->next)
+        {
+            cleanup->fn(cleanup->obj);
+        }
+    }
+    usedBytes = used();
+
+    size_t freed = 0;
+    for (const Block &block : large_)
+    {
+        ::free(block.data);
+        freed += block.size;
+    }
+    large_.clear();
+    while (blocks_.size() > kMaxRetainedBlocks)
+    {
+        ::free(blocks_.back().data);
+        freed += blocks_.back().size;
+        blocks_.pop_back();
+    }
+    reserved_.store(reserved_.load(std::memory_order_relaxed) - freed, std::memory_order_relaxed);
+
+    usedBefore_ = 0;
+    if (blocks_.empty())
+    {
+        blockBegin_ = ptr_ = end_ = nullptr;
+    }
+    else
+    {
+        useBlock(0);
+    }
+
+    if (usedBytes > highWater_.load(std::memory_order_relaxed))
+    {
+        highWater_.store(usedBytes, std::memory_order_relaxed);
+    }
+    add(totalAllocations_, allocations_);
+    allocations_ = 0;
+    add(resets_, 1);
+}
+
+ArenaStats Arena::stats() const
+{
+    ArenaStats stats;
+    stats.highWater = highWater_.load(std::memory_order_relaxed);
+    stats.reserved = reserved_.load(std::memory_order_relaxed);
+    stats.allocations = totalAllocations_.load(std::memory_order_relaxed);
+    stats.blockAllocations = blockAllocations_.load(std::memory_order_relaxed);
+    stats.resets = resets_.load(std::memory_order_relaxed);
+    return stats;
+}
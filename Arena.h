@@ -0,0 +1,185 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+//Arena的统计，highWater是单轮循环用过的最大字节数
+struct ArenaStats
+{
+    size_t highWater = 0;
+    size_t reserved = 0;//当前持有的块的总大小
+    uint64_t allocations = 0;//从arena分配的次数，这些都不经过malloc
+    uint64_t blockAllocations = 0;//arena自己向malloc要块的次数
+    uint64_t resets = 0;
+};
+
+/**
+ * 每个loop一个的bump分配器，只在loop线程中使用，不加锁
+ * 消息回调中临时的字符串、解析出来的头、临时vector从这里分配，只移动一个指针；
+ * EventLoop每轮循环结束时reset，一次性回收这一轮分配的所有内存，保留的块下一轮接着用
+ * 活过这一轮的对象（放进了连接的context、定时器、跨线程的任务）要先promote到堆上
+ */
+class Arena : noncopyable
+{
+public:
+    static const size_t kBlockSize = 64 * 1024;
+    static const size_t kMaxRetainedBlocks = 4;//reset以后最多留着这么多块，多出来的还给malloc
+
+    explicit Arena(size_t blockSize = kBlockSize);
+    ~Arena();
+
+    void* allocate(size_t size, size_t align = alignof(max_align_t))
+    {
+        char *p = alignUp(ptr_, align);
+        //还没有块时p为空；长度为0的分配返回当前位置，不占空间，也不换块
+        if (p == nullptr || p > end_ || size > static_cast<size_t>(end_ - p))
+        {
+            return allocateSlow(size, align);
+        }
+        ptr_ = p + size;
+        ++allocations_;
+        return p;
+    }
+
+    //在arena上构造对象，有析构函数的对象在reset时按构造的逆序析构
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        void *p = allocate(sizeof(T), alignof(T));
+        T *obj = new (p) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            addCleanup(&destroy<T>, obj);
+        }
+        return obj;
+    }
+
+    //拷贝一份字符串到arena，以'\0'结尾
+    StringPiece copy(StringPiece str)
+    {
+        char *p = static_cast<char*>(allocate(str.size() + 1, 1));
+        ::memcpy(p, str.data(), str.size());
+        p[str.size()] = '\0';
+        return StringPiece(p, str.size());
+    }
+
+    //逃生口：把arena上的对象移动到堆上，reset以后仍然有效
+    //对象内部如果还引用arena的内存（ArenaString、ArenaVector），要先转成普通的string/vector
+    template <typename T>
+    std::unique_ptr<T> promote(T *obj)
+    {
+        return std::unique_ptr<T>(new T(std::move(*obj)));
+    }
+    static std::string promote(StringPiece str) { return str.toString(); }
+
+    //回收这一轮分配的所有内存，EventLoop每轮循环结束时调用
+    void reset();
+
+    //这一轮已经用掉的字节数
+    size_t used() const { return usedBefore_ + static_cast<size_t>(ptr_ - blockBegin_); }
+    //可以在其他线程读，每次reset时更新
+    ArenaStats stats() const;
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+    struct Cleanup
+    {
+        void (*fn)(void*);
+        void *obj;
+        Cleanup *next;
+    };
+
+    template <typename T>
+    static void destroy(void *obj) { static_cast<T*>(obj)->~T(); }
+
+    static char* alignUp(char *p, size_t align)
+    {
+        uintptr_t v = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((v + align - 1) & ~static_cast<uintptr_t>(align - 1));
+    }
+
+    void* allocateSlow(size_t size, size_t align);
+    void addCleanup(void (*fn)(void*), void *obj);
+    void useBlock(size_t index);
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    const size_t blockSize_;
+    std::vector<Block> blocks_;//普通大小的块，前面的用完了才用后面的
+    std::vector<Block> large_;//超过blockSize_/4的分配单独一块，reset时释放
+    size_t current_;//blocks_中正在用的块
+    char *blockBegin_;
+    char *ptr_;
+    char *end_;
+    size_t usedBefore_;//这一轮前面的块和large_用掉的字节数
+    Cleanup *cleanups_;
+    uint64_t allocations_;//loop线程中的计数，reset时汇总
+
+    std::atomic<size_t> highWater_;
+    std::atomic<size_t> reserved_;
+    std::atomic<uint64_t> totalAllocations_;
+    std::atomic<uint64_t> blockAllocations_;
+    std::atomic<uint64_t> resets_;
+};
+
+//让STL容器从arena分配，deallocate什么也不做，内存在reset时统一回收
+//arena为空时退回普通的堆分配，同一个容器类型既可以是loop线程中的临时对象，也可以活得更久
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    //给容器换一个新的arena时（赋值一个空容器）跟着换，不会继续用旧arena上已经回收的内存
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit ArenaAllocator(Arena *arena = nullptr) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n)
+    {
+        if (arena_ == nullptr)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, size_t)
+    {
+        if (arena_ == nullptr)
+        {
+            ::operator delete(p);
+        }
+    }
+
+    Arena* arena() const { return arena_; }
+private:
+    Arena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() == b.arena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() != b.arena(); }
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,54 @@
+#include "BatchReply.h"
+#include "TcpConnection.h"
+
+BatchReply::BatchReply(const TcpConnectionPtr &conn, bool lengthHeader)
+    : conn_(conn)
+    , lengthHeader_(lengthHeader)
+    , payloadBytes_(0)
+    , replies_(0)
+{
+}
+
+BatchReply::~BatchReply()
+{
+    flush();
+}
+
+void BatchReply::reply(StringPiece message)
+{
+    if (lengthHeader_)
+    {
+        text_.appendInt32(static_cast<int32_t>(message.size()));
+    }
+    text_.append(message.data(), message.size());
+    ++replies_;
+}
+
+void BatchReply::reply(const PayloadPtr &message)
+{
+    if (lengthHeader_)
+    {
+        text_.appendInt32(static_cast<int32_t>(message->size()));
+    }
+    append(message);
+    ++replies_;
+}
+
+void BatchReply::append(const PayloadPtr &data)
+{
+    payloads_.push_back(std::make_pair(text_.readableBytes(), data));
+    payloadBytes_ += data->size();
+}
+
+bool BatchReply::flush()
+{
+    if (text_.readableBytes() == 0 && payloads_.empty())
+    {
+        return true;
+    }
+    bool ok = conn_->sendBatch(&text_, payloads_);
+    text_.retrieveAll();
+    payloads_.clear();
+    payloadBytes_ = 0;
+    return ok;
+}
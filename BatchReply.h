@@ -0,0 +1,45 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "Payload.h"
+#include "StringPiece.h"
+
+#include <vector>
+#include <utility>
+
+/**
+ * 一批回复的收集器，处理一次读到的所有请求期间把回复攒在这里，最后一次交给连接
+ * 小的回复拷进同一个Buffer，Payload只持有引用，flush时按顺序排进发送缓冲区，一次writev发出去
+ * 只能在连接所属的loop线程中使用，析构时还没发送的回复自动flush
+ */
+class BatchReply : noncopyable
+{
+public:
+    //lengthHeader为true时reply给每条回复加上LengthHeaderCodec的4字节长度头
+    explicit BatchReply(const TcpConnectionPtr &conn, bool lengthHeader = false);
+    ~BatchReply();
+
+    const TcpConnectionPtr& connection() const { return conn_; }
+
+    //一条回复，按构造时的方式分帧
+    void reply(StringPiece message);
+    void reply(const PayloadPtr &message);
+    //不分帧，直接追加原始字节
+    void append(StringPiece data) { text_.append(data.data(), data.size()); }
+    void append(const PayloadPtr &data);
+
+    size_t replies() const { return replies_; }
+    size_t bytes() const { return text_.readableBytes() + payloadBytes_; }
+
+    //把攒下的回复交给连接，连接已经断开或者被MemoryBudget拒绝时返回false
+    bool flush();
+private:
+    TcpConnectionPtr conn_;
+    const bool lengthHeader_;
+    Buffer text_;
+    std::vector<std::pair<size_t, PayloadPtr>> payloads_;//payload插在text_的哪个位置之后
+    size_t payloadBytes_;
+    size_t replies_;
+};
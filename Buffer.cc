@@ -34,7 +34,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     }
     else//extrabuf里面也写入了数据，把第二块缓冲区的数据写入buffer
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;//没有底层数组时writable是0，数据全在extrabuf里
         append(extrabuf, n - writable);//writerIndex_开始写 n - writable大小的数据
     }
 
@@ -3,6 +3,9 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
 
 //网络库底层的缓冲器类型定义
 class Buffer
@@ -11,12 +14,20 @@ public:
     static const size_t kCheapPrepend = 8;// 头部字节大小 记录数据包的长度 
     static const size_t kInitialSize = 1024;// 缓冲区的大小 
 
+    //initialSize为0时不分配内存，第一次写入或者adoptStorage时才有底层数组
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)//开辟的大小 
+        : buffer_(initialSize > 0 ? kCheapPrepend + initialSize : 0)//开辟的大小 
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
     {}
 
+    void swap(Buffer &rhs)
+    {
+        buffer_.swap(rhs.buffer_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
     size_t readableBytes() const //可读的数据长度 
     {
         return writerIndex_ - readerIndex_;
@@ -24,7 +35,7 @@ public:
 
     size_t writableBytes() const //可写的缓冲区长度 
     {
-        return buffer_.size() - writerIndex_;
+        return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0;//没有底层数组时是0
     }
 
     size_t prependableBytes() const //返回头部的空间的大小 
@@ -88,6 +99,98 @@ public:
         writerIndex_ += len;
     }
 
+    //整数都按网络字节序（大端）读写
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        append(reinterpret_cast<const char*>(&be64), sizeof be64);
+    }
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        append(reinterpret_cast<const char*>(&be32), sizeof be32);
+    }
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        append(reinterpret_cast<const char*>(&be16), sizeof be16);
+    }
+    void appendInt8(int8_t x)
+    {
+        append(reinterpret_cast<const char*>(&x), sizeof x);
+    }
+
+    //读取但不取走，调用者保证readableBytes()足够
+    int64_t peekInt64() const
+    {
+        int64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return be64toh(be64);
+    }
+    int32_t peekInt32() const
+    {
+        int32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return be32toh(be32);
+    }
+    int16_t peekInt16() const
+    {
+        int16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof be16);
+        return be16toh(be16);
+    }
+    int8_t peekInt8() const
+    {
+        return *peek();
+    }
+
+    //读取并取走
+    int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+    int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+    int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+    int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
+    /**
+     * 把数据放到可读数据的前面，使用readerIndex_之前的空闲空间，不搬移已有的数据
+     * 先append消息体再prepend长度头，头部不需要额外的拷贝
+     * 调用者保证len不超过prependableBytes()，数据没被取走过时至少有kCheapPrepend个字节
+     */
+    void prepend(const void *data, size_t len)
+    {
+        if (buffer_.empty())
+        {
+            buffer_.resize(kCheapPrepend);//没有底层数组时先分配出头部空间
+        }
+        readerIndex_ -= len;
+        const char *d = static_cast<const char*>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        prepend(&be64, sizeof be64);
+    }
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        prepend(&be32, sizeof be32);
+    }
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        prepend(&be16, sizeof be16);
+    }
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
+    //直接往beginWrite()写了len个字节以后调用，比如交给zlib之类的库填充
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -98,6 +201,51 @@ public:
         return begin() + writerIndex_;
     }
 
+    bool hasStorage() const { return !buffer_.empty(); }
+    size_t capacity() const { return buffer_.capacity(); }
+
+    //没有可读数据时换上一块新的底层数组，BufferPool用它把缓存的数组交给Buffer
+    void adoptStorage(std::vector<char> &&storage)
+    {
+        buffer_.swap(storage);
+        retrieveAll();
+    }
+    //没有可读数据时交出底层数组，之后Buffer不再占用内存
+    std::vector<char> releaseStorage()
+    {
+        std::vector<char> storage;
+        storage.swap(buffer_);
+        retrieveAll();
+        return storage;
+    }
+    //按可读数据重新分配底层数组，释放扩容以后多出来的内存，reserve是额外保留的可写空间
+    void shrink(size_t reserve)
+    {
+        std::vector<char> storage(kCheapPrepend + readableBytes() + reserve);
+        std::copy(peek(), peek() + readableBytes(), storage.begin() + kCheapPrepend);
+        writerIndex_ = kCheapPrepend + readableBytes();
+        readerIndex_ = kCheapPrepend;
+        buffer_.swap(storage);
+    }
+
+    /**
+     * 在可读数据[start, beginWrite())中查找，返回第一个匹配的位置，找不到返回nullptr
+     * start默认是peek()，必须落在可读数据范围内，用来从上次找过的位置继续
+     * 按CPU在运行时选择AVX2、SSE4.2或者标量实现
+     */
+    const char* findCRLF() const { return findCRLF(peek()); }
+    const char* findCRLF(const char *start) const { return find(start, kCRLF, 2); }
+    const char* findEOL() const { return findEOL(peek()); }
+    const char* findEOL(const char *start) const;
+    //多字节分隔符
+    const char* find(const char *delim, size_t len) const { return find(peek(), delim, len); }
+    const char* find(const char *start, const char *delim, size_t len) const;
+    //第一个属于set中任意字节的位置
+    const char* findAnyOf(const char *set, size_t setLen) const { return findAnyOf(peek(), set, setLen); }
+    const char* findAnyOf(const char *start, const char *set, size_t setLen) const;
+    //当前使用的查找实现："avx2"、"sse4.2"或者"scalar"
+    static const char* searchImpl();
+
     //从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
     //通过fd发送数据
@@ -107,11 +255,11 @@ private:
     char* begin()
     {
         //it.operator*() 获取迭代器指向的内容，然后取个地址 
-        return &*buffer_.begin();//vector底层数组首元素的地址，也就是数组的起始地址
+        return buffer_.data();//vector底层数组首元素的地址，也就是数组的起始地址
     }
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
     void makeSpace(size_t len)
     {
@@ -133,6 +281,8 @@ private:
         }
     }
 
+    static const char kCRLF[];
+
     std::vector<char> buffer_;//vector数组 扩容方便 
     size_t readerIndex_;//可读数据的下标位置 
     size_t writerIndex_;//写数据的下标位置 
@@ -0,0 +1,31 @@
+#include "BufferPool.h"
+
+void BufferPool::fill(Buffer *buf)
+{
+    if (buf->hasStorage() || buf->readableBytes() > 0)
+    {
+        return;
+    }
+    if (free_.empty())
+    {
+        buf->adoptStorage(std::vector<char>(kStorageSize));
+    }
+    else
+    {
+        buf->adoptStorage(std::move(free_.back()));
+        free_.pop_back();
+    }
+}
+
+void BufferPool::recycle(Buffer *buf)
+{
+    if (!buf->hasStorage() || buf->readableBytes() > 0)
+    {
+        return;
+    }
+    std::vector<char> storage(buf->releaseStorage());
+    if (storage.size() == kStorageSize && storage.capacity() == kStorageSize && free_.size() < kMaxCached)
+    {
+        free_.push_back(std::move(storage));
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+#include <vector>
+
+/**
+ * 每个loop一个的Buffer底层数组缓存，只在loop线程中使用，不加锁
+ * 连接的缓冲区第一次用到时从这里取，空闲连接的缓冲区取空以后还回来，
+ * 大量空闲连接不用各自占着两块内存
+ * 只缓存默认大小的数组，扩容过的数组还回来时直接释放
+ */
+class BufferPool : noncopyable
+{
+public:
+    static const size_t kStorageSize = Buffer::kCheapPrepend + Buffer::kInitialSize;
+    static const size_t kMaxCached = 1024;
+
+    //有可读数据的Buffer不会被动到
+    void fill(Buffer *buf);
+    void recycle(Buffer *buf);
+
+    size_t cached() const { return free_.size(); }
+private:
+    std::vector<std::vector<char>> free_;
+};
@@ -0,0 +1,253 @@
+#include "Buffer.h"
+
+#include <string.h>
+#include <stdint.h>
+
+//向量实现只在x86上编译，其他架构只有标量实现
+#if defined(__x86_64__) || defined(__i386__)
+#define MYMUDUO_X86_SEARCH 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Buffer的查找函数
+ * 向量实现每次比较16/32个字节，只用非对齐的load，并且保证不会读到[begin, end)之外；
+ * 剩下不够一个向量的尾部交给标量实现
+ * 函数用target属性单独编译，整个库不需要-mavx2，启动时按CPU选一次实现；非x86平台直接用标量实现
+ */
+
+const char Buffer::kCRLF[] = "\r\n";
+
+namespace
+{
+
+using FindFunc = const char* (*)(const char *begin, const char *end, const char *needle, size_t len);
+using FindAnyFunc = const char* (*)(const char *begin, const char *end, const char *set, size_t setLen);
+
+const size_t kMaxVectorSet = 16;// 字节集合超过这么大时用查表
+
+// 调用者保证len >= 1
+const char* findScalar(const char *begin, const char *end, const char *needle, size_t len)
+{
+    if (static_cast<size_t>(end - begin) < len)
+    {
+        return nullptr;
+    }
+    const char *last = end - len;//最后一个可能的起始位置
+    const char *p = begin;
+    while (p <= last)
+    {
+        p = static_cast<const char*>(::memchr(p, needle[0], last - p + 1));
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (::memcmp(p + 1, needle + 1, len - 1) == 0)
+        {
+            return p;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+const char* findAnyScalar(const char *begin, const char *end, const char *set, size_t setLen)
+{
+    bool table[256] = {false};
+    for (size_t i = 0; i < setLen; ++i)
+    {
+        table[static_cast<unsigned char>(set[i])] = true;
+    }
+    for (const char *p = begin; p < end; ++p)
+    {
+        if (table[static_cast<unsigned char>(*p)])
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef MYMUDUO_X86_SEARCH
+// 同时比较分隔符的第一个和最后一个字节，两个都对上的位置再用memcmp确认中间的字节
+__attribute__((target("sse4.2")))
+const char* findSse42(const char *begin, const char *end, const char *needle, size_t len)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    const char *p = begin;
+    for (; end - p >= static_cast<ptrdiff_t>(len - 1 + 16); p += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                        _mm_cmpeq_epi8(last, blockLast)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (len <= 2 || ::memcmp(p + bit + 1, needle + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(p, end, needle, len);
+}
+
+__attribute__((target("avx2")))
+const char* findAvx2(const char *begin, const char *end, const char *needle, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    const char *p = begin;
+    for (; end - p >= static_cast<ptrdiff_t>(len - 1 + 32); p += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (len <= 2 || ::memcmp(p + bit + 1, needle + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSse42(p, end, needle, len);
+}
+
+// PCMPESTRI的equal any模式，一条指令比较16个字节和最多16个字节的集合
+__attribute__((target("sse4.2")))
+const char* findAnySse42(const char *begin, const char *end, const char *set, size_t setLen)
+{
+    if (setLen > kMaxVectorSet)
+    {
+        return findAnyScalar(begin, end, set, setLen);
+    }
+    char setBytes[16] = {0};//拷贝出来，不会读到set之外
+    ::memcpy(setBytes, set, setLen);
+    const __m128i setVec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(setBytes));
+    const char *p = begin;
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(setVec, static_cast<int>(setLen), block, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16)
+        {
+            return p + index;
+        }
+    }
+    return findAnyScalar(p, end, set, setLen);
+}
+
+// 集合中的每个字节广播成一个向量，逐个比较以后或起来，适合HTTP/RESP中常见的几个字节的集合
+__attribute__((target("avx2")))
+const char* findAnyAvx2(const char *begin, const char *end, const char *set, size_t setLen)
+{
+    if (setLen > kMaxVectorSet)
+    {
+        return findAnyScalar(begin, end, set, setLen);
+    }
+    __m256i setVecs[kMaxVectorSet];
+    for (size_t i = 0; i < setLen; ++i)
+    {
+        setVecs[i] = _mm256_set1_epi8(set[i]);
+    }
+    const char *p = begin;
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_cmpeq_epi8(block, setVecs[0]);
+        for (size_t i = 1; i < setLen; ++i)
+        {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, setVecs[i]));
+        }
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findAnySse42(p, end, set, setLen);
+}
+#endif // MYMUDUO_X86_SEARCH
+
+struct SearchImpl
+{
+    FindFunc find;
+    FindAnyFunc findAny;
+    const char *name;
+};
+
+SearchImpl selectSearchImpl()
+{
+#ifdef MYMUDUO_X86_SEARCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SearchImpl{findAvx2, findAnyAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return SearchImpl{findSse42, findAnySse42, "sse4.2"};
+    }
+#endif
+    return SearchImpl{findScalar, findAnyScalar, "scalar"};
+}
+
+const SearchImpl& searchImplInstance()
+{
+    static const SearchImpl impl = selectSearchImpl();
+    return impl;
+}
+
+} // namespace
+
+const char* Buffer::find(const char *start, const char *delim, size_t len) const
+{
+    const char *end = beginWrite();
+    if (len == 0 || start == nullptr || start < peek() || start >= end)
+    {
+        return nullptr;//没有可读数据或者start越界
+    }
+    if (len == 1)
+    {
+        return static_cast<const char*>(::memchr(start, delim[0], end - start));
+    }
+    return searchImplInstance().find(start, end, delim, len);
+}
+
+const char* Buffer::findEOL(const char *start) const
+{
+    const char *end = beginWrite();
+    if (start == nullptr || start < peek() || start >= end)
+    {
+        return nullptr;
+    }
+    //单个字节的查找直接用glibc的memchr，它本身就按CPU选择了AVX2/SSE2实现
+    return static_cast<const char*>(::memchr(start, '\n', end - start));
+}
+
+const char* Buffer::findAnyOf(const char *start, const char *set, size_t setLen) const
+{
+    const char *end = beginWrite();
+    if (setLen == 0 || start == nullptr || start < peek() || start >= end)
+    {
+        return nullptr;
+    }
+    if (setLen == 1)
+    {
+        return static_cast<const char*>(::memchr(start, set[0], end - start));
+    }
+    return searchImplInstance().findAny(start, end, set, setLen);
+}
+
+const char* Buffer::searchImpl()
+{
+    return searchImplInstance().name;
+}
@@ -0,0 +1,390 @@
+#include "CompressionStage.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include <time.h>
+#include <string.h>
+#include <atomic>
+
+namespace
+{
+
+const char kHelloMagic[] = "MZ";
+const int8_t kHelloVersion = 1;
+#ifdef MYMUDUO_HAVE_ZLIB
+const int8_t kSupportedAlgorithms = CompressionStage::kZlib;
+#else
+const int8_t kSupportedAlgorithms = CompressionStage::kNone;//没有zlib时握手中声明不压缩，和对端原样传输
+const int Z_NO_FLUSH = 0;//和zlib.h中的值相同，只用来编译不会执行的压缩路径
+const int Z_SYNC_FLUSH = 2;
+#endif
+
+//所有连接的统计，每次deflate/inflate结束时累加一次
+std::atomic<uint64_t> gRawBytesOut(0);
+std::atomic<uint64_t> gCompressedBytesOut(0);
+std::atomic<uint64_t> gCompressedBytesIn(0);
+std::atomic<uint64_t> gRawBytesIn(0);
+std::atomic<uint64_t> gDeflateNanos(0);
+std::atomic<uint64_t> gInflateNanos(0);
+std::atomic<uint64_t> gFlushes(0);
+
+uint64_t threadCpuNanos()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void add(std::atomic<uint64_t> &total, uint64_t *counter, uint64_t n)
+{
+    *counter += n;
+    total.fetch_add(n, std::memory_order_relaxed);//多个loop线程同时累加
+}
+
+} // namespace
+
+CompressionStage::CompressionStage(const CompressionOptions &options)
+    : options_(options)
+    , helloReceived_(false)
+    , compress_(false)
+    , flushPending_(false)
+    , inflateBacklogged_(false)
+    , unflushed_(0)
+    , deflater_(nullptr)
+    , inflater_(nullptr)
+    , pendingOut_(0)
+    , compressedOut_(0)
+    , inflatedIn_(0)
+{
+}
+
+CompressionStage::~CompressionStage()
+{
+#ifdef MYMUDUO_HAVE_ZLIB
+    if (deflater_ != nullptr)
+    {
+        ::deflateEnd(deflater_);
+        delete deflater_;
+    }
+    if (inflater_ != nullptr)
+    {
+        ::inflateEnd(inflater_);
+        delete inflater_;
+    }
+#endif
+}
+
+StageFactory CompressionStage::factory(const CompressionOptions &options)
+{
+    return [options](const TcpConnectionPtr&) {
+        return StagePtr(new CompressionStage(options));
+    };
+}
+
+CompressionStats CompressionStage::totalStats()
+{
+    CompressionStats stats;
+    stats.rawBytesOut = gRawBytesOut.load(std::memory_order_relaxed);
+    stats.compressedBytesOut = gCompressedBytesOut.load(std::memory_order_relaxed);
+    stats.compressedBytesIn = gCompressedBytesIn.load(std::memory_order_relaxed);
+    stats.rawBytesIn = gRawBytesIn.load(std::memory_order_relaxed);
+    stats.deflateNanos = gDeflateNanos.load(std::memory_order_relaxed);
+    stats.inflateNanos = gInflateNanos.load(std::memory_order_relaxed);
+    stats.flushes = gFlushes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void CompressionStage::onConnected(StageContext &ctx)
+{
+    Buffer hello(kHelloLen);
+    hello.append(kHelloMagic, 2);
+    hello.appendInt8(kHelloVersion);
+    hello.appendInt8(options_.enabled ? kSupportedAlgorithms : static_cast<int8_t>(kNone));
+    ctx.fireWrite(&hello);//握手不经过压缩
+}
+
+//对端的4字节握手，两端都支持zlib时开启压缩
+bool CompressionStage::handleHello(StageContext &ctx, Buffer *in)
+{
+    if (in->readableBytes() < kHelloLen)
+    {
+        return false;
+    }
+    if (::memcmp(in->peek(), kHelloMagic, 2) != 0)
+    {
+        LOG_ERROR("CompressionStage [%s] peer did not send a compression hello\n",
+            ctx.connection()->name().c_str());
+        in->retrieveAll();
+        ctx.connection()->forceClose();
+        return false;
+    }
+    in->retrieve(3);//版本号目前只有1，以后按最小的版本兼容
+    int8_t peerAlgorithms = in->readInt8();
+    helloReceived_ = true;
+    compress_ = options_.enabled && (peerAlgorithms & kSupportedAlgorithms & kZlib);
+    if (compress_ && !initStreams())
+    {
+        ctx.connection()->forceClose();
+        return false;
+    }
+    LOG_DEBUG("CompressionStage [%s] compression %s\n",
+        ctx.connection()->name().c_str(), compress_ ? "on" : "off");
+
+    //握手之前send的数据
+    if (pendingOut_.readableBytes() > 0)
+    {
+        onWrite(ctx, &pendingOut_);
+    }
+    if (flushPending_)
+    {
+        flushPending_ = false;
+        onFlush(ctx);
+    }
+    return true;
+}
+
+void CompressionStage::onConsumed(StageContext &ctx)
+{
+    //下一级处理了积压的解压数据，降到上限以下时继续解压留在上一级Buffer中的数据
+    if (inflateBacklogged_ && inflatedIn_.readableBytes() <= options_.maxInflatedBytes)
+    {
+        inflateBacklogged_ = false;
+        ctx.resumeRead();
+    }
+}
+
+//下一级stage暂停了读，交下去的数据只会积压
+bool CompressionStage::nextStagePaused(StageContext &ctx) const
+{
+    size_t next = ctx.index() + 1;
+    Pipeline *pipeline = ctx.pipeline();
+    return next < pipeline->size() && pipeline->context(next)->readPaused();
+}
+
+void CompressionStage::onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime)
+{
+    if (!helloReceived_ && !handleHello(ctx, in))
+    {
+        return;
+    }
+    if (in->readableBytes() == 0)
+    {
+        return;
+    }
+    if (compress_)
+    {
+        inflateFrom(ctx, in, receiveTime);
+    }
+    else
+    {
+        ctx.fireRead(in, receiveTime);//不压缩时原样交给下一级，不拷贝
+    }
+}
+
+void CompressionStage::onWrite(StageContext &ctx, Buffer *out)
+{
+    if (!helloReceived_)
+    {
+        if (&pendingOut_ != out)
+        {
+            pendingOut_.append(out->peek(), out->readableBytes());
+            out->retrieveAll();
+        }
+        return;
+    }
+    if (!compress_)
+    {
+        ctx.fireWrite(out);
+        return;
+    }
+    unflushed_ += out->readableBytes();
+    deflateFrom(ctx, out, Z_NO_FLUSH);
+}
+
+void CompressionStage::onFlush(StageContext &ctx)
+{
+    if (!helloReceived_)
+    {
+        flushPending_ = true;
+        return;
+    }
+    if (!compress_ || unflushed_ == 0)
+    {
+        ctx.fireFlush();
+        return;
+    }
+    if (!options_.flushOnDrain
+        || unflushed_ >= options_.flushThreshold
+        || ctx.connection()->pendingOutputBytes() == 0)
+    {
+        syncFlush(ctx);
+    }
+    //否则发送缓冲区写空时在onDrained中flush
+}
+
+void CompressionStage::onDrained(StageContext &ctx)
+{
+    if (compress_ && unflushed_ > 0)
+    {
+        syncFlush(ctx);
+    }
+    ctx.fireDrained();
+}
+
+void CompressionStage::syncFlush(StageContext &ctx)
+{
+    Buffer empty(0);
+    deflateFrom(ctx, &empty, Z_SYNC_FLUSH);
+    unflushed_ = 0;
+    add(gFlushes, &stats_.flushes, 1);
+    ctx.fireFlush();
+}
+
+#ifdef MYMUDUO_HAVE_ZLIB
+
+bool CompressionStage::initStreams()
+{
+    deflater_ = new z_stream();
+    inflater_ = new z_stream();
+    int ret = ::deflateInit2(deflater_, options_.level, Z_DEFLATED, options_.windowBits,
+                            options_.memLevel, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+    {
+        LOG_ERROR("CompressionStage deflateInit2 error:%d\n", ret);
+        delete deflater_;
+        deflater_ = nullptr;
+        return false;
+    }
+    ret = ::inflateInit2(inflater_, options_.windowBits);
+    if (ret != Z_OK)
+    {
+        LOG_ERROR("CompressionStage inflateInit2 error:%d\n", ret);
+        delete inflater_;
+        inflater_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//把out中的数据压进deflate流，输出的压缩数据每积累几块就交给下一级，compressedOut_不会无限增长
+void CompressionStage::deflateFrom(StageContext &ctx, Buffer *out, int flush)
+{
+    uint64_t start = threadCpuNanos();
+    size_t rawLen = out->readableBytes();
+    size_t produced = 0;
+
+    deflater_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(out->peek()));
+    deflater_->avail_in = static_cast<uInt>(rawLen);
+    do
+    {
+        compressedOut_.ensureWriteableBytes(kChunk);
+        size_t writable = compressedOut_.writableBytes();
+        deflater_->next_out = reinterpret_cast<Bytef*>(compressedOut_.beginWrite());
+        deflater_->avail_out = static_cast<uInt>(writable);
+        int ret = ::deflate(deflater_, flush);
+        if (ret == Z_STREAM_ERROR)
+        {
+            out->retrieveAll();
+            fail(ctx, "deflate", ret);
+            return;
+        }
+        size_t n = writable - deflater_->avail_out;
+        compressedOut_.hasWritten(n);
+        produced += n;
+        if (compressedOut_.readableBytes() >= 4 * kChunk)
+        {
+            ctx.fireWrite(&compressedOut_);
+        }
+    } while (deflater_->avail_in > 0 || deflater_->avail_out == 0);
+    out->retrieveAll();
+
+    if (compressedOut_.readableBytes() > 0)
+    {
+        ctx.fireWrite(&compressedOut_);
+    }
+    add(gRawBytesOut, &stats_.rawBytesOut, rawLen);
+    add(gCompressedBytesOut, &stats_.compressedBytesOut, produced);
+    add(gDeflateNanos, &stats_.deflateNanos, threadCpuNanos() - start);
+}
+
+/**
+ * 从in中增量解压，每解出一块就交给下一级
+ * 下一级暂停了读并且积压超过maxInflatedBytes时，这一级也暂停，连接停止从socket读，没解压的数据留在in中；
+ * 下一级恢复以后处理了积压的数据，在onConsumed中恢复，pipeline重新把in交给这一级继续解压
+ * 下一级没有暂停只是在等更多的数据（一条消息比上限还大）时继续解压，否则这条连接再也凑不齐这条消息
+ */
+void CompressionStage::inflateFrom(StageContext &ctx, Buffer *in, Timestamp receiveTime)
+{
+    uint64_t start = threadCpuNanos();
+    size_t consumedTotal = 0;
+    size_t producedTotal = 0;
+    while (in->readableBytes() > 0)
+    {
+        inflatedIn_.ensureWriteableBytes(kChunk);
+        size_t readable = in->readableBytes();
+        size_t writable = inflatedIn_.writableBytes();
+        inflater_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in->peek()));
+        inflater_->avail_in = static_cast<uInt>(readable);
+        inflater_->next_out = reinterpret_cast<Bytef*>(inflatedIn_.beginWrite());
+        inflater_->avail_out = static_cast<uInt>(writable);
+        int ret = ::inflate(inflater_, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            in->retrieveAll();
+            fail(ctx, "inflate", ret);//对端不会结束deflate流，Z_STREAM_END也是错误
+            return;
+        }
+        size_t consumed = readable - inflater_->avail_in;
+        size_t produced = writable - inflater_->avail_out;
+        in->retrieve(consumed);
+        inflatedIn_.hasWritten(produced);
+        consumedTotal += consumed;
+        producedTotal += produced;
+        if (produced > 0)
+        {
+            ctx.fireRead(&inflatedIn_, receiveTime);
+        }
+        if (inflatedIn_.readableBytes() > options_.maxInflatedBytes && nextStagePaused(ctx))
+        {
+            inflateBacklogged_ = true;
+            ctx.pauseRead();
+            break;
+        }
+        if (consumed == 0 && produced == 0)
+        {
+            break;
+        }
+    }
+    add(gCompressedBytesIn, &stats_.compressedBytesIn, consumedTotal);
+    add(gRawBytesIn, &stats_.rawBytesIn, producedTotal);
+    add(gInflateNanos, &stats_.inflateNanos, threadCpuNanos() - start);
+}
+
+#else // MYMUDUO_HAVE_ZLIB
+
+//握手中没有声明zlib，compress_总是false，下面的函数不会被调用
+bool CompressionStage::initStreams()
+{
+    return false;
+}
+
+void CompressionStage::deflateFrom(StageContext &ctx, Buffer *out, int)
+{
+    ctx.fireWrite(out);
+}
+
+void CompressionStage::inflateFrom(StageContext &ctx, Buffer *in, Timestamp receiveTime)
+{
+    ctx.fireRead(in, receiveTime);
+}
+
+#endif // MYMUDUO_HAVE_ZLIB
+
+void CompressionStage::fail(StageContext &ctx, const char *what, int ret)
+{
+    LOG_ERROR("CompressionStage [%s] %s error:%d\n", ctx.connection()->name().c_str(), what, ret);
+    ctx.connection()->forceClose();
+}
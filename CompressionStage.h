@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Pipeline.h"
+#include "Buffer.h"
+
+#include <stdint.h>
+
+struct z_stream_s;
+
+struct CompressionOptions
+{
+    bool enabled = true;//false时在握手中声明不压缩，这条连接两个方向都原样传输
+    int level = 6;//zlib压缩级别1-9
+    int memLevel = 8;//deflate内部状态的内存，约(1 << (memLevel + 9)) + (1 << (windowBits + 2))字节
+    int windowBits = 15;
+    size_t flushThreshold = 64 * 1024;//没flush的原始数据超过这么多时不等发送缓冲区写空，立即flush
+    bool flushOnDrain = true;//发送缓冲区有积压时先不flush，写空以后再flush，积压时压缩率更高
+    size_t maxInflatedBytes = 4 * 1024 * 1024;//下一级暂停读时，解压出来积压的数据超过这么多就暂停解压和读socket
+};
+
+//压缩的统计，ratio是压缩后/压缩前
+struct CompressionStats
+{
+    uint64_t rawBytesOut = 0;//压缩前的发送数据
+    uint64_t compressedBytesOut = 0;
+    uint64_t compressedBytesIn = 0;
+    uint64_t rawBytesIn = 0;//解压后的接收数据
+    uint64_t deflateNanos = 0;//deflate花费的线程CPU时间
+    uint64_t inflateNanos = 0;
+    uint64_t flushes = 0;
+
+    double outRatio() const { return rawBytesOut > 0 ? static_cast<double>(compressedBytesOut) / rawBytesOut : 1.0; }
+    double inRatio() const { return rawBytesIn > 0 ? static_cast<double>(compressedBytesIn) / rawBytesIn : 1.0; }
+};
+
+/**
+ * 流式压缩stage，用zlib的deflate/inflate，放在pipeline中靠近socket的位置（TLS之上）
+ * 建立连接时两端各发4字节的握手（"MZ"、版本、支持的算法），两端都开启时才压缩，否则原样传输；
+ * 握手完成之前send的数据先缓存，握手完成以后再压缩发送，所以两端都要加这个stage
+ * 发送：每次send的数据以Z_NO_FLUSH压进deflate流，消息边界时如果发送缓冲区是空的就Z_SYNC_FLUSH，
+ * 否则等发送缓冲区写空或者积累到flushThreshold再flush，压缩后的数据按块交给下一级，内存有上限
+ * 接收：从上一级的Buffer中增量inflate，按块交给下一级
+ * 编译时没有找到zlib（MYMUDUO_HAVE_ZLIB）时握手中声明不压缩，两个方向都原样传输；暂不支持LZ4，握手中为它保留了标志位
+ */
+class CompressionStage : public Stage
+{
+public:
+    static const size_t kChunk = 16 * 1024;// 每次deflate/inflate预留的输出空间
+    static const size_t kHelloLen = 4;
+    enum Algorithm
+    {
+        kNone = 0,
+        kZlib = 1,
+        kLz4 = 2,//保留
+    };
+
+    explicit CompressionStage(const CompressionOptions &options = CompressionOptions());
+    ~CompressionStage() override;
+
+    //TcpServer::addStage/TcpClient::addStage用的工厂
+    static StageFactory factory(const CompressionOptions &options = CompressionOptions());
+
+    bool negotiated() const { return helloReceived_; }
+    bool compressing() const { return compress_; }
+    //这条连接的统计，只在loop线程中读
+    const CompressionStats& stats() const { return stats_; }
+    //进程内所有连接的统计，任意线程都可以读
+    static CompressionStats totalStats();
+
+    void onConnected(StageContext &ctx) override;
+    void onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime) override;
+    void onWrite(StageContext &ctx, Buffer *out) override;
+    void onFlush(StageContext &ctx) override;
+    void onDrained(StageContext &ctx) override;
+    void onConsumed(StageContext &ctx) override;
+    bool hasPendingOutput() const override { return pendingOut_.readableBytes() > 0; }
+private:
+    bool handleHello(StageContext &ctx, Buffer *in);
+    bool initStreams();
+    void deflateFrom(StageContext &ctx, Buffer *out, int flush);
+    void syncFlush(StageContext &ctx);
+    void inflateFrom(StageContext &ctx, Buffer *in, Timestamp receiveTime);
+    bool nextStagePaused(StageContext &ctx) const;
+    void fail(StageContext &ctx, const char *what, int ret);
+
+    const CompressionOptions options_;
+    bool helloReceived_;
+    bool compress_;
+    bool flushPending_;//握手完成之前有过flush
+    bool inflateBacklogged_;//因为下一级积压暂停了读
+    size_t unflushed_;//压进deflate流但还没flush的原始字节数
+    z_stream_s *deflater_;
+    z_stream_s *inflater_;
+    Buffer pendingOut_;//握手完成之前send的数据
+    Buffer compressedOut_;//交给下一级（socket一端）的压缩数据
+    Buffer inflatedIn_;//交给下一级（用户一端）的解压数据
+    CompressionStats stats_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接，和Acceptor对应
+ * 非阻塞connect，注册channel的写事件等连接完成，失败以后按指数退避重试
+ * 连接成功以后把sockfd交给newConnectionCallback_，由TcpClient创建TcpConnection
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void (int sockfd)>;
+
+    static const int kInitRetryDelayMs = 500;
+    static const int kMaxRetryDelayMs = 30 * 1000;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+
+    void start();//可以在任意线程调用
+    void restart();//只能在loop线程调用，重置退避时间重新连接
+    void stop();//可以在任意线程调用
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+private:
+    enum States { kDisconnected, kConnecting, kConnected };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;//是否还要继续连接
+    States state_;
+    std::unique_ptr<Channel> channel_;//只在连接过程中存在，连上以后交给TcpConnection
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
@@ -2,6 +2,11 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "SendQueue.h"
+#include "TimerQueue.h"
+#include "BufferPool.h"
+#include "Arena.h"
+#include "MemoryBudget.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -36,6 +41,13 @@ EventLoop::EventLoop()//构造函数
     , poller_(Poller::newDefaultPoller(this)) // 生成了一个指向epollpoller的poller指针
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , sendQueue_(new SendQueue(this))
+    , timerQueue_(new TimerQueue(this))
+    , bufferBytes_(0)
+    , unpublishedBufferBytes_(0)
+    , connectionPool_(std::make_shared<ObjectPool>(threadId_))
+    , bufferPool_(new BufferPool)
+    , arena_(new Arena)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread)//这个线程已经有loop了，就不创建了 
@@ -86,6 +98,8 @@ void EventLoop::loop()
 		    subloop执行之前mainloop注册的cb操作（接收新的channel）
          */ 
         doPendingFunctors();//mainloop注册回调给subloop。 
+        publishBufferBytes();
+        arena_->reset();//这一轮回调中的临时分配到此为止
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -167,6 +181,21 @@ void EventLoop::wakeup()
     }
 }
 
+EventLoop::TimerId EventLoop::runAfter(double delay, Functor cb)
+{
+    return timerQueue_->addTimer(std::move(cb), delay, 0);
+}
+
+EventLoop::TimerId EventLoop::runEvery(double interval, Functor cb)
+{
+    return timerQueue_->addTimer(std::move(cb), interval, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 //EventLoop的方法 =》 Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -199,5 +228,20 @@ void EventLoop::doPendingFunctors()//执行回调 在loop中调用的方法
         functor();//执行当前loop需要执行的回调操作
     }
 
+    //本轮loop中延迟flush的连接在poll阻塞之前统一发送
+    //放在callingPendingFunctors_为true时做，flush中queueInLoop的回调会唤醒loop，不会等到poll超时
+    sendQueue_->flushDeferred();
+
     callingPendingFunctors_ = false;
 }
+
+void EventLoop::publishBufferBytes()
+{
+    MemoryBudget &budget = MemoryBudget::instance();
+    if (unpublishedBufferBytes_ != 0)
+    {
+        budget.publish(unpublishedBufferBytes_);//每轮循环只有一次原子操作
+        unpublishedBufferBytes_ = 0;
+    }
+    budget.resumeIfBelow();
+}
@@ -9,9 +9,14 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "ObjectPool.h"
 
 class Channel;
 class Poller;
+class SendQueue;
+class TimerQueue;
+class BufferPool;
+class Arena;
 
 //时间循环类  主要包含了两个大模块 Channel   Poller（epoll的抽象）
 class EventLoop : noncopyable
@@ -19,6 +24,7 @@ class EventLoop : noncopyable
 public:
     using Functor = std::function<void()>;//定义一个回调的类型 
     //using代替typedef，进行类型的重命名 
+    using TimerId = uint64_t;
 
     EventLoop();
     ~EventLoop();
@@ -38,6 +44,30 @@ public:
     //用来唤醒loop所在的线程的
     void wakeup();
 
+    //定时器，可以在任意线程调用，回调在loop线程中执行
+    TimerId runAfter(double delay, Functor cb);//delay秒以后执行一次
+    TimerId runEvery(double interval, Functor cb);//每隔interval秒执行一次
+    void cancel(TimerId timerId);
+
+    //其他线程发给这个loop上连接的数据，合并成批发送
+    SendQueue* sendQueue() const { return sendQueue_.get(); }
+
+    //本loop上所有连接缓冲区中的数据量，只能在loop线程中修改，每轮循环汇总到MemoryBudget一次
+    void adjustBufferBytes(int64_t delta)
+    {
+        bufferBytes_.store(bufferBytes_.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        unpublishedBufferBytes_ += delta;
+    }
+    int64_t bufferBytes() const { return bufferBytes_.load(std::memory_order_relaxed); }
+
+    //本loop线程的连接对象内存池，TcpServer在这个loop上创建的连接都从这里分配
+    const ObjectPoolPtr& connectionPool() const { return connectionPool_; }
+    //本loop线程的连接缓冲区底层数组缓存，只能在loop线程中使用
+    BufferPool* bufferPool() const { return bufferPool_.get(); }
+    //本loop线程的临时内存，回调中通过conn->getLoop()->arena()拿到，每轮循环结束时整体回收
+    //只能在loop线程中使用，要留到下一轮的对象用Arena::promote移到堆上
+    Arena* arena() const { return arena_.get(); }
+
     //EventLoop的方法 调用 Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
@@ -48,6 +78,7 @@ public:
 private:
     void handleRead();//wake up
     void doPendingFunctors();//执行回调
+    void publishBufferBytes();//把本轮循环缓冲区的变化汇总到MemoryBudget
 
     using ChannelList = std::vector<Channel*>;
 
@@ -68,4 +99,14 @@ private:
     std::atomic_bool callingPendingFunctors_;//标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_;//存储loop需要执行的所有的回调操作
     std::mutex mutex_;//互斥锁，用来保护上面vector容器的线程安全操作
+
+    std::unique_ptr<SendQueue> sendQueue_;
+    std::unique_ptr<TimerQueue> timerQueue_;
+
+    std::atomic<int64_t> bufferBytes_;
+    int64_t unpublishedBufferBytes_;
+
+    ObjectPoolPtr connectionPool_;
+    std::unique_ptr<BufferPool> bufferPool_;
+    std::unique_ptr<Arena> arena_;
 };
@@ -0,0 +1,168 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static const char kCRLF[] = "\r\n";
+static const char kHeaderEnd[] = "\r\n\r\n";
+
+HttpContext::HttpContext(Arena *arena)
+    : scanned_(0)
+    , headerLength_(0)
+    , bodyLength_(0)
+    , arena_(arena)
+    , streaming_(false)
+{
+}
+
+void HttpContext::reset()
+{
+    scanned_ = 0;
+    headerLength_ = 0;
+    bodyLength_ = 0;
+    request_.reset(arena_);
+}
+
+void HttpContext::consume(Buffer *buf)
+{
+    buf->retrieve(headerLength_ + bodyLength_);
+    reset();
+}
+
+HttpContext::ParseResult HttpContext::parse(Buffer *buf, Timestamp receiveTime)
+{
+    const char *data = buf->peek();
+    size_t readable = buf->readableBytes();
+
+    bool headerKnown = headerLength_ > 0;
+    if (!headerKnown)
+    {
+        //"\r\n\r\n"可能跨在上次数据的末尾，往回多看3个字节
+        size_t from = scanned_ >= 3 ? scanned_ - 3 : 0;
+        const char *end = buf->find(data + from, kHeaderEnd, 4);
+        if (end == nullptr)
+        {
+            scanned_ = readable;
+            return readable > kMaxHeaderSize ? kHeaderTooLarge : kNeedMore;
+        }
+        headerLength_ = end + 4 - data;
+        if (headerLength_ > kMaxHeaderSize)
+        {
+            return kHeaderTooLarge;
+        }
+    }
+
+    //Buffer扩容或者搬移数据以后原来的指针就失效了，所以每次都按当前的peek()重新切分头部
+    request_.reset(arena_);
+    const char *lineEnd = buf->findCRLF();
+    if (!parseRequestLine(data, lineEnd)
+        || !parseHeaders(lineEnd + 2, data + headerLength_ - 2))
+    {
+        return kBadRequest;
+    }
+
+    if (!headerKnown)
+    {
+        if (!request_.getHeader("Transfer-Encoding").empty())
+        {
+            return kNotImplemented;
+        }
+        StringPiece contentLength = request_.getHeader("Content-Length");
+        if (!contentLength.empty())
+        {
+            std::string digits = contentLength.toString();
+            char *endptr = nullptr;
+            unsigned long long length = ::strtoull(digits.c_str(), &endptr, 10);
+            if (*endptr != '\0' || digits[0] == '-')
+            {
+                return kBadRequest;
+            }
+            if (length > kMaxBodySize)
+            {
+                return kBodyTooLarge;
+            }
+            bodyLength_ = static_cast<size_t>(length);
+        }
+    }
+
+    if (readable < headerLength_ + bodyLength_)
+    {
+        return kNeedMore;
+    }
+    request_.body_.set(data + headerLength_, bodyLength_);
+    request_.receiveTime_ = receiveTime;
+    return kGotRequest;
+}
+
+// GET /index.html?a=1 HTTP/1.1
+bool HttpContext::parseRequestLine(const char *begin, const char *end)
+{
+    const char *space = std::find(begin, end, ' ');
+    if (space == begin || space == end)
+    {
+        return false;
+    }
+    request_.method_.set(begin, space - begin);
+
+    const char *start = space + 1;
+    space = std::find(start, end, ' ');
+    if (space == start || space == end)
+    {
+        return false;
+    }
+    const char *question = std::find(start, space, '?');
+    request_.path_.set(start, question - start);
+    if (question != space)
+    {
+        request_.query_.set(question + 1, space - question - 1);
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// begin是第一个头部的开头，end是最后一个头部的"\r\n"之后
+bool HttpContext::parseHeaders(const char *begin, const char *end)
+{
+    while (begin < end)
+    {
+        const char *lineEnd = static_cast<const char*>(::memmem(begin, end - begin, kCRLF, 2));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+        const char *colon = std::find(begin, lineEnd, ':');
+        if (colon == begin || colon == lineEnd)
+        {
+            return false;
+        }
+        const char *valueBegin = colon + 1;
+        const char *valueEnd = lineEnd;
+        while (valueBegin < valueEnd && (*valueBegin == ' ' || *valueBegin == '\t'))
+        {
+            ++valueBegin;
+        }
+        while (valueEnd > valueBegin && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        {
+            --valueEnd;
+        }
+        request_.headers_.push_back(HttpRequest::Header(
+            StringPiece(begin, colon - begin), StringPiece(valueBegin, valueEnd - valueBegin)));
+        begin = lineEnd + 2;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "Timestamp.h"
+
+#include <string>
+
+class Buffer;
+class Arena;
+
+/**
+ * 每条HTTP连接一个，保存增量解析的状态
+ * 请求头没收全时记住已经找过的位置，新数据到来只扫描新增的部分；
+ * 解析出来的HttpRequest直接指向Buffer中的数据，处理完以后调用consume取走这个请求
+ * 给了arena（连接所属loop的arena()）时头部列表从arena分配，只能在这个loop线程中解析
+ */
+class HttpContext : noncopyable
+{
+public:
+    static const size_t kMaxHeaderSize = 64 * 1024;// 请求行加头部的最大长度
+    static const size_t kMaxBodySize = 8 * 1024 * 1024;// 请求体的最大长度
+
+    enum ParseResult
+    {
+        kNeedMore,//请求还没收全
+        kGotRequest,//request()可以使用
+        kBadRequest,
+        kHeaderTooLarge,
+        kBodyTooLarge,
+        kNotImplemented,//请求体用了chunked编码
+    };
+
+    explicit HttpContext(Arena *arena = nullptr);
+
+    //从buf的可读数据开头解析一个请求，不取走数据
+    ParseResult parse(Buffer *buf, Timestamp receiveTime);
+    const HttpRequest& request() const { return request_; }
+    //处理完request()以后调用，从buf中取走这个请求，准备解析下一个
+    void consume(Buffer *buf);
+
+    //组装响应用的临时空间，在同一条连接的请求之间复用
+    std::string& scratch() { return scratch_; }
+
+    //正在发送流式响应，后面的请求等流结束以后再处理
+    void setStreaming(bool on) { streaming_ = on; }
+    bool streaming() const { return streaming_; }
+private:
+    bool parseRequestLine(const char *begin, const char *end);
+    bool parseHeaders(const char *begin, const char *end);
+    void reset();
+
+    size_t scanned_;//已经找过"\r\n\r\n"的字节数
+    size_t headerLength_;//请求行加头部的长度，0表示头部还没收全
+    size_t bodyLength_;
+    Arena *arena_;
+    HttpRequest request_;
+    std::string scratch_;
+    bool streaming_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+#include "Arena.h"
+
+#include <vector>
+#include <utility>
+
+/**
+ * 一个HTTP请求，所有字段都是指向连接inputBuffer_的视图，解析时不拷贝
+ * 只在HttpServer的回调中有效，回调返回以后这些数据就被取走了，需要保留的字段用toString拷贝
+ * 头部列表从loop的Arena分配，这一轮循环结束就回收，连接空闲时不占内存
+ */
+class HttpRequest
+{
+public:
+    enum Version { kUnknown, kHttp10, kHttp11 };
+    using Header = std::pair<StringPiece, StringPiece>;
+    using HeaderList = ArenaVector<Header>;
+
+    HttpRequest()
+        : version_(kUnknown)
+    {}
+
+    StringPiece method() const { return method_; }
+    StringPiece path() const { return path_; }
+    StringPiece query() const { return query_; }//不包括'?'
+    Version version() const { return version_; }
+    StringPiece body() const { return body_; }
+    Timestamp receiveTime() const { return receiveTime_; }
+    const HeaderList& headers() const { return headers_; }
+
+    //头部名字忽略大小写，没有这个头部时返回空的StringPiece
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for (const Header &header : headers_)
+        {
+            if (header.first.caseEqual(field))
+            {
+                return header.second;
+            }
+        }
+        return StringPiece();
+    }
+
+    //HTTP/1.1默认保持连接，HTTP/1.0需要Connection: keep-alive
+    bool keepAlive() const
+    {
+        StringPiece connection = getHeader("Connection");
+        if (version_ == kHttp11)
+        {
+            return !connection.caseEqual("close");
+        }
+        return connection.caseEqual("keep-alive");
+    }
+private:
+    friend class HttpContext;
+
+    //每次解析之前调用；arena上次分配的内存可能已经在循环结束时回收了，所以换一个新的空列表，不能clear以后接着用
+    void reset(Arena *arena)
+    {
+        method_.clear();
+        path_.clear();
+        query_.clear();
+        version_ = kUnknown;
+        body_.clear();
+        if (arena != nullptr)
+        {
+            headers_ = HeaderList(ArenaAllocator<Header>(arena));
+        }
+        else
+        {
+            headers_.clear();//保留vector的容量，下一个请求不用再分配
+        }
+    }
+
+    StringPiece method_;
+    StringPiece path_;
+    StringPiece query_;
+    Version version_;
+    StringPiece body_;
+    Timestamp receiveTime_;
+    HeaderList headers_;
+};
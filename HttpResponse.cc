@@ -0,0 +1,49 @@
+#include "HttpResponse.h"
+
+#include <stdio.h>
+
+void HttpResponse::appendHeaders(std::string *out) const
+{
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
+    out->append(buf, n);
+    out->append(statusMessage_);
+    out->append("\r\n", 2);
+
+    if (chunked_)
+    {
+        out->append("Transfer-Encoding: chunked\r\n");
+    }
+    else
+    {
+        size_t length = bodyPayload_ ? bodyPayload_->size() : body_.size();
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", length);
+        out->append(buf, n);
+    }
+
+    if (closeConnection_)
+    {
+        out->append("Connection: close\r\n");
+    }
+    else
+    {
+        out->append("Connection: Keep-Alive\r\n");
+    }
+
+    out->append(headers_.data(), headers_.size());
+    out->append("\r\n", 2);
+}
+
+HttpStreamPtr HttpResponse::startStream()
+{
+    if (!conn_)
+    {
+        return HttpStreamPtr();
+    }
+    if (!stream_)
+    {
+        stream_ = std::make_shared<HttpStream>(conn_);
+        chunked_ = true;
+    }
+    return stream_;
+}
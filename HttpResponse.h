@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Payload.h"
+#include "HttpStream.h"
+#include "Arena.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * HTTP响应，由HttpServer的回调填写
+ * 响应体可以是string，也可以是共享的Payload（只持有引用，和响应头一起用writev发送，不拷贝）
+ * chunked模式下按addChunk的顺序用Transfer-Encoding: chunked发送，不需要事先知道总长度
+ * addChunk的数据要等回调返回才一起发送；边产生边发送用startStream
+ * HttpServer创建的响应，addHeader的头部拼在loop的Arena上，只在回调期间有效
+ */
+class HttpResponse
+{
+public:
+    static const size_t kInlineBodySize = 1024;// 小于这个长度的Payload直接拷贝到文本中，少一个iovec
+
+    enum HttpStatusCode
+    {
+        kUnknown,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k400BadRequest = 400,
+        k404NotFound = 404,
+        k413PayloadTooLarge = 413,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+    };
+
+    explicit HttpResponse(bool close)
+        : statusCode_(kUnknown)
+        , closeConnection_(close)
+        , chunked_(false)
+    {}
+    //HttpServer用的构造函数，可以startStream，arena是连接所属loop的arena()
+    HttpResponse(bool close, const TcpConnectionPtr &conn, Arena *arena)
+        : statusCode_(kUnknown)
+        , closeConnection_(close)
+        , chunked_(false)
+        , headers_(ArenaAllocator<char>(arena))
+        , conn_(conn)
+    {}
+
+    void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
+    void setStatusMessage(const std::string &message) { statusMessage_ = message; }
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(const std::string &contentType) { addHeader("Content-Type", contentType); }
+    void addHeader(StringPiece key, StringPiece value)
+    {
+        headers_.append(key.data(), key.size());
+        headers_.append(": ", 2);
+        headers_.append(value.data(), value.size());
+        headers_.append("\r\n", 2);
+    }
+
+    void setBody(const std::string &body) { body_ = body; }
+    void setBody(std::string &&body) { body_ = std::move(body); }
+    //共享的响应体，多个响应发送同一份数据时不拷贝
+    void setBody(const PayloadPtr &body) { bodyPayload_ = body; }
+
+    //chunked响应，设置以后setBody的内容不再发送
+    void setChunked(bool on) { chunked_ = on; }
+    bool chunked() const { return chunked_; }
+    void addChunk(std::string data) { chunks_.push_back(makePayload(std::move(data))); }
+    void addChunk(const PayloadPtr &data) { chunks_.push_back(data); }
+
+    //流式的chunked响应，回调返回以后发送响应头和addChunk的数据，之后的chunk通过HttpStream逐个发送
+    //不是HttpServer创建的响应返回nullptr
+    HttpStreamPtr startStream();
+    const HttpStreamPtr& stream() const { return stream_; }
+
+    /**
+     * 把响应组装成要发送的片段：连续的小块（状态行、头部、string响应体、chunk的长度行）
+     * 追加到out中，遇到不小于kInlineBodySize的Payload时先把out交给sendText，再把Payload交给sendPayload
+     * 最后剩在out中的数据由调用者发送，这样多个流水线请求的响应可以合并成一次发送
+     * headOnly为true时只发送头部（HEAD请求）
+     */
+    template <typename TextSink, typename PayloadSink>
+    void serialize(std::string *out, bool headOnly, TextSink sendText, PayloadSink sendPayload) const;
+    //一个chunk的长度行、数据和结尾的CRLF，规则同serialize，长度为0的chunk由调用者跳过
+    template <typename TextSink, typename PayloadSink>
+    static void serializeChunk(const PayloadPtr &chunk, std::string *out, TextSink sendText, PayloadSink sendPayload);
+private:
+    void appendHeaders(std::string *out) const;
+
+    HttpStatusCode statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool chunked_;
+    ArenaString headers_;//已经拼好的"key: value\r\n"
+    std::string body_;
+    PayloadPtr bodyPayload_;
+    std::vector<PayloadPtr> chunks_;
+    TcpConnectionPtr conn_;
+    HttpStreamPtr stream_;
+};
+
+template <typename TextSink, typename PayloadSink>
+void HttpResponse::serialize(std::string *out, bool headOnly, TextSink sendText, PayloadSink sendPayload) const
+{
+    appendHeaders(out);
+    if (headOnly)
+    {
+        return;
+    }
+
+    if (chunked_)
+    {
+        for (const PayloadPtr &chunk : chunks_)
+        {
+            if (chunk->size() == 0)
+            {
+                continue;//长度为0的chunk表示结束，不能出现在中间
+            }
+            serializeChunk(chunk, out, sendText, sendPayload);
+        }
+        if (!stream_)
+        {
+            out->append("0\r\n\r\n", 5);//流式响应由HttpStream::finish结束
+        }
+    }
+    else if (bodyPayload_ && bodyPayload_->size() < kInlineBodySize)
+    {
+        out->append(bodyPayload_->data(), bodyPayload_->size());
+    }
+    else if (bodyPayload_)
+    {
+        sendText(out);
+        sendPayload(bodyPayload_);
+    }
+    else
+    {
+        out->append(body_);
+    }
+}
+
+template <typename TextSink, typename PayloadSink>
+void HttpResponse::serializeChunk(const PayloadPtr &chunk, std::string *out, TextSink sendText, PayloadSink sendPayload)
+{
+    char sizeLine[32];
+    int n = snprintf(sizeLine, sizeof sizeLine, "%zx\r\n", chunk->size());
+    out->append(sizeLine, n);
+    if (chunk->size() < kInlineBodySize)
+    {
+        out->append(chunk->data(), chunk->size());
+    }
+    else
+    {
+        sendText(out);
+        sendPayload(chunk);
+    }
+    out->append("\r\n", 2);
+}
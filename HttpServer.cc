@@ -0,0 +1,162 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <memory>
+
+//没有设置回调时所有请求都返回404
+static void defaultHttpCallback(const HttpRequest&, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+    resp->setCloseConnection(true);
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &name,
+                TcpServer::Option option)
+    : loop_(loop)
+    , server_(loop, listenAddr, name, option)
+    , httpCallback_(defaultHttpCallback)
+{
+    server_.setConnectionCallback(
+        std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&HttpServer::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    LOG_INFO("HttpServer[%s] starts listening on %s\n",
+        server_.name().c_str(), server_.ipPort().c_str());
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<HttpContext>(conn->getLoop()->arena()));
+        //同一轮loop中产生的响应合并到一次writev
+        conn->setDeferredFlush(true);
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    if (!conn->connected())
+    {
+        buf->retrieveAll();//已经决定关闭连接，后面的请求不再处理
+        return;
+    }
+
+    HttpContext *context = static_cast<HttpContext*>(conn->getContext().get());
+    if (context->streaming())
+    {
+        return;//流式响应还没结束，请求留在缓冲区中
+    }
+    while (buf->readableBytes() > 0)
+    {
+        HttpContext::ParseResult result = context->parse(buf, receiveTime);
+        if (result == HttpContext::kNeedMore)
+        {
+            break;
+        }
+        if (result != HttpContext::kGotRequest)
+        {
+            switch (result)
+            {
+            case HttpContext::kHeaderTooLarge:
+                sendError(conn, HttpResponse::k431HeaderFieldsTooLarge, "Request Header Fields Too Large");
+                break;
+            case HttpContext::kBodyTooLarge:
+                sendError(conn, HttpResponse::k413PayloadTooLarge, "Payload Too Large");
+                break;
+            case HttpContext::kNotImplemented:
+                sendError(conn, HttpResponse::k501NotImplemented, "Not Implemented");
+                break;
+            default:
+                sendError(conn, HttpResponse::k400BadRequest, "Bad Request");
+                break;
+            }
+            buf->retrieveAll();
+            break;
+        }
+
+        const HttpRequest &request = context->request();
+        HttpResponse response(!request.keepAlive(), conn, conn->getLoop()->arena());
+        httpCallback_(request, &response);
+        bool headOnly = request.method() == "HEAD";
+        sendResponse(conn, response, headOnly, &context->scratch());
+        //回调返回以后request指向的数据才可以取走
+        context->consume(buf);
+
+        if (response.stream() && response.stream()->start(headOnly,
+                std::bind(&HttpServer::onStreamFinished, this, conn, response.closeConnection())))
+        {
+            //流结束之前停止读，已经收到的流水线请求留在缓冲区中
+            context->setStreaming(true);
+            conn->stopRead();
+            break;
+        }
+
+        if (response.closeConnection())
+        {
+            conn->shutdown();//延迟flush的数据发送完以后才关闭写端
+            buf->retrieveAll();
+            break;
+        }
+    }
+}
+
+void HttpServer::onStreamFinished(const TcpConnectionPtr &conn, bool closeConnection)
+{
+    HttpContext *context = static_cast<HttpContext*>(conn->getContext().get());
+    if (!conn->connected() || context == nullptr)
+    {
+        return;
+    }
+    context->setStreaming(false);
+    if (closeConnection)
+    {
+        conn->shutdown();
+        return;
+    }
+    conn->startRead();
+    if (conn->inputBuffer()->readableBytes() > 0)
+    {
+        onMessage(conn, conn->inputBuffer(), Timestamp::now());
+        conn->inputConsumed();
+    }
+}
+
+void HttpServer::sendResponse(const TcpConnectionPtr &conn, const HttpResponse &response, bool headOnly, std::string *scratch)
+{
+    scratch->clear();
+    //响应头和小的响应体拷贝进发送缓冲区，大的Payload只持有引用，flush时一起writev
+    auto sendText = [&conn](std::string *text) {
+        if (!text->empty())
+        {
+            conn->send(*text);
+            text->clear();
+        }
+    };
+    auto sendPayload = [&conn](const PayloadPtr &payload) {
+        conn->send(payload);
+    };
+    response.serialize(scratch, headOnly, sendText, sendPayload);
+    sendText(scratch);
+}
+
+void HttpServer::sendError(const TcpConnectionPtr &conn, HttpResponse::HttpStatusCode code, const char *message)
+{
+    HttpResponse response(true);
+    response.setStatusCode(code);
+    response.setStatusMessage(message);
+    HttpContext *context = static_cast<HttpContext*>(conn->getContext().get());
+    sendResponse(conn, response, false, &context->scratch());
+    conn->shutdown();
+}
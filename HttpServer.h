@@ -0,0 +1,46 @@
+#pragma once
+
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "noncopyable.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器
+ * 请求在连接的inputBuffer_中增量解析，HttpRequest直接指向缓冲区不拷贝；
+ * 一次读到的多个流水线请求在同一次messageCallback中依次处理，
+ * 响应追加到连接的发送缓冲区，连接开启延迟flush，本轮loop结束时所有响应一次writev发出
+ */
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+
+    HttpServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &name,
+                TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop* getLoop() const { return loop_; }
+    //线程数、socket参数等在底层的TcpServer上设置
+    TcpServer& server() { return server_; }
+
+    //在连接所属的loop线程中调用，request只在回调期间有效
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+
+    void start();
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onStreamFinished(const TcpConnectionPtr &conn, bool closeConnection);
+    void sendResponse(const TcpConnectionPtr &conn, const HttpResponse &response, bool headOnly, std::string *scratch);
+    void sendError(const TcpConnectionPtr &conn, HttpResponse::HttpStatusCode code, const char *message);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+};
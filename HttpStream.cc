@@ -0,0 +1,135 @@
+#include "HttpStream.h"
+#include "HttpResponse.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+
+HttpStream::HttpStream(const TcpConnectionPtr &conn)
+    : conn_(conn)
+    , started_(false)
+    , headOnly_(false)
+    , finished_(false)
+    , finishCalled_(false)
+{
+}
+
+HttpStream::~HttpStream()
+{
+    //排队中的write和finish都持有this，走到这里说明loop线程中已经没有这个流的任务了
+    if (!finishCalled_ && started_)
+    {
+        TcpConnectionPtr conn(conn_);
+        bool headOnly = headOnly_;
+        FinishCallback cb(finishCallback_);
+        conn->getLoop()->runInLoop([conn, headOnly, cb]() {
+            if (!headOnly)
+            {
+                sendTerminator(conn);
+            }
+            if (cb)
+            {
+                cb();
+            }
+        });
+    }
+}
+
+bool HttpStream::connected() const
+{
+    return conn_->connected();
+}
+
+void HttpStream::write(const PayloadPtr &data)
+{
+    conn_->getLoop()->runInLoop(std::bind(&HttpStream::writeInLoop, shared_from_this(), data));
+}
+
+void HttpStream::finish()
+{
+    finishCalled_ = true;
+    conn_->getLoop()->runInLoop(std::bind(&HttpStream::finishInLoop, shared_from_this()));
+}
+
+bool HttpStream::start(bool headOnly, const FinishCallback &cb)
+{
+    started_ = true;
+    headOnly_ = headOnly;
+    std::vector<PayloadPtr> pending;
+    pending.swap(pending_);
+    for (const PayloadPtr &data : pending)
+    {
+        writeInLoop(data);
+    }
+    if (finished_)
+    {
+        if (!headOnly_)
+        {
+            sendTerminator(conn_);
+        }
+        return false;
+    }
+    finishCallback_ = cb;
+    return true;
+}
+
+void HttpStream::writeInLoop(const PayloadPtr &data)
+{
+    if (finished_ || data->size() == 0)
+    {
+        return;//长度为0的chunk表示结束，不能出现在中间
+    }
+    if (!started_)
+    {
+        pending_.push_back(data);
+        return;
+    }
+    if (headOnly_ || !conn_->connected())
+    {
+        return;
+    }
+    //和HttpServer::sendResponse一样，小块拷贝进发送缓冲区，大的Payload只持有引用
+    const TcpConnectionPtr &conn = conn_;
+    auto sendText = [&conn](std::string *text) {
+        if (!text->empty())
+        {
+            conn->send(*text);
+            text->clear();
+        }
+    };
+    auto sendPayload = [&conn](const PayloadPtr &payload) {
+        conn->send(payload);
+    };
+    scratch_.clear();
+    HttpResponse::serializeChunk(data, &scratch_, sendText, sendPayload);
+    sendText(&scratch_);
+}
+
+void HttpStream::finishInLoop()
+{
+    if (finished_)
+    {
+        return;
+    }
+    finished_ = true;
+    if (!started_)
+    {
+        return;//回调还没返回，start时发送结束标记
+    }
+    if (!headOnly_)
+    {
+        sendTerminator(conn_);
+    }
+    FinishCallback cb;
+    cb.swap(finishCallback_);//回调持有连接，用完就释放
+    if (cb)
+    {
+        cb();
+    }
+}
+
+void HttpStream::sendTerminator(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->send(std::string("0\r\n\r\n", 5));
+    }
+}
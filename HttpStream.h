@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Payload.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <vector>
+
+class HttpStream;
+using HttpStreamPtr = std::shared_ptr<HttpStream>;
+
+/**
+ * 流式的chunked响应，在HttpCallback中通过HttpResponse::startStream得到
+ * 回调返回以后HttpServer先发送响应头和已经addChunk的数据，之后每次write立即作为一个chunk发送，
+ * finish发送结束的空chunk；流结束之前连接停止读，后面的流水线请求等流结束以后再处理
+ * write和finish可以在任意线程调用，数据转到连接所属的loop线程发送
+ * 没有调用finish就析构时自动结束
+ */
+class HttpStream : noncopyable, public std::enable_shared_from_this<HttpStream>
+{
+public:
+    //流结束以后回调，HttpServer用它恢复处理这条连接上后面的请求
+    using FinishCallback = std::function<void ()>;
+
+    explicit HttpStream(const TcpConnectionPtr &conn);
+    ~HttpStream();
+
+    //连接已经断开时返回false，生产者可以据此停止
+    bool connected() const;
+
+    void write(const std::string &data) { write(makePayload(data)); }
+    void write(std::string &&data) { write(makePayload(std::move(data))); }
+    void write(const char *data, size_t len) { write(makePayload(data, len)); }
+    void write(const PayloadPtr &data);
+    void finish();
+
+    /**
+     * HttpServer在响应头发送以后调用，只在loop线程中调用
+     * 回调中已经write的数据这时才发出去；回调中已经finish时发送结束标记并返回false，不再回调finishCallback
+     */
+    bool start(bool headOnly, const FinishCallback &cb);
+private:
+    void writeInLoop(const PayloadPtr &data);
+    void finishInLoop();
+    static void sendTerminator(const TcpConnectionPtr &conn);
+
+    TcpConnectionPtr conn_;
+    bool started_;//响应头已经发出去了，只在loop线程中访问
+    bool headOnly_;//HEAD请求，只有响应头
+    bool finished_;
+    std::atomic_bool finishCalled_;//析构时判断是否要自动结束
+    std::vector<PayloadPtr> pending_;//start之前write的数据
+    FinishCallback finishCallback_;
+    std::string scratch_;
+};
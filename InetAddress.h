@@ -2,25 +2,48 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <string>
 
-//封装socket地址类型
+//封装socket地址类型，支持IPv4和AF_UNIX（包括abstract namespace）
 class InetAddress
 {
 public:
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
     explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
-    {}
-    
+    {
+        setSockAddr(addr);
+    }
+
+    //AF_UNIX地址，abstract为true时是abstract namespace，不在文件系统中创建文件
+    //path放不进sun_path时返回无效地址（valid()为false），不截断成另一个路径
+    static InetAddress fromUnixPath(const std::string &path, bool abstract = false);
+    //accept/getsockname/getpeername得到的任意地址
+    static InetAddress fromSockAddr(const sockaddr *addr, socklen_t len);
     
     // 获取ip和port的函数
     std::string toIp() const;
-    std::string toIpPort() const;
+    std::string toIpPort() const;//AF_UNIX地址返回unix:path，abstract地址返回unix:@name
     uint16_t toPort() const;
 
+    sa_family_t family() const { return addr_.sin_family; }
+    bool valid() const { return family() != AF_UNSPEC; }
+    bool isUnix() const { return family() == AF_UNIX; }
+    //AF_UNIX的文件路径，abstract地址不包括开头的'\0'
+    std::string unixPath() const;
+    bool isAbstract() const { return isUnix() && len_ > offsetof(sockaddr_un, sun_path) && addrUn_.sun_path[0] == '\0'; }
+
     const sockaddr_in* getSockAddr() const {return &addr_;}
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+    const sockaddr* getSockAddrGeneric() const { return reinterpret_cast<const sockaddr*>(&addr_); }
+    socklen_t getSockLen() const { return len_; }
+    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; len_ = sizeof addr; }
 private:
-    sockaddr_in addr_;
+    union
+    {
+        sockaddr_in addr_;
+        sockaddr_un addrUn_;
+    };
+    socklen_t len_;//bind/connect时传给内核的长度，abstract地址的长度决定了名字
 };
@@ -1,14 +1,71 @@
 #include "InetAddress.h"
+#include "Logger.h"
 
 #include <strings.h>
 #include <string.h>
+#include <stddef.h>
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    bzero(&addr_, sizeof addr_);//addr_清0了，相当于memset
+    bzero(&addrUn_, sizeof addrUn_);//addr_清0了，相当于memset
     addr_.sin_family = AF_INET;
     addr_.sin_port = htons(port);//转成网络字节序
     addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    len_ = sizeof addr_;
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path, bool abstract)
+{
+    InetAddress addr;
+    bzero(&addr.addrUn_, sizeof addr.addrUn_);
+    addr.addrUn_.sun_family = AF_UNIX;
+    //abstract地址的第一个字节是'\0'，名字不要求以'\0'结尾
+    size_t offset = abstract ? 1 : 0;
+    size_t maxLen = sizeof addr.addrUn_.sun_path - offset - (abstract ? 0 : 1);
+    if (path.size() > maxLen)
+    {
+        LOG_ERROR("InetAddress::fromUnixPath path %s is longer than %lu bytes \n",
+            path.c_str(), static_cast<unsigned long>(maxLen));
+        addr.addrUn_.sun_family = AF_UNSPEC;
+        addr.len_ = 0;
+        return addr;
+    }
+    size_t len = path.size();
+    memcpy(addr.addrUn_.sun_path + offset, path.data(), len);
+    addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + offset + len + (abstract ? 0 : 1));
+    return addr;
+}
+
+InetAddress InetAddress::fromSockAddr(const sockaddr *sa, socklen_t len)
+{
+    InetAddress addr;
+    bzero(&addr.addrUn_, sizeof addr.addrUn_);
+    if (len > sizeof addr.addrUn_)
+    {
+        len = sizeof addr.addrUn_;
+    }
+    memcpy(&addr.addrUn_, sa, len);
+    addr.len_ = len;
+    if (len < sizeof(sa_family_t))
+    {
+        addr.addrUn_.sun_family = AF_UNIX;//未命名的unix socket，getsockname只返回family或者长度为0
+        addr.len_ = sizeof(sa_family_t);
+    }
+    return addr;
+}
+
+std::string InetAddress::unixPath() const
+{
+    if (!isUnix() || len_ <= offsetof(sockaddr_un, sun_path))
+    {
+        return std::string();
+    }
+    size_t len = len_ - offsetof(sockaddr_un, sun_path);
+    if (addrUn_.sun_path[0] == '\0')
+    {
+        return std::string(addrUn_.sun_path + 1, len - 1);
+    }
+    return std::string(addrUn_.sun_path, strnlen(addrUn_.sun_path, len));
 }
 
 std::string InetAddress::toIp() const//打印IP地址
@@ -21,6 +78,10 @@ std::string InetAddress::toIp() const//打印IP地址
 
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        return (isAbstract() ? "unix:@" : "unix:") + unixPath();
+    }
     //ip:port
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
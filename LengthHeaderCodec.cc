@@ -0,0 +1,132 @@
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+#include "BatchReply.h"
+
+#include <utility>
+
+const size_t LengthHeaderCodec::kMaxReserveSize;
+
+LengthHeaderCodec::LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize)
+    : frameCallback_(cb)
+    , maxFrameSize_(maxFrameSize)
+{
+}
+
+/**
+ * 帧不大时一次留出整个帧的空间，不用随着数据到来反复扩容；
+ * 大帧只先留kMaxReserveSize，长度头是对端说了算的，数据真的到了才继续扩容
+ */
+void LengthHeaderCodec::reserveFrame(Buffer *buf, size_t frameLen)
+{
+    size_t missing = frameLen - buf->readableBytes();
+    buf->ensureWriteableBytes(missing < kMaxReserveSize ? missing : kMaxReserveSize);
+}
+
+bool LengthHeaderCodec::checkLength(const TcpConnectionPtr &conn, Buffer *buf, size_t len)
+{
+    if (len <= maxFrameSize_)
+    {
+        return true;
+    }
+    if (errorCallback_)
+    {
+        errorCallback_(conn, len);
+    }
+    else
+    {
+        LOG_ERROR("LengthHeaderCodec [%s] invalid frame length %zu, max %zu\n",
+            conn->name().c_str(), len, maxFrameSize_);
+        conn->forceClose();
+    }
+    buf->retrieveAll();
+    return false;
+}
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    if (batchCallback_)
+    {
+        dispatchBatch(conn, buf, receiveTime);
+        return;
+    }
+    while (buf->readableBytes() >= kHeaderLen)
+    {
+        size_t len = static_cast<uint32_t>(buf->peekInt32());
+        if (!checkLength(conn, buf, len))
+        {
+            break;
+        }
+
+        size_t frameLen = kHeaderLen + len;
+        if (buf->readableBytes() < frameLen)
+        {
+            reserveFrame(buf, frameLen);
+            break;
+        }
+        frameCallback_(conn, StringPiece(buf->peek() + kHeaderLen, len), receiveTime);
+        buf->retrieve(frameLen);
+    }
+}
+
+/**
+ * 先找出所有完整的帧，视图都指向buf，回调返回以后一起取走
+ * 帧列表每个loop线程一份，反复使用不再分配
+ */
+void LengthHeaderCodec::dispatchBatch(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    static thread_local std::vector<StringPiece> frames;
+    frames.clear();
+    const char *p = buf->peek();
+    size_t remaining = buf->readableBytes();
+    while (remaining >= kHeaderLen)
+    {
+        int32_t be32 = 0;
+        ::memcpy(&be32, p, sizeof be32);
+        size_t len = static_cast<uint32_t>(be32toh(be32));
+        if (len > maxFrameSize_)
+        {
+            break;//前面完整的帧照常处理，非法的长度头留到最后报错
+        }
+        size_t frameLen = kHeaderLen + len;
+        if (remaining < frameLen)
+        {
+            break;
+        }
+        frames.push_back(StringPiece(p + kHeaderLen, len));
+        p += frameLen;
+        remaining -= frameLen;
+    }
+
+    if (!frames.empty())
+    {
+        {
+            BatchReply reply(conn, true);
+            batchCallback_(conn, frames, &reply, receiveTime);
+        }//析构时一次发出这一批的回复
+        buf->retrieve(p - buf->peek());
+        frames.clear();
+    }
+
+    if (buf->readableBytes() >= kHeaderLen)
+    {
+        size_t len = static_cast<uint32_t>(buf->peekInt32());
+        if (checkLength(conn, buf, len))
+        {
+            reserveFrame(buf, kHeaderLen + len);
+        }
+    }
+}
+
+bool LengthHeaderCodec::send(const TcpConnectionPtr &conn, StringPiece message) const
+{
+    Buffer buf(message.size());
+    buf.append(message.data(), message.size());
+    return send(conn, &buf);
+}
+
+bool LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf) const
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+    return conn->send(std::move(*buf));
+}
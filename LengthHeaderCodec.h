@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <vector>
+
+class BatchReply;
+
+/**
+ * 4字节网络字节序长度头 + 消息体的分帧编解码
+ * 收到完整的帧以后把指向inputBuffer_的视图交给frameCallback，不拷贝，回调返回以后帧被取走
+ * 发送时消息体写进Buffer，长度头prepend到kCheapPrepend的空间里，不需要搬移消息体
+ * 设置了batchCallback时，一次读到的所有完整帧一起交给batchCallback，回复攒在BatchReply中，
+ * 回调返回以后一次writev发出去，处理函数也可以把一批请求合并成一次后端查询
+ */
+class LengthHeaderCodec : noncopyable
+{
+public:
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameSize = 16 * 1024 * 1024;
+    //收到长度头以后最多为这个帧预留这么多空间，剩下的随着数据到来再扩容，
+    //只发长度头不发数据的对端不能让每条连接都占着maxFrameSize的内存
+    static const size_t kMaxReserveSize = 64 * 1024;
+
+    //frame只在回调期间有效
+    using FrameCallback = std::function<void (const TcpConnectionPtr&, StringPiece, Timestamp)>;
+    //长度头超过maxFrameSize时回调，默认打印错误并关闭连接
+    using ErrorCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+    //frames按到达顺序，只在回调期间有效；reply中的回复自动加长度头
+    using BatchCallback = std::function<void (const TcpConnectionPtr&, const std::vector<StringPiece>&,
+                                              BatchReply*, Timestamp)>;
+
+    explicit LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize = kDefaultMaxFrameSize);
+
+    void setErrorCallback(const ErrorCallback &cb) { errorCallback_ = cb; }
+    //设置以后不再逐帧调用frameCallback
+    void setBatchCallback(const BatchCallback &cb) { batchCallback_ = cb; }
+    size_t maxFrameSize() const { return maxFrameSize_; }
+
+    //设置为TcpConnection/TcpServer的messageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    //把message加上长度头发送
+    bool send(const TcpConnectionPtr &conn, StringPiece message) const;
+    //buf中的可读数据是消息体，在它前面prepend长度头以后整个Buffer交给连接发送，buf被清空
+    bool send(const TcpConnectionPtr &conn, Buffer *buf) const;
+private:
+    void dispatchBatch(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    //长度头非法时返回false
+    bool checkLength(const TcpConnectionPtr &conn, Buffer *buf, size_t len);
+    //为长度是frameLen（包括长度头）的帧预留空间，最多kMaxReserveSize
+    static void reserveFrame(Buffer *buf, size_t frameLen);
+
+    FrameCallback frameCallback_;
+    BatchCallback batchCallback_;
+    ErrorCallback errorCallback_;
+    const size_t maxFrameSize_;
+};
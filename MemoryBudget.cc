@@ -0,0 +1,96 @@
+#include "MemoryBudget.h"
+#include "TcpConnection.h"
+
+MemoryBudget& MemoryBudget::instance()
+{
+    static MemoryBudget budget;
+    return budget;
+}
+
+MemoryBudget::MemoryBudget()
+    : limit_(0)
+    , resumePercent_(90)
+    , policy_(kNone)
+    , pauseFloor_(kDefaultPauseFloor)
+    , used_(0)
+    , peak_(0)
+    , connections_(0)
+    , numPaused_(0)
+    , pauseCount_(0)
+    , rejectedSends_(0)
+    , closedConnections_(0)
+{
+}
+
+int64_t MemoryBudget::connectionShare() const
+{
+    int64_t conns = connections();
+    return limit() / (conns > 0 ? conns : 1);
+}
+
+void MemoryBudget::publish(int64_t delta)
+{
+    int64_t used = used_.fetch_add(delta, std::memory_order_relaxed) + delta;
+    int64_t peak = peak_.load(std::memory_order_relaxed);
+    while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+    {
+    }
+}
+
+void MemoryBudget::addPaused(const TcpConnectionPtr &conn)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    paused_.push_back(conn);
+    numPaused_.fetch_add(1, std::memory_order_relaxed);
+    pauseCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryBudget::removePaused(const TcpConnectionPtr &conn)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t i = 0;
+    while (i < paused_.size())
+    {
+        const std::weak_ptr<TcpConnection> &weak = paused_[i];
+        //按控制块比较，不用lock，不会在锁里析构别的连接
+        bool same = !weak.owner_before(conn) && !conn.owner_before(weak);
+        if (same || weak.expired())
+        {
+            paused_[i].swap(paused_.back());
+            paused_.pop_back();
+            numPaused_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void MemoryBudget::resumeIfBelow()
+{
+    if (numPaused_.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    int64_t limit = this->limit();
+    if (limit > 0 && usedBytes() > limit / 100 * resumePercent_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    std::vector<std::weak_ptr<TcpConnection>> paused;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        paused.swap(paused_);
+        numPaused_.store(0, std::memory_order_relaxed);
+    }
+    for (const std::weak_ptr<TcpConnection> &weak : paused)
+    {
+        TcpConnectionPtr conn(weak.lock());
+        if (conn)
+        {
+            conn->resumeFromBudget();//在连接所属的loop中恢复读
+        }
+    }
+}
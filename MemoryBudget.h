@@ -0,0 +1,94 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * 进程内所有TcpConnection的inputBuffer_/outputBuffer_中的数据总量和预算
+ * 每个连接把自己缓冲区的变化记在所属EventLoop上，EventLoop每轮循环只把差值原子地加一次到这里，
+ * 读取总量不需要加锁
+ * 超过预算时按策略处理：暂停读占用最多的连接、拒绝新的send、关闭占用远超平均值的连接
+ */
+class MemoryBudget : noncopyable
+{
+public:
+    enum Policy
+    {
+        kNone = 0,
+        kPauseReads = 1,//占用不少于平均份额的连接停止读，降到恢复线以下再继续读
+        kRejectSends = 2,//超过预算时send直接返回false
+        kCloseOffenders = 4,//占用超过平均份额kOffenderFactor倍的连接直接关闭
+    };
+
+    static const int kOffenderFactor = 4;
+    static const int64_t kDefaultPauseFloor = 64 * 1024;
+
+    static MemoryBudget& instance();
+
+    //limit为0表示不限制
+    void setLimit(int64_t bytes) { limit_.store(bytes, std::memory_order_relaxed); }
+    //降到limit * resumePercent / 100以下时恢复暂停的读
+    void setResumePercent(int percent) { resumePercent_.store(percent, std::memory_order_relaxed); }
+    void setPolicy(int policy) { policy_.store(policy, std::memory_order_relaxed); }
+    /**
+     * kPauseReads不暂停输入缓冲区不到bytes的连接，已经暂停的连接被取走数据降到这以下时也恢复读
+     * 这些连接手里多半是半条消息，不让它读就永远凑不齐，如果预算全被这样的连接占着，谁都等不到恢复线
+     * 应用层最长的消息不超过这个值就不会因为暂停读而卡住
+     */
+    void setPauseFloor(int64_t bytes) { pauseFloor_.store(bytes, std::memory_order_relaxed); }
+
+    int64_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    int policy() const { return policy_.load(std::memory_order_relaxed); }
+    int64_t pauseFloor() const { return pauseFloor_.load(std::memory_order_relaxed); }
+    int64_t usedBytes() const { return used_.load(std::memory_order_relaxed); }
+    int64_t peakBytes() const { return peak_.load(std::memory_order_relaxed); }
+    int64_t connections() const { return connections_.load(std::memory_order_relaxed); }
+
+    bool overBudget() const
+    {
+        int64_t limit = this->limit();
+        return limit > 0 && usedBytes() > limit;
+    }
+    //每个连接的平均份额，不少于这个数的连接算是大户
+    int64_t connectionShare() const;
+
+    //统计，用来在OOM之前报警
+    int64_t pausedConnections() const { return numPaused_.load(std::memory_order_relaxed); }
+    uint64_t pauseCount() const { return pauseCount_.load(std::memory_order_relaxed); }
+    uint64_t rejectedSends() const { return rejectedSends_.load(std::memory_order_relaxed); }
+    uint64_t closedConnections() const { return closedConnections_.load(std::memory_order_relaxed); }
+
+    //下面的接口由EventLoop和TcpConnection调用
+    void publish(int64_t delta);
+    void addConnection(int64_t n) { connections_.fetch_add(n, std::memory_order_relaxed); }
+    void countRejectedSend() { rejectedSends_.fetch_add(1, std::memory_order_relaxed); }
+    void countClosedConnection() { closedConnections_.fetch_add(1, std::memory_order_relaxed); }
+    void addPaused(const TcpConnectionPtr &conn);
+    //连接自己恢复了读或者断开了，从暂停列表中删掉它（顺便删掉已经析构的连接），不在列表中时什么也不做
+    void removePaused(const TcpConnectionPtr &conn);
+    //预算降到恢复线以下时，恢复所有因为预算暂停读的连接
+    void resumeIfBelow();
+private:
+    MemoryBudget();
+
+    std::atomic<int64_t> limit_;
+    std::atomic<int> resumePercent_;
+    std::atomic<int> policy_;
+    std::atomic<int64_t> pauseFloor_;
+    std::atomic<int64_t> used_;
+    std::atomic<int64_t> peak_;
+    std::atomic<int64_t> connections_;
+
+    std::atomic<int64_t> numPaused_;
+    std::atomic<uint64_t> pauseCount_;
+    std::atomic<uint64_t> rejectedSends_;
+    std::atomic<uint64_t> closedConnections_;
+
+    std::mutex mutex_;//只保护paused_，只有超预算的时候才会用到
+    std::vector<std::weak_ptr<TcpConnection>> paused_;
+};
@@ -0,0 +1,105 @@
+#include "ObjectPool.h"
+#include "CurrentThread.h"
+
+#include <new>
+#include <algorithm>
+
+ObjectPool::ObjectPool(pid_t ownerTid)
+    : ownerTid_(ownerTid)
+    , blockSize_(0)
+    , freeList_(nullptr)
+    , numFree_(0)
+    , remoteFree_(nullptr)
+    , reused_(0)
+    , allocated_(0)
+{
+}
+
+ObjectPool::~ObjectPool()
+{
+    reclaimRemote();
+    while (freeList_)
+    {
+        FreeBlock *block = freeList_;
+        freeList_ = block->next;
+        ::operator delete(block);
+    }
+}
+
+void* ObjectPool::allocate(size_t bytes)
+{
+    bytes = std::max(bytes, sizeof(FreeBlock));
+    if (CurrentThread::tid() != ownerTid_)
+    {
+        return ::operator new(bytes);//不在所属线程，不碰空闲链表
+    }
+
+    if (blockSize_ == 0)
+    {
+        blockSize_ = bytes;
+    }
+    if (bytes == blockSize_)
+    {
+        if (freeList_ == nullptr)
+        {
+            reclaimRemote();
+        }
+        if (freeList_)
+        {
+            FreeBlock *block = freeList_;
+            freeList_ = block->next;
+            --numFree_;
+            reused_.store(reused_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+    allocated_.store(allocated_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return ::operator new(bytes);
+}
+
+void ObjectPool::deallocate(void *p, size_t bytes)
+{
+    bytes = std::max(bytes, sizeof(FreeBlock));
+    if (bytes != blockSize_)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    if (CurrentThread::tid() == ownerTid_)
+    {
+        pushLocal(block);
+        return;
+    }
+    //其他线程释放的块压到无锁栈上，所属线程一次取走整个栈，不会有ABA问题
+    FreeBlock *head = remoteFree_.load(std::memory_order_relaxed);
+    do
+    {
+        block->next = head;
+    } while (!remoteFree_.compare_exchange_weak(head, block,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+void ObjectPool::pushLocal(FreeBlock *block)
+{
+    if (numFree_ >= kMaxCached)
+    {
+        ::operator delete(block);
+        return;
+    }
+    block->next = freeList_;
+    freeList_ = block;
+    ++numFree_;
+}
+
+void ObjectPool::reclaimRemote()
+{
+    FreeBlock *block = remoteFree_.exchange(nullptr, std::memory_order_acquire);
+    while (block)
+    {
+        FreeBlock *next = block->next;
+        pushLocal(block);
+        block = next;
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * 属于一个线程的定长内存块池，用来复用连接对象的内存
+ * 在所属线程分配和释放不加锁；在其他线程释放的内存块挂到一个无锁栈上，
+ * 所属线程下次分配时一次性全部收回，内存始终回到分配它的线程
+ * 第一次分配的大小就是块大小，其他大小直接用operator new
+ */
+class ObjectPool : noncopyable
+{
+public:
+    static const size_t kMaxCached = 4096;// 空闲链表最多缓存的块数，超过的直接释放
+
+    explicit ObjectPool(pid_t ownerTid);
+    ~ObjectPool();
+
+    void* allocate(size_t bytes);
+    void deallocate(void *p, size_t bytes);
+
+    size_t blockSize() const { return blockSize_; }
+    size_t cachedBlocks() const { return numFree_; }
+    //从池中复用的次数和新分配的次数
+    uint64_t reused() const { return reused_.load(std::memory_order_relaxed); }
+    uint64_t allocated() const { return allocated_.load(std::memory_order_relaxed); }
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    void pushLocal(FreeBlock *block);
+    void reclaimRemote();
+
+    const pid_t ownerTid_;
+    size_t blockSize_;
+    FreeBlock *freeList_;//只在所属线程访问
+    size_t numFree_;
+    std::atomic<FreeBlock*> remoteFree_;//其他线程释放的块
+    std::atomic<uint64_t> reused_;
+    std::atomic<uint64_t> allocated_;
+};
+
+using ObjectPoolPtr = std::shared_ptr<ObjectPool>;
+
+/**
+ * 从ObjectPool分配内存的allocator，配合std::allocate_shared使用，
+ * 对象和shared_ptr的控制块在同一块内存里
+ * allocator持有池的引用，对象比池的所属线程活得更久也是安全的
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(const ObjectPoolPtr &pool)
+        : pool_(pool)
+    {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &other)
+        : pool_(other.pool())
+    {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n)
+    {
+        pool_->deallocate(p, n * sizeof(T));
+    }
+
+    const ObjectPoolPtr& pool() const { return pool_; }
+private:
+    ObjectPoolPtr pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &lhs, const PoolAllocator<U> &rhs)
+{
+    return lhs.pool() == rhs.pool();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &lhs, const PoolAllocator<U> &rhs)
+{
+    return !(lhs == rhs);
+}
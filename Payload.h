@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+
+/**
+ * 不可变的待发送数据，通过shared_ptr引用计数共享
+ * TcpConnection::send(PayloadPtr)只持有引用不拷贝数据，
+ * zero-copy发送时内核直接读用户内存，数据必须一直存活到内核通知发送完成
+ */
+class Payload : noncopyable
+{
+public:
+    explicit Payload(std::string data)
+        : data_(std::move(data))
+    {}
+    Payload(const char *data, size_t len)
+        : data_(data, len)
+    {}
+
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+private:
+    const std::string data_;
+};
+
+using PayloadPtr = std::shared_ptr<const Payload>;
+
+inline PayloadPtr makePayload(std::string data)
+{
+    return std::make_shared<const Payload>(std::move(data));
+}
+
+inline PayloadPtr makePayload(const char *data, size_t len)
+{
+    return std::make_shared<const Payload>(data, len);
+}
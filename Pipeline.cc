@@ -0,0 +1,253 @@
+#include "Pipeline.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+
+#include <functional>
+
+void Stage::onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime)
+{
+    ctx.fireRead(in, receiveTime);
+}
+
+void Stage::onWrite(StageContext &ctx, Buffer *out)
+{
+    ctx.fireWrite(out);
+}
+
+void Stage::onFlush(StageContext &ctx)
+{
+    ctx.fireFlush();
+}
+
+void Stage::onWritabilityChanged(StageContext &ctx, bool writable)
+{
+    ctx.fireWritabilityChanged(writable);
+}
+
+void Stage::onDrained(StageContext &ctx)
+{
+    ctx.fireDrained();
+}
+
+StageContext::StageContext(Pipeline *pipeline, size_t index)
+    : pipeline_(pipeline)
+    , index_(index)
+    , paused_(false)
+    , pendingIn_(nullptr)
+{
+}
+
+const TcpConnectionPtr& StageContext::connection() const
+{
+    return pipeline_->conn_->self_;
+}
+
+void StageContext::fireRead(Buffer *buf, Timestamp receiveTime)
+{
+    pipeline_->deliverRead(index_ + 1, buf, receiveTime);
+}
+
+void StageContext::fireWrite(Buffer *buf)
+{
+    pipeline_->deliverWrite(index_, buf);
+}
+
+void StageContext::fireFlush()
+{
+    pipeline_->deliverFlush(index_);
+}
+
+void StageContext::fireWritabilityChanged(bool writable)
+{
+    pipeline_->deliverWritability(index_ + 1, writable);
+}
+
+void StageContext::fireDrained()
+{
+    pipeline_->deliverDrained(index_ + 1);
+}
+
+void StageContext::pauseRead()
+{
+    if (!paused_)
+    {
+        pipeline_->pause(index_);
+    }
+}
+
+void StageContext::resumeRead()
+{
+    if (paused_)
+    {
+        pipeline_->resume(index_);
+    }
+}
+
+bool StageContext::writable() const
+{
+    return pipeline_->writable();
+}
+
+Pipeline::Pipeline(TcpConnection *conn)
+    : conn_(conn)
+    , pausedStages_(0)
+    , writable_(true)
+{
+}
+
+Pipeline::~Pipeline() = default;
+
+void Pipeline::addStage(StagePtr stage)
+{
+    contexts_.emplace_back(new StageContext(this, stages_.size()));
+    stages_.push_back(std::move(stage));
+}
+
+void Pipeline::addFirst(StagePtr stage)
+{
+    stages_.insert(stages_.begin(), std::move(stage));
+    contexts_.emplace(contexts_.begin(), new StageContext(this, 0));
+    for (size_t i = 1; i < contexts_.size(); ++i)
+    {
+        contexts_[i]->index_ = i;
+    }
+}
+
+void Pipeline::connected()
+{
+    for (size_t i = 0; i < stages_.size(); ++i)
+    {
+        stages_[i]->onConnected(*contexts_[i]);
+    }
+}
+
+void Pipeline::disconnected()
+{
+    for (size_t i = 0; i < stages_.size(); ++i)
+    {
+        stages_[i]->onDisconnected(*contexts_[i]);
+    }
+}
+
+void Pipeline::read(Buffer *in, Timestamp receiveTime)
+{
+    lastReceiveTime_ = receiveTime;
+    deliverRead(0, in, receiveTime);
+}
+
+void Pipeline::write(Buffer *out)
+{
+    deliverWrite(stages_.size(), out);
+    deliverFlush(stages_.size());
+}
+
+void Pipeline::setWritable(bool writable)
+{
+    if (writable_ != writable)
+    {
+        writable_ = writable;
+        deliverWritability(0, writable);
+    }
+}
+
+void Pipeline::drained()
+{
+    deliverDrained(0);
+}
+
+bool Pipeline::hasPendingOutput() const
+{
+    for (const StagePtr &stage : stages_)
+    {
+        if (stage->hasPendingOutput())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Pipeline::deliverRead(size_t index, Buffer *buf, Timestamp receiveTime)
+{
+    if (index == stages_.size())
+    {
+        conn_->messageCallback_(conn_->self_, buf, receiveTime);
+        return;
+    }
+    StageContext *ctx = contexts_[index].get();
+    ctx->pendingIn_ = buf;
+    if (!ctx->paused_)
+    {
+        stages_[index]->onRead(*ctx, buf, receiveTime);
+    }
+}
+
+void Pipeline::deliverWrite(size_t index, Buffer *buf)
+{
+    if (index == 0)
+    {
+        conn_->sendInLoop(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+        return;
+    }
+    stages_[index - 1]->onWrite(*contexts_[index - 1], buf);
+}
+
+void Pipeline::deliverFlush(size_t index)
+{
+    if (index > 0)
+    {
+        stages_[index - 1]->onFlush(*contexts_[index - 1]);
+    }
+}
+
+void Pipeline::deliverWritability(size_t index, bool writable)
+{
+    if (index < stages_.size())
+    {
+        stages_[index]->onWritabilityChanged(*contexts_[index], writable);
+    }
+}
+
+void Pipeline::deliverDrained(size_t index)
+{
+    if (index < stages_.size())
+    {
+        stages_[index]->onDrained(*contexts_[index]);
+    }
+}
+
+void Pipeline::pause(size_t index)
+{
+    contexts_[index]->paused_ = true;
+    if (++pausedStages_ == 1)
+    {
+        conn_->setPipelinePaused(true);
+    }
+}
+
+void Pipeline::resume(size_t index)
+{
+    contexts_[index]->paused_ = false;
+    if (--pausedStages_ == 0)
+    {
+        conn_->setPipelinePaused(false);
+    }
+    //可能是在这一级自己的onRead中恢复的，放到下一次loop中重新交数据，避免重入
+    conn_->getLoop()->queueInLoop(
+        std::bind(&TcpConnection::redrivePipeline, conn_->shared_from_this(), index));
+}
+
+void Pipeline::redrive(size_t index)
+{
+    StageContext *ctx = contexts_[index].get();
+    if (!ctx->paused_ && ctx->pendingIn_ != nullptr && ctx->pendingIn_->readableBytes() > 0)
+    {
+        stages_[index]->onRead(*ctx, ctx->pendingIn_, lastReceiveTime_);
+        if (index > 0)
+        {
+            stages_[index - 1]->onConsumed(*contexts_[index - 1]);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <memory>
+#include <vector>
+#include <functional>
+
+class Buffer;
+class TcpConnection;
+class Pipeline;
+class StageContext;
+
+/**
+ * 连接上的一级处理（分帧、压缩、加密……），入站方向从socket到用户，出站方向从用户到socket
+ * stage之间传递Buffer指针：不改变数据的stage把收到的Buffer原样交给下一级，字节不拷贝；
+ * 变换数据的stage写进自己持有的Buffer，下一级直接在这个Buffer上读
+ * 下一级没处理完的数据留在Buffer中，有新数据或者恢复读的时候再交下来
+ * 所有方法都在连接所属的loop线程中调用
+ */
+class Stage : noncopyable
+{
+public:
+    virtual ~Stage() = default;
+
+    virtual void onConnected(StageContext &) {}
+    virtual void onDisconnected(StageContext &) {}
+    //入站：in中是上一级（靠近socket）的数据，处理掉的部分从in中取走，默认原样交给下一级
+    virtual void onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime);
+    //出站：out中是上一级（靠近用户）要发送的数据，处理掉的部分从out中取走，默认原样交给下一级
+    virtual void onWrite(StageContext &ctx, Buffer *out);
+    //出站方向的消息边界，每次send结束时调用，缓存了数据的stage在这里输出
+    virtual void onFlush(StageContext &ctx);
+    //连接的发送缓冲区越过高水位（writable为false）或者降到低水位以下，从socket一端往用户一端传
+    virtual void onWritabilityChanged(StageContext &ctx, bool writable);
+    //连接的发送缓冲区写空了，从socket一端往用户一端传，等到这个时候再输出的stage可以在这里flush
+    virtual void onDrained(StageContext &ctx);
+    //下一级resumeRead以后重新处理了这一级交下去的积压数据，因为下一级积压而暂停的stage在这里恢复
+    virtual void onConsumed(StageContext &) {}
+    //还有留在stage中、没交给上一级的发送数据（比如握手完成之前缓存的数据），shutdown等它们交下来才关闭写端
+    virtual bool hasPendingOutput() const { return false; }
+};
+
+using StagePtr = std::unique_ptr<Stage>;
+//TcpServer用它为每条连接创建一个stage
+using StageFactory = std::function<StagePtr (const TcpConnectionPtr&)>;
+
+//stage在pipeline中的位置，stage通过它把数据交给相邻的stage
+class StageContext : noncopyable
+{
+public:
+    const TcpConnectionPtr& connection() const;
+    Pipeline* pipeline() const { return pipeline_; }
+    size_t index() const { return index_; }
+
+    void fireRead(Buffer *buf, Timestamp receiveTime);
+    void fireWrite(Buffer *buf);
+    void fireFlush();
+    void fireWritabilityChanged(bool writable);
+    void fireDrained();
+
+    /**
+     * 入站背压：暂停以后上一级交下来的数据留在上一级的Buffer中，连接停止从socket读，
+     * 内核接收缓冲区写满以后由tcp的流量控制让对端停止发送
+     * resumeRead以后在下一次loop中把积压的数据重新交给这一级
+     */
+    void pauseRead();
+    void resumeRead();
+    bool readPaused() const { return paused_; }
+    //出站方向是否可以继续写
+    bool writable() const;
+private:
+    friend class Pipeline;
+    StageContext(Pipeline *pipeline, size_t index);
+
+    Pipeline *pipeline_;
+    size_t index_;
+    bool paused_;
+    Buffer *pendingIn_;//上一级最近一次交下来的Buffer，恢复读的时候从这里继续
+};
+
+/**
+ * 一条连接的stage链，下标0靠近socket
+ * 入站数据从inputBuffer_开始依次经过各级，最后一级交出来的Buffer交给连接的messageCallback；
+ * 出站数据从最后一级开始依次经过各级，到了下标0以后写进连接的发送缓冲区
+ */
+class Pipeline : noncopyable
+{
+public:
+    explicit Pipeline(TcpConnection *conn);
+    ~Pipeline();
+
+    //在connectEstablished之前添加，先添加的靠近socket
+    void addStage(StagePtr stage);
+    //加到最靠近socket的位置，TLS握手完成以后由连接加入解密的stage，之后才调用connected()
+    void addFirst(StagePtr stage);
+    size_t size() const { return stages_.size(); }
+    Stage* stage(size_t index) const { return stages_[index].get(); }
+    StageContext* context(size_t index) const { return contexts_[index].get(); }
+    //第一个类型是S的stage，没有时返回nullptr
+    template <typename S>
+    S* find() const
+    {
+        for (const StagePtr &stage : stages_)
+        {
+            S *s = dynamic_cast<S*>(stage.get());
+            if (s != nullptr)
+            {
+                return s;
+            }
+        }
+        return nullptr;
+    }
+
+    //以下由TcpConnection在loop线程中调用
+    void connected();
+    void disconnected();
+    void read(Buffer *in, Timestamp receiveTime);//socket读到了数据
+    void write(Buffer *out);//用户send的数据，结束后触发一次flush
+    void setWritable(bool writable);
+    bool writable() const { return writable_; }
+    void drained();
+    bool hasPendingOutput() const;
+    void redrive(size_t index);//把index这一级积压的数据重新交给它
+private:
+    friend class StageContext;
+
+    void deliverRead(size_t index, Buffer *buf, Timestamp receiveTime);
+    void deliverWrite(size_t index, Buffer *buf);//交给index-1，index为0时写进连接
+    void deliverFlush(size_t index);
+    void deliverWritability(size_t index, bool writable);
+    void deliverDrained(size_t index);
+    void pause(size_t index);
+    void resume(size_t index);
+
+    TcpConnection *conn_;
+    std::vector<StagePtr> stages_;
+    std::vector<std::unique_ptr<StageContext>> contexts_;
+    size_t pausedStages_;
+    bool writable_;
+    Timestamp lastReceiveTime_;
+};
@@ -0,0 +1,350 @@
+#include "PubSubHub.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <map>
+
+/**
+ * 一个loop上的订阅表，除了计数以外只在这个loop的线程中访问
+ */
+class LocalHub : noncopyable, public std::enable_shared_from_this<LocalHub>
+{
+public:
+    LocalHub(EventLoop *loop, const PubSubOptions &options)
+        : loop_(loop)
+        , options_(options)
+        , subscriptions_(0)
+        , retryScheduled_(false)
+        , delivered_(0)
+        , dropped_(0)
+        , conflated_(0)
+        , disconnected_(0)
+    {}
+
+    EventLoop* loop() const { return loop_; }
+    //publish用它跳过没有订阅者的loop，订阅还在路上时可能读到旧值
+    bool empty() const { return subscriptions_.load(std::memory_order_relaxed) == 0; }
+
+    void subscribe(const TcpConnectionPtr &conn, const std::string &topic);
+    void unsubscribe(const TcpConnectionPtr &conn, const std::string &topic);
+    void unsubscribeAll(const TcpConnectionPtr &conn);
+    void publish(const std::string &topic, const PayloadPtr &payload);
+    void addStats(PubSubStats *stats) const;
+private:
+    using WeakConnection = std::weak_ptr<TcpConnection>;
+    //订阅表不延长连接的寿命，没有unsubscribeAll就析构的连接只留下一条失效的记录，publish时清理
+    struct Subscriber
+    {
+        WeakConnection conn;
+        PayloadPtr conflated;//越过高水位期间最新的一条，还没发出去
+    };
+    using SubscriberList = std::vector<Subscriber>;
+    //按控制块比较，weak_ptr还在控制块就不会被复用，连接析构以后地址被新连接用了也不会混
+    using ConnectionTopics = std::map<WeakConnection, std::vector<std::string>, std::owner_less<WeakConnection>>;
+
+    static bool sameConnection(const WeakConnection &a, const WeakConnection &b)
+    {
+        return !a.owner_before(b) && !b.owner_before(a);
+    }
+    bool removeSubscriber(SubscriberList &list, const WeakConnection &conn);
+    void eraseTopic(const std::string &topic, const WeakConnection &conn);
+    void deliver(Subscriber &sub, const TcpConnectionPtr &conn, const PayloadPtr &payload);
+    void scheduleRetry();
+    void retryConflated();
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    EventLoop *loop_;
+    const PubSubOptions options_;
+    std::unordered_map<std::string, SubscriberList> topics_;
+    ConnectionTopics byConn_;//unsubscribeAll用
+    std::atomic<size_t> subscriptions_;
+    bool retryScheduled_;
+
+    std::atomic<uint64_t> delivered_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> conflated_;
+    std::atomic<uint64_t> disconnected_;
+};
+
+void LocalHub::subscribe(const TcpConnectionPtr &conn, const std::string &topic)
+{
+    SubscriberList &list = topics_[topic];
+    WeakConnection weak(conn);
+    for (const Subscriber &sub : list)
+    {
+        if (sameConnection(sub.conn, weak))
+        {
+            return;
+        }
+    }
+    list.push_back(Subscriber{weak, PayloadPtr()});
+    byConn_[weak].push_back(topic);
+    subscriptions_.store(subscriptions_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool LocalHub::removeSubscriber(SubscriberList &list, const WeakConnection &conn)
+{
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        if (sameConnection(list[i].conn, conn))
+        {
+            std::swap(list[i], list.back());
+            list.pop_back();
+            subscriptions_.store(subscriptions_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+//从连接的反向索引中去掉topic
+void LocalHub::eraseTopic(const std::string &topic, const WeakConnection &conn)
+{
+    auto it = byConn_.find(conn);
+    if (it != byConn_.end())
+    {
+        std::vector<std::string> &topics = it->second;
+        topics.erase(std::remove(topics.begin(), topics.end(), topic), topics.end());
+        if (topics.empty())
+        {
+            byConn_.erase(it);
+        }
+    }
+}
+
+void LocalHub::unsubscribe(const TcpConnectionPtr &conn, const std::string &topic)
+{
+    auto it = topics_.find(topic);
+    WeakConnection weak(conn);
+    if (it != topics_.end() && removeSubscriber(it->second, weak))
+    {
+        if (it->second.empty())
+        {
+            topics_.erase(it);
+        }
+        eraseTopic(topic, weak);
+    }
+}
+
+void LocalHub::unsubscribeAll(const TcpConnectionPtr &conn)
+{
+    WeakConnection weak(conn);
+    auto it = byConn_.find(weak);
+    if (it == byConn_.end())
+    {
+        return;
+    }
+    for (const std::string &topic : it->second)
+    {
+        auto t = topics_.find(topic);
+        if (t != topics_.end() && removeSubscriber(t->second, weak) && t->second.empty())
+        {
+            topics_.erase(t);
+        }
+    }
+    byConn_.erase(it);
+}
+
+//一次publish在这个loop上的全部工作：本地的订阅者逐个发送，共享同一个payload
+void LocalHub::publish(const std::string &topic, const PayloadPtr &payload)
+{
+    auto it = topics_.find(topic);
+    if (it == topics_.end())
+    {
+        return;
+    }
+    SubscriberList &list = it->second;
+    for (size_t i = 0; i < list.size(); )
+    {
+        TcpConnectionPtr conn(list[i].conn.lock());
+        if (!conn || !conn->connected())
+        {
+            //断开了或者已经析构了但是没有unsubscribeAll，顺便清理
+            WeakConnection weak(list[i].conn);
+            removeSubscriber(list, weak);
+            eraseTopic(topic, weak);
+            continue;
+        }
+        deliver(list[i], conn, payload);
+        ++i;
+    }
+    if (list.empty())
+    {
+        topics_.erase(it);
+    }
+}
+
+void LocalHub::deliver(Subscriber &sub, const TcpConnectionPtr &conn, const PayloadPtr &payload)
+{
+    if (conn->pendingOutputBytes() <= options_.highWaterMark)
+    {
+        if (sub.conflated)
+        {
+            sub.conflated.reset();//被这一条取代
+            add(conflated_, 1);
+        }
+        conn->send(payload);
+        add(delivered_, 1);
+        return;
+    }
+    switch (options_.slowPolicy)
+    {
+    case PubSubOptions::kDropMessage:
+        add(dropped_, 1);
+        break;
+    case PubSubOptions::kConflate:
+        if (sub.conflated)
+        {
+            add(conflated_, 1);
+        }
+        sub.conflated = payload;
+        scheduleRetry();
+        break;
+    case PubSubOptions::kDisconnect:
+        LOG_INFO("PubSubHub drop slow subscriber %s pending:%lu \n",
+            conn->name().c_str(), static_cast<unsigned long>(conn->pendingOutputBytes()));
+        conn->forceClose();//下一次publish时因为不再connected被清理
+        add(disconnected_, 1);
+        break;
+    }
+}
+
+void LocalHub::scheduleRetry()
+{
+    if (!retryScheduled_)
+    {
+        retryScheduled_ = true;
+        loop_->runAfter(options_.conflateRetrySeconds,
+            std::bind(&LocalHub::retryConflated, shared_from_this()));
+    }
+}
+
+//发送缓冲区降下来的订阅者补发合并以后的最新消息，还有没发出去的就继续等
+void LocalHub::retryConflated()
+{
+    retryScheduled_ = false;
+    bool pending = false;
+    for (auto &entry : topics_)
+    {
+        for (Subscriber &sub : entry.second)
+        {
+            if (!sub.conflated)
+            {
+                continue;
+            }
+            TcpConnectionPtr conn(sub.conn.lock());
+            if (!conn || !conn->connected())
+            {
+                sub.conflated.reset();
+            }
+            else if (conn->pendingOutputBytes() <= options_.highWaterMark)
+            {
+                PayloadPtr payload;
+                payload.swap(sub.conflated);
+                conn->send(payload);
+                add(delivered_, 1);
+            }
+            else
+            {
+                pending = true;
+            }
+        }
+    }
+    if (pending)
+    {
+        scheduleRetry();
+    }
+}
+
+void LocalHub::addStats(PubSubStats *stats) const
+{
+    stats->delivered += delivered_.load(std::memory_order_relaxed);
+    stats->dropped += dropped_.load(std::memory_order_relaxed);
+    stats->conflated += conflated_.load(std::memory_order_relaxed);
+    stats->disconnected += disconnected_.load(std::memory_order_relaxed);
+}
+
+PubSubHub::PubSubHub(const std::vector<EventLoop*> &loops, const PubSubOptions &options)
+    : published_(0)
+{
+    for (EventLoop *loop : loops)
+    {
+        if (byLoop_.count(loop) == 0)
+        {
+            locals_.push_back(std::make_shared<LocalHub>(loop, options));
+            byLoop_[loop] = locals_.back().get();
+        }
+    }
+}
+
+PubSubHub::~PubSubHub() = default;
+
+LocalHub* PubSubHub::localHub(EventLoop *loop) const
+{
+    auto it = byLoop_.find(loop);
+    if (it == byLoop_.end())
+    {
+        LOG_ERROR("PubSubHub: connection loop %p is not managed by this hub \n", loop);
+        return nullptr;
+    }
+    return it->second;
+}
+
+void PubSubHub::subscribe(const TcpConnectionPtr &conn, const std::string &topic)
+{
+    LocalHub *local = localHub(conn->getLoop());
+    if (local != nullptr)
+    {
+        local->loop()->runInLoop(std::bind(&LocalHub::subscribe, local->shared_from_this(), conn, topic));
+    }
+}
+
+void PubSubHub::unsubscribe(const TcpConnectionPtr &conn, const std::string &topic)
+{
+    LocalHub *local = localHub(conn->getLoop());
+    if (local != nullptr)
+    {
+        local->loop()->runInLoop(std::bind(&LocalHub::unsubscribe, local->shared_from_this(), conn, topic));
+    }
+}
+
+void PubSubHub::unsubscribeAll(const TcpConnectionPtr &conn)
+{
+    LocalHub *local = localHub(conn->getLoop());
+    if (local != nullptr)
+    {
+        local->loop()->runInLoop(std::bind(&LocalHub::unsubscribeAll, local->shared_from_this(), conn));
+    }
+}
+
+//每个有订阅者的loop一个任务，topic和payload的引用由任务持有
+void PubSubHub::publish(const std::string &topic, const PayloadPtr &payload)
+{
+    published_.fetch_add(1, std::memory_order_relaxed);//可能有多个线程同时publish
+    for (const std::shared_ptr<LocalHub> &local : locals_)
+    {
+        if (!local->empty())
+        {
+            local->loop()->runInLoop(std::bind(&LocalHub::publish, local, topic, payload));
+        }
+    }
+}
+
+PubSubStats PubSubHub::stats() const
+{
+    PubSubStats stats;
+    stats.published = published_.load(std::memory_order_relaxed);
+    for (const std::shared_ptr<LocalHub> &local : locals_)
+    {
+        local->addStats(&stats);
+    }
+    return stats;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Payload.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <stdint.h>
+
+class EventLoop;
+class LocalHub;
+
+//订阅者的发送缓冲区越过高水位以后的处理
+struct PubSubOptions
+{
+    enum SlowPolicy
+    {
+        kDropMessage,//丢掉发给它的这条消息
+        kConflate,//每个topic只留最新的一条，发送缓冲区降下来以后再发
+        kDisconnect,//断开这个订阅者
+    };
+    size_t highWaterMark = 4 * 1024 * 1024;//pendingOutputBytes()超过这么多算慢
+    SlowPolicy slowPolicy = kConflate;
+    double conflateRetrySeconds = 0.01;//有合并的消息时隔多久检查一次订阅者是否降下来了
+};
+
+struct PubSubStats
+{
+    uint64_t published = 0;//publish的次数
+    uint64_t delivered = 0;//发给订阅者的消息数
+    uint64_t dropped = 0;
+    uint64_t conflated = 0;//被更新的消息覆盖掉的消息数
+    uint64_t disconnected = 0;
+};
+
+/**
+ * 跨loop的发布订阅，每个loop有自己的订阅表，只在自己的线程中访问
+ * 订阅者按所在连接的loop登记，publish对每个有订阅者的loop只投递一个任务，
+ * 由这个loop在本地依次发给订阅者，所有订阅者共享同一个Payload，数据只有一份
+ * 订阅者的发送缓冲区越过highWaterMark时按slowPolicy丢弃、合并或者断开
+ * subscribe/unsubscribe/publish可以在任意线程调用，订阅在所在loop处理以后才生效
+ */
+class PubSubHub : noncopyable
+{
+public:
+    //loops是订阅者所在的所有loop，通常是TcpServer::getAllLoops()
+    explicit PubSubHub(const std::vector<EventLoop*> &loops, const PubSubOptions &options = PubSubOptions());
+    ~PubSubHub();
+
+    void subscribe(const TcpConnectionPtr &conn, const std::string &topic);
+    void unsubscribe(const TcpConnectionPtr &conn, const std::string &topic);
+    //连接断开时在connectionCallback中调用；订阅表只持有weak_ptr，不调用也不会让连接活下去，
+    //只是留下的记录要等下一次publish这个topic才清理掉
+    void unsubscribeAll(const TcpConnectionPtr &conn);
+
+    void publish(const std::string &topic, const PayloadPtr &payload);
+    void publish(const std::string &topic, std::string message) { publish(topic, makePayload(std::move(message))); }
+
+    //各个loop的计数加起来，不是同一时刻的快照
+    PubSubStats stats() const;
+private:
+    LocalHub* localHub(EventLoop *loop) const;
+
+    std::vector<std::shared_ptr<LocalHub>> locals_;//任务绑定shared_ptr，hub先析构也没关系
+    std::unordered_map<EventLoop*, LocalHub*> byLoop_;//构造以后只读
+    std::atomic<uint64_t> published_;
+};
@@ -0,0 +1,158 @@
+#include "SendQueue.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+SendQueue::SendQueue(EventLoop *loop)
+    : loop_(loop)
+    , numPending_(0)
+    , deferredSends_(0)
+    , deferredFlushes_(0)
+{
+}
+
+SendQueue::~SendQueue()
+{
+}
+
+SendQueue::PendingSend& SendQueue::nextSlot(const TcpConnectionPtr &conn, Kind kind, bool *first)
+{
+    *first = numPending_ == 0;
+    if (numPending_ == pending_.size())
+    {
+        pending_.emplace_back();//只有这一批比以前的都大时才会分配
+    }
+    PendingSend &slot = pending_[numPending_++];
+    slot.kind = kind;
+    slot.conn = conn;
+    return slot;
+}
+
+void SendQueue::push(const TcpConnectionPtr &conn, const char *data, size_t len)
+{
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        nextSlot(conn, kString, &first).data.assign(data, len);//复用上一次留下的string空间
+    }
+    if (first)
+    {
+        schedule();
+    }
+}
+
+void SendQueue::push(const TcpConnectionPtr &conn, std::string &&data)
+{
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        nextSlot(conn, kString, &first).data.swap(data);//调用者拿回一个空的string
+    }
+    if (first)
+    {
+        schedule();
+    }
+}
+
+void SendQueue::push(const TcpConnectionPtr &conn, Buffer &&data)
+{
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        nextSlot(conn, kBuffer, &first).buffer.swap(data);//调用者拿回一个空的Buffer
+    }
+    if (first)
+    {
+        schedule();
+    }
+}
+
+void SendQueue::push(const TcpConnectionPtr &conn, const PayloadPtr &payload)
+{
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        nextSlot(conn, kPayload, &first).payload = payload;
+    }
+    if (first)
+    {
+        schedule();
+    }
+}
+
+//一批只投递一个任务，lambda只捕获this，放得进std::function的内部空间，不分配内存
+void SendQueue::schedule()
+{
+    loop_->queueInLoop([this]() { doSend(); });
+}
+
+void SendQueue::doSend()
+{
+    size_t count = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.swap(sending_);
+        count = numPending_;
+        numPending_ = 0;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        PendingSend &slot = sending_[i];
+        TcpConnection *conn = slot.conn.get();
+        if (!conn->flushScheduled_)
+        {
+            conn->flushScheduled_ = true;
+            flushList_.push_back(slot.conn);
+        }
+
+        switch (slot.kind)
+        {
+        case kString:
+            conn->queueOutputInLoop(slot.data.data(), slot.data.size());
+            slot.data.clear();
+            break;
+        case kBuffer:
+            conn->queueOutputInLoop(&slot.buffer);
+            break;
+        case kPayload:
+            conn->queuePayloadInLoop(slot.payload);
+            slot.payload.reset();
+            break;
+        }
+        slot.conn.reset();
+    }
+
+    for (const TcpConnectionPtr &conn : flushList_)
+    {
+        conn->flushScheduled_ = false;
+        if (conn->deferredFlush_)
+        {
+            conn->deferFlushInLoop();//开启了cork的连接等本轮loop结束再发送
+        }
+        else
+        {
+            conn->flushOutputInLoop();
+        }
+    }
+    flushList_.clear();
+}
+
+void SendQueue::deferFlush(const TcpConnectionPtr &conn)
+{
+    deferredList_.push_back(conn);
+}
+
+void SendQueue::flushDeferred()
+{
+    //flush中的回调可能再次send，新加入的连接留在deferredList_中，下一轮处理
+    flushingList_.swap(deferredList_);
+    for (const TcpConnectionPtr &conn : flushingList_)
+    {
+        conn->deferredFlushScheduled_ = false;
+        if (conn->flushOutputInLoop())
+        {
+            countDeferredFlush();
+        }
+    }
+    flushingList_.clear();
+}
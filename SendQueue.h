@@ -0,0 +1,87 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "Payload.h"
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 每个EventLoop一个，合并其他线程发给这个loop上连接的数据
+ * 一批数据只向loop投递一个任务、唤醒一次loop线程；loop中先把整批数据追加到各个连接的发送缓冲区，
+ * 再对每个连接只flush一次（一次write/writev）
+ * 队列中的元素在批次之间复用，string和Buffer通过swap交给loop，生产者线程send时不需要分配内存
+ *
+ * 同时负责延迟flush（cork）：开启了deferredFlush的连接在一轮loop中send的数据只追加到发送缓冲区，
+ * 这一轮结束、poll阻塞之前统一flush一次
+ */
+class SendQueue : noncopyable
+{
+public:
+    explicit SendQueue(EventLoop *loop);
+    ~SendQueue();
+
+    void push(const TcpConnectionPtr &conn, const char *data, size_t len);
+    void push(const TcpConnectionPtr &conn, std::string &&data);
+    void push(const TcpConnectionPtr &conn, Buffer &&data);
+    void push(const TcpConnectionPtr &conn, const PayloadPtr &payload);
+
+    // loop线程中调用：连接有延迟发送的数据，本轮loop结束时flush
+    void deferFlush(const TcpConnectionPtr &conn);
+    // loop线程中调用：flush本轮所有延迟发送的连接
+    void flushDeferred();
+
+    // 延迟flush的统计，任意线程都可以读
+    void countDeferredSend() { increment(deferredSends_); }
+    void countDeferredFlush() { increment(deferredFlushes_); }
+    uint64_t deferredSends() const { return deferredSends_.load(std::memory_order_relaxed); }//没有立即write的send次数
+    uint64_t deferredFlushes() const { return deferredFlushes_.load(std::memory_order_relaxed); }//实际的flush次数
+    uint64_t syscallsSaved() const
+    {
+        uint64_t flushes = deferredFlushes();
+        uint64_t sends = deferredSends();
+        return sends > flushes ? sends - flushes : 0;
+    }
+private:
+    //计数器只在loop线程中修改，不需要原子的read-modify-write
+    static void increment(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    enum Kind { kString, kBuffer, kPayload };
+    struct PendingSend
+    {
+        PendingSend() : kind(kString), buffer(0) {}
+
+        Kind kind;
+        TcpConnectionPtr conn;
+        std::string data;
+        Buffer buffer;
+        PayloadPtr payload;
+    };
+
+    // 在mutex_保护下取一个空闲的元素，队列从空变成非空时需要给loop投递任务
+    PendingSend& nextSlot(const TcpConnectionPtr &conn, Kind kind, bool *first);
+    void schedule();
+    void doSend();//在loop线程中执行
+
+    EventLoop *loop_;
+    std::mutex mutex_;
+    std::vector<PendingSend> pending_;//生产者写入的这一批
+    size_t numPending_;
+    std::vector<PendingSend> sending_;//loop线程正在处理的一批，和pending_交换
+    std::vector<TcpConnectionPtr> flushList_;//这一批涉及到的连接，每个只出现一次
+    std::vector<TcpConnectionPtr> deferredList_;//本轮loop延迟flush的连接
+    std::vector<TcpConnectionPtr> flushingList_;//flushDeferred正在处理的连接，和deferredList_交换
+
+    std::atomic<uint64_t> deferredSends_;
+    std::atomic<uint64_t> deferredFlushes_;
+};
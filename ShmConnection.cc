@@ -0,0 +1,628 @@
+#include "ShmConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <new>
+#include <algorithm>
+
+const size_t ShmConnection::kDefaultRingSize;
+const size_t ShmConnection::kRecordHeader;
+const uint32_t ShmConnection::kMoreChunks;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "shared memory rings need lock-free atomics");
+
+/**
+ * 一个方向的环，放在共享内存中，两个进程各自映射
+ * 消费端和生产端写的字段分别放在不同的缓存行，避免来回失效
+ * waiting标志是通知的握手：一端先置位再检查对方的位置，另一端先发布位置再检查标志，
+ * 两边都用seq_cst，至少有一边能看到对方，不会丢唤醒
+ */
+struct ShmRingHeader
+{
+    alignas(64) std::atomic<uint64_t> head;//消费端已经取走的位置
+    std::atomic<uint32_t> consumerWaiting;//消费端处理完准备回到poll，生产端写了数据以后要唤醒它
+    alignas(64) std::atomic<uint64_t> tail;//生产端已经发布的位置
+    std::atomic<uint32_t> producerWaiting;//生产端写满了，消费端腾出空间以后要唤醒它
+    std::atomic<uint32_t> closed;//生产端不会再写
+    uint64_t size;
+};
+
+static const size_t kRingHeaderSize = 4096;//头部占一页，数据从页边界开始
+static const uint32_t kWrapMarker = 0xFFFFFFFF;//环尾放不下一条消息，从头开始
+static const uint64_t kHelloMagic = 0x4d594d5544554f53ULL;
+
+static size_t alignRecord(size_t len)
+{
+    return (len + 7) & ~static_cast<size_t>(7);
+}
+
+static size_t regionSizeFor(size_t ringSize)
+{
+    return 2 * (kRingHeaderSize + ringSize);
+}
+
+static void* mapRegion(int memfd, size_t size)
+{
+    void *region = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    return region == MAP_FAILED ? nullptr : region;
+}
+
+//create发给对端的内容，fd在SCM_RIGHTS中
+struct ShmHello
+{
+    uint64_t magic;
+    uint64_t ringSize;
+};
+
+ShmConnectionPtr ShmConnection::create(EventLoop *loop, const std::string &name, int controlFd, size_t ringSize)
+{
+    //环的大小取2的幂，位置对大小取模只要一次与运算
+    size_t size = 4096;
+    while (size < ringSize)
+    {
+        size <<= 1;
+    }
+    size_t regionSize = regionSizeFor(size);
+    int memfd = ::memfd_create("mymuduo-shm", MFD_CLOEXEC);
+    int efds[2] = { ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) };
+    void *region = nullptr;
+    if (memfd >= 0 && efds[0] >= 0 && efds[1] >= 0 && ::ftruncate(memfd, regionSize) == 0)
+    {
+        region = mapRegion(memfd, regionSize);
+    }
+    if (region != nullptr)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            ShmRingHeader *h = new (static_cast<char*>(region) + i * (kRingHeaderSize + size)) ShmRingHeader;
+            h->head.store(0);
+            h->tail.store(0);
+            h->consumerWaiting.store(1);//对端还没开始处理，第一条消息要唤醒它
+            h->producerWaiting.store(0);
+            h->closed.store(0);
+            h->size = size;
+        }
+
+        ShmHello hello = { kHelloMagic, size };
+        iovec iov = { &hello, sizeof hello };
+        int fds[3] = { memfd, efds[0], efds[1] };
+        char control[CMSG_SPACE(sizeof fds)];
+        ::memset(control, 0, sizeof control);
+        msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+        ::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+        if (::sendmsg(controlFd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof hello))
+        {
+            //创建的一端写环0、读环1，自己的eventfd是efds[0]
+            return ShmConnectionPtr(new ShmConnection(loop, name, controlFd, memfd, region, size,
+                                                      efds[0], efds[1], true));
+        }
+    }
+    LOG_ERROR("ShmConnection::create [%s] fail errno:%d \n", name.c_str(), errno);
+    if (region != nullptr) ::munmap(region, regionSize);
+    if (memfd >= 0) ::close(memfd);
+    if (efds[0] >= 0) ::close(efds[0]);
+    if (efds[1] >= 0) ::close(efds[1]);
+    ::close(controlFd);
+    return ShmConnectionPtr();
+}
+
+ShmConnectionPtr ShmConnection::accept(EventLoop *loop, const std::string &name, int controlFd, int timeoutMs)
+{
+    ShmHello hello;
+    ::memset(&hello, 0, sizeof hello);
+    iovec iov = { &hello, sizeof hello };
+    int fds[3] = { -1, -1, -1 };
+    char control[CMSG_SPACE(sizeof fds)];
+    msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    pollfd pfd = { controlFd, POLLIN, 0 };
+    ssize_t n = -1;
+    if (::poll(&pfd, 1, timeoutMs) == 1)
+    {
+        n = ::recvmsg(controlFd, &msg, MSG_CMSG_CLOEXEC);
+    }
+    cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN(sizeof fds))
+    {
+        ::memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+    }
+
+    void *region = nullptr;
+    size_t size = hello.ringSize;
+    struct stat st;
+    if (n == static_cast<ssize_t>(sizeof hello) && hello.magic == kHelloMagic
+        && fds[0] >= 0 && size >= 4096 && (size & (size - 1)) == 0
+        && ::fstat(fds[0], &st) == 0 && static_cast<size_t>(st.st_size) == regionSizeFor(size))
+    {
+        region = mapRegion(fds[0], regionSizeFor(size));
+    }
+    if (region != nullptr)
+    {
+        return ShmConnectionPtr(new ShmConnection(loop, name, controlFd, fds[0], region, size,
+                                                  fds[2], fds[1], false));
+    }
+    LOG_ERROR("ShmConnection::accept [%s] fail n:%d errno:%d \n", name.c_str(), (int)n, errno);
+    for (int fd : fds)
+    {
+        if (fd >= 0) ::close(fd);
+    }
+    ::close(controlFd);
+    return ShmConnectionPtr();
+}
+
+ShmConnection::ShmConnection(EventLoop *loop, const std::string &name, int controlFd,
+                             int memfd, void *region, size_t ringSize,
+                             int myEventfd, int peerEventfd, bool creator)
+    : loop_(loop)
+    , name_(name)
+    , state_(kConnecting)
+    , controlFd_(controlFd)
+    , memfd_(memfd)
+    , region_(region)
+    , regionSize_(regionSizeFor(ringSize))
+    , ringSize_(ringSize)
+    , myEventfd_(myEventfd)
+    , peerEventfd_(peerEventfd)
+    , eventChannel_(loop, myEventfd)
+    , controlChannel_(loop, controlFd)
+    , txTail_(0)
+    , txHeadCache_(0)
+    , rxHead_(0)
+    , outbox_(0)
+    , shutdownPending_(false)
+    , messagesSent_(0)
+    , messagesReceived_(0)
+    , notifications_(0)
+    , suppressed_(0)
+    , wakeups_(0)
+    , ringFull_(0)
+{
+    char *rings[2] = { static_cast<char*>(region), static_cast<char*>(region) + kRingHeaderSize + ringSize };
+    char *tx = creator ? rings[0] : rings[1];
+    char *rx = creator ? rings[1] : rings[0];
+    tx_ = reinterpret_cast<ShmRingHeader*>(tx);
+    txData_ = tx + kRingHeaderSize;
+    rx_ = reinterpret_cast<ShmRingHeader*>(rx);
+    rxData_ = rx + kRingHeaderSize;
+    txTail_ = tx_->tail.load(std::memory_order_relaxed);
+    txHeadCache_ = tx_->head.load(std::memory_order_relaxed);
+    rxHead_ = rx_->head.load(std::memory_order_relaxed);
+
+    eventChannel_.setReadCallback(std::bind(&ShmConnection::handleRead, this, std::placeholders::_1));
+    controlChannel_.setReadCallback(std::bind(&ShmConnection::handleControlRead, this, std::placeholders::_1));
+    controlChannel_.setCloseCallback(std::bind(&ShmConnection::handleClose, this));
+    controlChannel_.setErrorCallback(std::bind(&ShmConnection::handleClose, this));
+}
+
+ShmConnection::~ShmConnection()
+{
+    LOG_DEBUG("ShmConnection::dtor [%s]\n", name_.c_str());
+    ::munmap(region_, regionSize_);
+    ::close(memfd_);
+    ::close(myEventfd_);
+    ::close(peerEventfd_);
+    ::close(controlFd_);
+}
+
+void ShmConnection::start()
+{
+    loop_->runInLoop(std::bind(&ShmConnection::connectEstablished, shared_from_this()));
+}
+
+void ShmConnection::connectEstablished()
+{
+    self_ = shared_from_this();
+    state_ = kConnected;
+    eventChannel_.enableReading();
+    controlChannel_.enableReading();
+    if (connectionCallback_)
+    {
+        connectionCallback_(self_);
+    }
+    //对端可能在start之前就写了数据
+    handleRead(Timestamp::now());
+}
+
+void ShmConnection::connectDestroyed()
+{
+    eventChannel_.remove();
+    controlChannel_.remove();
+    ShmConnectionPtr self;
+    self.swap(self_);
+}
+
+bool ShmConnection::send(const void *data, size_t len)
+{
+    if (state_ != kConnected)
+    {
+        return false;
+    }
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(static_cast<const char*>(data), len);
+    }
+    else
+    {
+        loop_->runInLoop(std::bind(&ShmConnection::sendStringInLoop, shared_from_this(),
+                                   std::string(static_cast<const char*>(data), len)));
+    }
+    return true;
+}
+
+bool ShmConnection::send(std::string &&message)
+{
+    if (state_ != kConnected)
+    {
+        return false;
+    }
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(message.data(), message.size());
+    }
+    else
+    {
+        loop_->runInLoop(std::bind(&ShmConnection::sendStringInLoop, shared_from_this(), std::move(message)));
+    }
+    return true;
+}
+
+void ShmConnection::sendStringInLoop(const std::string &message)
+{
+    sendInLoop(message.data(), message.size());
+}
+
+//环是单生产者的，只有loop线程写
+void ShmConnection::sendInLoop(const char *data, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    bool wrote = false;
+    do
+    {
+        size_t chunk = std::min(len, maxChunkSize());
+        uint32_t flags = chunk < len ? kMoreChunks : 0;
+        if (outbox_.readableBytes() == 0 && tryWrite(data, chunk, flags))
+        {
+            wrote = true;
+        }
+        else
+        {
+            //前面还有暂存的段，或者环满了，保持顺序先暂存
+            uint32_t header[2] = { static_cast<uint32_t>(chunk), flags };
+            outbox_.append(reinterpret_cast<const char*>(header), sizeof header);
+            outbox_.append(data, chunk);
+        }
+        data += chunk;
+        len -= chunk;
+    } while (len > 0);
+    if (wrote)
+    {
+        publish();
+    }
+}
+
+/**
+ * 消息拷进环，还不对对端可见，publish以后才可见
+ * 环尾剩下的空间放不下时写一个回绕标记，消息从环头开始，一条消息总是连续的
+ */
+bool ShmConnection::tryWrite(const char *data, size_t len, uint32_t flags)
+{
+    const size_t mask = ringSize_ - 1;
+    size_t need = kRecordHeader + alignRecord(len);
+    size_t offset = txTail_ & mask;
+    size_t toEnd = ringSize_ - offset;
+    size_t total = toEnd < need ? toEnd + need : need;
+    if (ringSize_ - (txTail_ - txHeadCache_) < total)
+    {
+        txHeadCache_ = tx_->head.load(std::memory_order_acquire);
+        if (ringSize_ - (txTail_ - txHeadCache_) < total)
+        {
+            //先登记再检查一次，对端在这之间腾出的空间不会漏掉唤醒
+            tx_->producerWaiting.store(1, std::memory_order_seq_cst);
+            txHeadCache_ = tx_->head.load(std::memory_order_seq_cst);
+            if (ringSize_ - (txTail_ - txHeadCache_) < total)
+            {
+                add(ringFull_, 1);
+                return false;
+            }
+        }
+    }
+    if (toEnd < need)
+    {
+        ::memcpy(txData_ + offset, &kWrapMarker, sizeof kWrapMarker);
+        txTail_ += toEnd;
+        offset = 0;
+    }
+    uint32_t header[2] = { static_cast<uint32_t>(len), flags };
+    ::memcpy(txData_ + offset, header, sizeof header);
+    ::memcpy(txData_ + offset + kRecordHeader, data, len);
+    txTail_ += need;
+    if ((flags & kMoreChunks) == 0)
+    {
+        add(messagesSent_, 1);
+    }
+    return true;
+}
+
+//发布写好的消息，对端正在处理时不唤醒它，它回到poll之前会再检查一次
+void ShmConnection::publish()
+{
+    tx_->tail.store(txTail_, std::memory_order_seq_cst);
+    if (tx_->consumerWaiting.load(std::memory_order_seq_cst) != 0
+        && tx_->consumerWaiting.exchange(0) != 0)
+    {
+        notifyPeer();
+    }
+    else
+    {
+        add(suppressed_, 1);
+    }
+}
+
+void ShmConnection::notifyPeer()
+{
+    uint64_t one = 1;
+    if (::write(peerEventfd_, &one, sizeof one) != sizeof one && errno != EAGAIN)
+    {
+        LOG_ERROR("ShmConnection::notifyPeer [%s] errno:%d \n", name_.c_str(), errno);
+    }
+    add(notifications_, 1);
+}
+
+void ShmConnection::flushOutbox()
+{
+    bool wrote = false;
+    while (outbox_.readableBytes() > 0)
+    {
+        uint32_t header[2];
+        ::memcpy(header, outbox_.peek(), sizeof header);
+        if (!tryWrite(outbox_.peek() + sizeof header, header[0], header[1]))
+        {
+            break;
+        }
+        outbox_.retrieve(sizeof header + header[0]);
+        wrote = true;
+    }
+    if (wrote)
+    {
+        publish();
+    }
+    if (shutdownPending_ && outbox_.readableBytes() == 0)
+    {
+        shutdownPending_ = false;
+        shutdownInLoop();
+    }
+}
+
+//对端写了数据或者腾出了空间
+void ShmConnection::handleRead(Timestamp receiveTime)
+{
+    uint64_t counter = 0;
+    if (::read(myEventfd_, &counter, sizeof counter) == sizeof counter)
+    {
+        add(wakeups_, 1);
+    }
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    drainRx(receiveTime);
+    if (outbox_.readableBytes() > 0)
+    {
+        flushOutbox();
+    }
+    if (rx_->closed.load(std::memory_order_acquire) != 0
+        && rx_->tail.load(std::memory_order_acquire) == rxHead_)
+    {
+        handleClose();//对端shutdown并且数据都收完了
+    }
+}
+
+/**
+ * 取完环中的消息再登记等待，登记以后再检查一次，这期间对端新发布的消息不会漏掉
+ * 处理期间consumerWaiting是0，对端发送不写eventfd
+ */
+void ShmConnection::drainRx(Timestamp receiveTime)
+{
+    for (;;)
+    {
+        consume(receiveTime);
+        if (state_ == kDisconnected)
+        {
+            return;//回调中关闭了连接
+        }
+        rx_->consumerWaiting.store(1, std::memory_order_seq_cst);
+        if (rx_->tail.load(std::memory_order_seq_cst) == rxHead_)
+        {
+            break;
+        }
+        rx_->consumerWaiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t ShmConnection::consume(Timestamp receiveTime)
+{
+    const size_t mask = ringSize_ - 1;
+    uint64_t tail = rx_->tail.load(std::memory_order_acquire);
+    uint64_t start = rxHead_;
+    size_t count = 0;
+    //tail和记录头都是对端写的，对端崩溃或者有bug时不能信，越界之前就断开
+    if (tail - rxHead_ > ringSize_)
+    {
+        corrupted("tail out of range", tail);
+        return 0;
+    }
+    while (rxHead_ != tail)
+    {
+        size_t offset = rxHead_ & mask;
+        uint64_t available = tail - rxHead_;
+        uint32_t header[2];
+        ::memcpy(header, rxData_ + offset, sizeof header);
+        uint32_t len = header[0];
+        if (len == kWrapMarker)
+        {
+            if (ringSize_ - offset > available)
+            {
+                corrupted("wrap marker past tail", len);
+                return 0;
+            }
+            rxHead_ += ringSize_ - offset;
+            continue;
+        }
+        uint64_t recordSize = kRecordHeader + alignRecord(len);
+        if (len > maxChunkSize() || recordSize > ringSize_ - offset || recordSize > available)
+        {
+            corrupted("record length out of range", len);
+            return 0;
+        }
+        const char *data = rxData_ + offset + kRecordHeader;
+        bool last = (header[1] & kMoreChunks) == 0;
+        if (!frameCallback_)
+        {
+            inputBuffer_.append(data, len);
+        }
+        else if (!last || partial_.readableBytes() > 0)
+        {
+            //分段的大消息先拼起来
+            partial_.append(data, len);
+            if (last)
+            {
+                frameCallback_(self_, StringPiece(partial_.peek(), partial_.readableBytes()), receiveTime);
+                partial_.retrieveAll();
+            }
+        }
+        else
+        {
+            //回调期间这条消息还没还给对端，直接引用环中的内存
+            frameCallback_(self_, StringPiece(data, len), receiveTime);
+        }
+        rxHead_ += recordSize;
+        if (last)
+        {
+            ++count;
+        }
+    }
+    if (rxHead_ == start)
+    {
+        return 0;
+    }
+    rx_->head.store(rxHead_, std::memory_order_seq_cst);
+    if (rx_->producerWaiting.load(std::memory_order_seq_cst) != 0
+        && rx_->producerWaiting.exchange(0) != 0)
+    {
+        notifyPeer();//对端写满了在等空间
+    }
+    add(messagesReceived_, count);
+    if (!frameCallback_ && inputBuffer_.readableBytes() > 0 && state_ != kDisconnected)
+    {
+        if (messageCallback_)
+        {
+            messageCallback_(self_, &inputBuffer_, receiveTime);
+        }
+        else
+        {
+            inputBuffer_.retrieveAll();
+        }
+    }
+    return count;
+}
+
+void ShmConnection::corrupted(const char *what, uint64_t value)
+{
+    LOG_ERROR("ShmConnection::consume [%s] ring corrupted: %s (%llu) at %llu \n",
+        name_.c_str(), what, static_cast<unsigned long long>(value), static_cast<unsigned long long>(rxHead_));
+    forceCloseInLoop();
+}
+
+//控制socket只用来发现对端退出
+void ShmConnection::handleControlRead(Timestamp)
+{
+    char buf[64];
+    ssize_t n = ::read(controlFd_, buf, sizeof buf);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        handleClose();
+    }
+}
+
+void ShmConnection::shutdown()
+{
+    int expected = kConnected;
+    if (state_.compare_exchange_strong(expected, kDisconnecting))
+    {
+        loop_->runInLoop(std::bind(&ShmConnection::shutdownInLoop, shared_from_this()));
+    }
+}
+
+void ShmConnection::shutdownInLoop()
+{
+    if (outbox_.readableBytes() > 0)
+    {
+        shutdownPending_ = true;//暂存的消息写完以后再通知
+        return;
+    }
+    tx_->closed.store(1, std::memory_order_release);
+    notifyPeer();
+}
+
+void ShmConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        loop_->queueInLoop(std::bind(&ShmConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void ShmConnection::forceCloseInLoop()
+{
+    if (state_ != kDisconnected)
+    {
+        tx_->closed.store(1, std::memory_order_release);
+        notifyPeer();
+        handleClose();
+    }
+}
+
+void ShmConnection::handleClose()
+{
+    if (state_ == kDisconnected || !self_)
+    {
+        return;
+    }
+    state_ = kDisconnected;
+    eventChannel_.disableAll();
+    controlChannel_.disableAll();
+    ::shutdown(controlFd_, SHUT_RDWR);//对端的控制socket马上读到EOF
+    ShmConnectionPtr guard(self_);
+    if (connectionCallback_)
+    {
+        connectionCallback_(guard);
+    }
+    loop_->queueInLoop(std::bind(&ShmConnection::connectDestroyed, guard));
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+#include "Channel.h"
+#include "Timestamp.h"
+#include "StringPiece.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+class EventLoop;
+class ShmConnection;
+struct ShmRingHeader;
+
+using ShmConnectionPtr = std::shared_ptr<ShmConnection>;
+
+/**
+ * 同一台机器上两个进程之间的共享内存连接
+ * 一块memfd映射出两个单生产者单消费者的环形缓冲区，每个方向一个，发送只是把消息拷进环里，不需要系统调用
+ * 每一端有一个eventfd注册在自己的loop上，对端写了数据或者腾出了空间时通过它唤醒
+ * 接收端正在处理（还没有回到poll）时发送端不写eventfd，一轮处理最多只需要一次唤醒
+ *
+ * 建立：两个进程先用AF_UNIX socket连上，一端create把memfd和两个eventfd通过SCM_RIGHTS发给对端，
+ * 另一端accept收下，之后这条socket只用来发现对端退出（进程崩溃时内核关闭socket）
+ * 消息有边界，超过maxChunkSize()的消息分成几段写，收端拼好以后再交出去；
+ * 环写满时消息暂存在本端，对端腾出空间以后继续写
+ * 除了send，其他接口都只能在loop线程中调用
+ */
+class ShmConnection : noncopyable, public std::enable_shared_from_this<ShmConnection>
+{
+public:
+    //和TcpConnection的回调形状一样，但参数是ShmConnectionPtr，两种连接没有共同的基类，
+    //同一份处理代码要挂在两种连接上时写成模板或者用lambda转发
+    using ConnectionCallback = std::function<void (const ShmConnectionPtr&)>;
+    using MessageCallback = std::function<void (const ShmConnectionPtr&, Buffer*, Timestamp)>;
+    //直接指向环中的消息，不拷贝，回调返回以后这块内存就还给对端了
+    using FrameCallback = std::function<void (const ShmConnectionPtr&, StringPiece, Timestamp)>;
+
+    static const size_t kDefaultRingSize = 1024 * 1024;//每个方向的环的大小
+
+    //在已经连上的AF_UNIX socket controlFd上创建共享内存并发给对端，接管controlFd，失败时返回nullptr
+    static ShmConnectionPtr create(EventLoop *loop, const std::string &name, int controlFd,
+                                   size_t ringSize = kDefaultRingSize);
+    //在controlFd上接收对端create发来的共享内存，最多等timeoutMs毫秒，接管controlFd，失败时返回nullptr
+    static ShmConnectionPtr accept(EventLoop *loop, const std::string &name, int controlFd,
+                                   int timeoutMs = 1000);
+    ~ShmConnection();
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+    bool connected() const { return state_ == kConnected; }
+    //一段的最大长度，不超过这个长度的消息在frameCallback中直接引用环中的内存
+    size_t maxChunkSize() const { return ringSize_ / 4; }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    //收到的消息追加到inputBuffer_以后回调，一次唤醒收到的所有消息只回调一次
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    //设置以后每条消息直接交给frameCallback，不经过inputBuffer_，messageCallback不再调用
+    void setFrameCallback(const FrameCallback &cb) { frameCallback_ = cb; }
+
+    //开始收发，之后回调connectionCallback
+    void start();
+
+    //在其他线程调用时数据拷贝一份转到loop线程，连接已经断开时返回false
+    bool send(const void *data, size_t len);
+    bool send(const std::string &message) { return send(message.data(), message.size()); }
+    bool send(std::string &&message);
+    //暂存的消息写完以后通知对端不再发送，对端收完以后关闭，两端都断开
+    void shutdown();
+    //直接断开，不等暂存的消息
+    void forceClose();
+
+    uint64_t messagesSent() const { return messagesSent_.load(std::memory_order_relaxed); }
+    uint64_t messagesReceived() const { return messagesReceived_.load(std::memory_order_relaxed); }
+    uint64_t notifications() const { return notifications_.load(std::memory_order_relaxed); }//写eventfd的次数
+    uint64_t notificationsSuppressed() const { return suppressed_.load(std::memory_order_relaxed); }//对端在处理所以省掉的通知
+    uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+    uint64_t ringFullStalls() const { return ringFull_.load(std::memory_order_relaxed); }
+private:
+    enum StateE { kConnecting, kConnected, kDisconnecting, kDisconnected };
+    static const size_t kRecordHeader = 8;//这一段的长度+标志，数据按8字节对齐
+    static const uint32_t kMoreChunks = 1;//消息还有后续的段
+
+    ShmConnection(EventLoop *loop, const std::string &name, int controlFd,
+                  int memfd, void *region, size_t ringSize,
+                  int myEventfd, int peerEventfd, bool creator);
+
+    void connectEstablished();
+    void connectDestroyed();
+    void handleRead(Timestamp receiveTime);
+    void handleControlRead(Timestamp receiveTime);
+    void handleClose();
+    void sendInLoop(const char *data, size_t len);
+    void sendStringInLoop(const std::string &message);
+    void shutdownInLoop();
+    void forceCloseInLoop();
+
+    bool tryWrite(const char *data, size_t len, uint32_t flags);
+    void publish();
+    void drainRx(Timestamp receiveTime);
+    size_t consume(Timestamp receiveTime);
+    void corrupted(const char *what, uint64_t value);
+    void flushOutbox();
+    void notifyPeer();
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    EventLoop *loop_;
+    const std::string name_;
+    std::atomic_int state_;
+    ShmConnectionPtr self_;//start到connectDestroyed期间loop持有的引用
+
+    int controlFd_;
+    int memfd_;
+    void *region_;
+    size_t regionSize_;
+    const size_t ringSize_;
+    int myEventfd_;//对端通过它唤醒本端
+    int peerEventfd_;
+    Channel eventChannel_;
+    Channel controlChannel_;
+
+    ShmRingHeader *tx_;
+    char *txData_;
+    uint64_t txTail_;//只有本端写，发布之前先在这里推进
+    uint64_t txHeadCache_;//上次读到的对端消费位置，空间够用时不去读对端的缓存行
+    ShmRingHeader *rx_;
+    const char *rxData_;
+    uint64_t rxHead_;
+
+    Buffer inputBuffer_;
+    Buffer outbox_;//环写满时暂存的段，格式和环中的记录头一样，数据不对齐
+    Buffer partial_;//frameCallback模式下拼接中的大消息
+    bool shutdownPending_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    FrameCallback frameCallback_;
+
+    std::atomic<uint64_t> messagesSent_;
+    std::atomic<uint64_t> messagesReceived_;
+    std::atomic<uint64_t> notifications_;
+    std::atomic<uint64_t> suppressed_;
+    std::atomic<uint64_t> wakeups_;
+    std::atomic<uint64_t> ringFull_;
+};
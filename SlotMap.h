@@ -0,0 +1,124 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <vector>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 用数组下标做key的容器，插入和删除都是O(1)，不需要哈希
+ * id的低32位是下标，高32位是这个槽位的代数，槽位每次被释放代数加一，
+ * 旧的id在槽位被复用以后就找不到了，不会误删新的元素
+ * id不会是0，可以用0表示无效id
+ */
+template <typename T>
+class SlotMap : noncopyable
+{
+public:
+    using Id = uint64_t;
+
+    SlotMap()
+        : freeHead_(kNoFree)
+        , size_(0)
+    {}
+
+    Id insert(T value)
+    {
+        uint32_t index;
+        if (freeHead_ != kNoFree)
+        {
+            index = freeHead_;
+            freeHead_ = slots_[index].nextFree;//从空闲链表头部取一个槽位
+        }
+        else
+        {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.push_back(Slot());
+        }
+        Slot &slot = slots_[index];
+        slot.value = std::move(value);
+        slot.used = true;
+        ++size_;
+        return makeId(slot.generation, index);
+    }
+
+    //id已经被删除过或者槽位已经复用时返回false
+    bool erase(Id id)
+    {
+        Slot *slot = lookup(id);
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        slot->value = T();//释放元素持有的资源
+        slot->used = false;
+        ++slot->generation;
+        if (slot->generation == 0)
+        {
+            slot->generation = 1;
+        }
+        slot->nextFree = freeHead_;
+        freeHead_ = indexOf(id);
+        --size_;
+        return true;
+    }
+
+    T* find(Id id)
+    {
+        Slot *slot = lookup(id);
+        return slot ? &slot->value : nullptr;
+    }
+
+    //按槽位顺序访问所有元素
+    template <typename Func>
+    void forEach(Func func)
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.used)
+            {
+                func(slot.value);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    static uint32_t indexOf(Id id) { return static_cast<uint32_t>(id); }
+    static uint32_t generationOf(Id id) { return static_cast<uint32_t>(id >> 32); }
+private:
+    static const uint32_t kNoFree = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        Slot() : value(), generation(1), nextFree(kNoFree), used(false) {}
+
+        T value;
+        uint32_t generation;
+        uint32_t nextFree;
+        bool used;
+    };
+
+    static Id makeId(uint32_t generation, uint32_t index)
+    {
+        return (static_cast<Id>(generation) << 32) | index;
+    }
+
+    Slot* lookup(Id id)
+    {
+        uint32_t index = indexOf(id);
+        if (index >= slots_.size())
+        {
+            return nullptr;
+        }
+        Slot &slot = slots_[index];
+        return slot.used && slot.generation == generationOf(id) ? &slot : nullptr;
+    }
+
+    std::vector<Slot> slots_;
+    uint32_t freeHead_;//空闲槽位链表
+    size_t size_;
+};
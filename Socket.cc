@@ -8,6 +8,11 @@
 #include <strings.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <errno.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60 // linux 4.14
+#endif
 
 Socket::~Socket()
 {
@@ -16,7 +21,7 @@ Socket::~Socket()
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (0 != ::bind(sockfd_, (sockaddr*)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.getSockAddrGeneric(), localaddr.getSockLen()))
     {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
@@ -38,13 +43,13 @@ int Socket::accept(InetAddress *peeraddr)
      * Reactor模型 one loop per thread
      * poller + non-blocking IO
      */ 
-    sockaddr_in addr;
+    sockaddr_un addr;//足够放下sockaddr_in和sockaddr_un
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        *peeraddr = InetAddress::fromSockAddr((sockaddr*)&addr, len);
     }
     return connfd;
 }
@@ -57,26 +62,158 @@ void Socket::shutdownWrite()
     }
 }
 
-void Socket::setTcpNoDelay(bool on)
+static bool setIntOption(int sockfd, int level, int optname, int optval, const char *name)
 {
-    int optval = on ? 1 : 0;
-    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof optval);
+    if (::setsockopt(sockfd, level, optname, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("%s sockfd:%d value:%d fail errno:%d \n", name, sockfd, optval, errno);
+        return false;
+    }
+    return true;
 }
 
-void Socket::setReuseAddr(bool on)
+static int getIntOption(int sockfd, int level, int optname)
 {
-    int optval = on ? 1 : 0;
-    ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof optval);
+    int optval = 0;
+    socklen_t len = sizeof optval;
+    if (::getsockopt(sockfd, level, optname, &optval, &len) < 0)
+    {
+        return -1;
+    }
+    return optval;
 }
 
-void Socket::setReusePort(bool on)
+bool Socket::setTcpNoDelay(bool on)
 {
-    int optval = on ? 1 : 0;
-    ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof optval);
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_NODELAY, on ? 1 : 0, "setTcpNoDelay");
+}
+
+bool Socket::setReuseAddr(bool on)
+{
+    return setIntOption(sockfd_, SOL_SOCKET, SO_REUSEADDR, on ? 1 : 0, "setReuseAddr");
+}
+
+bool Socket::setReusePort(bool on)
+{
+    return setIntOption(sockfd_, SOL_SOCKET, SO_REUSEPORT, on ? 1 : 0, "setReusePort");
+}
+
+bool Socket::setKeepAlive(bool on)
+{
+    return setIntOption(sockfd_, SOL_SOCKET, SO_KEEPALIVE, on ? 1 : 0, "setKeepAlive");
 }
 
-void Socket::setKeepAlive(bool on)
+bool Socket::setZeroCopy(bool on)
 {
     int optval = on ? 1 : 0;
-    ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("setZeroCopy sockfd:%d fail errno:%d \n", sockfd_, errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setSendBuffer(int bytes)
+{
+    return setIntOption(sockfd_, SOL_SOCKET, SO_SNDBUF, bytes, "setSendBuffer");
+}
+
+bool Socket::setRecvBuffer(int bytes)
+{
+    return setIntOption(sockfd_, SOL_SOCKET, SO_RCVBUF, bytes, "setRecvBuffer");
+}
+
+bool Socket::setQuickAck(bool on)
+{
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_QUICKACK, on ? 1 : 0, "setQuickAck");
+}
+
+bool Socket::setNotSentLowat(int bytes)
+{
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, bytes, "setNotSentLowat");
+}
+
+bool Socket::setDeferAccept(int seconds)
+{
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, seconds, "setDeferAccept");
+}
+
+bool Socket::setFastOpen(int queueLen)
+{
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, queueLen, "setFastOpen");
+}
+
+bool Socket::setUserTimeout(unsigned int ms)
+{
+    return setIntOption(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT, static_cast<int>(ms), "setUserTimeout");
+}
+
+bool Socket::applyOptions(const SocketOptions &options, bool listening, bool unixDomain)
+{
+    bool ok = true;
+    if (options.sendBuffer > 0)
+    {
+        ok = setSendBuffer(options.sendBuffer) && ok;
+    }
+    if (options.recvBuffer > 0)
+    {
+        ok = setRecvBuffer(options.recvBuffer) && ok;
+    }
+    if (unixDomain)
+    {
+        return ok;//AF_UNIX没有TCP层的选项
+    }
+    ok = setTcpNoDelay(options.tcpNoDelay) && ok;
+    ok = setKeepAlive(options.keepAlive) && ok;
+    if (options.notSentLowat > 0)
+    {
+        ok = setNotSentLowat(options.notSentLowat) && ok;
+    }
+    if (options.userTimeoutMs > 0)
+    {
+        ok = setUserTimeout(options.userTimeoutMs) && ok;
+    }
+    if (listening)
+    {
+        if (options.deferAcceptSeconds > 0)
+        {
+            ok = setDeferAccept(options.deferAcceptSeconds) && ok;
+        }
+        if (options.fastOpenQueue > 0)
+        {
+            ok = setFastOpen(options.fastOpenQueue) && ok;
+        }
+    }
+    else if (options.quickAck)
+    {
+        ok = setQuickAck(true) && ok;
+    }
+    return ok;
+}
+
+bool Socket::isUnix() const
+{
+    return getIntOption(sockfd_, SOL_SOCKET, SO_DOMAIN) == AF_UNIX;
+}
+
+SocketOptions Socket::effectiveOptions() const
+{
+    SocketOptions options;
+    options.sendBuffer = getIntOption(sockfd_, SOL_SOCKET, SO_SNDBUF);
+    options.recvBuffer = getIntOption(sockfd_, SOL_SOCKET, SO_RCVBUF);
+    if (isUnix())
+    {
+        options.tcpNoDelay = false;
+        options.keepAlive = false;
+        return options;
+    }
+    options.tcpNoDelay = getIntOption(sockfd_, IPPROTO_TCP, TCP_NODELAY) > 0;
+    options.keepAlive = getIntOption(sockfd_, SOL_SOCKET, SO_KEEPALIVE) > 0;
+    options.quickAck = getIntOption(sockfd_, IPPROTO_TCP, TCP_QUICKACK) > 0;
+    options.notSentLowat = getIntOption(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+    options.deferAcceptSeconds = getIntOption(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT);
+    options.fastOpenQueue = getIntOption(sockfd_, IPPROTO_TCP, TCP_FASTOPEN);
+    options.userTimeoutMs = static_cast<unsigned int>(getIntOption(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT));
+    return options;
 }
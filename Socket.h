@@ -1,6 +1,7 @@
 #pragma once
 
 #include "noncopyable.h"
+#include "SocketOptions.h"
 
 class InetAddress;
 
@@ -23,10 +24,27 @@ public:
 
     void shutdownWrite();
 
-    void setTcpNoDelay(bool on);//直接发送，数据不进行TCP缓存 
-    void setReuseAddr(bool on);
-    void setReusePort(bool on);
-    void setKeepAlive(bool on);
+    //下面的设置失败时打印错误并返回false
+    bool setTcpNoDelay(bool on);//直接发送，数据不进行TCP缓存 
+    bool setReuseAddr(bool on);
+    bool setReusePort(bool on);
+    bool setKeepAlive(bool on);
+    bool setZeroCopy(bool on);//开启SO_ZEROCOPY，内核不支持时返回false
+    bool setSendBuffer(int bytes);
+    bool setRecvBuffer(int bytes);
+    bool setQuickAck(bool on);
+    bool setNotSentLowat(int bytes);
+    bool setDeferAccept(int seconds);
+    bool setFastOpen(int queueLen);
+    bool setUserTimeout(unsigned int ms);
+
+    //按SocketOptions设置，listening为true时才设置只对监听socket有效的选项
+    //unixDomain由调用者从地址得到，AF_UNIX socket跳过TCP层的选项，不用每次getsockopt查询
+    //所有选项都会尝试，有任何一个失败返回false
+    bool applyOptions(const SocketOptions &options, bool listening, bool unixDomain);
+    //通过getsockopt读回内核实际生效的值
+    SocketOptions effectiveOptions() const;
+    bool isUnix() const;//AF_UNIX socket没有TCP层的选项
 private:
     const int sockfd_;
 };
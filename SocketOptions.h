@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * TcpServer上的socket参数，Acceptor在listen之前设置到监听socket上，
+ * TcpConnection建立时设置到accept得到的socket上
+ * 数值为0表示不设置，使用系统默认值
+ */
+struct SocketOptions
+{
+    bool tcpNoDelay = true;//关闭Nagle算法，小的响应不会被延迟
+    bool keepAlive = true;
+    int sendBuffer = 0;//SO_SNDBUF，内核实际使用的是设置值的两倍
+    int recvBuffer = 0;//SO_RCVBUF，在监听socket上设置才能影响窗口扩大因子
+    bool quickAck = false;//TCP_QUICKACK不是持久的，每次读完都要重新设置
+    int notSentLowat = 0;//TCP_NOTSENT_LOWAT，限制发送缓冲区中还没发出去的数据量
+    int deferAcceptSeconds = 0;//TCP_DEFER_ACCEPT，只对监听socket有效，有数据到达才accept
+    int fastOpenQueue = 0;//TCP_FASTOPEN，只对监听socket有效，等待的TFO请求队列长度
+    unsigned int userTimeoutMs = 0;//TCP_USER_TIMEOUT，数据超过这么久没有被确认就断开连接
+};
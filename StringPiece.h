@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+/**
+ * 指向一段已有内存的只读视图，不持有数据也不拷贝
+ * 协议解析时用它直接引用Buffer中的字节，数据的生命周期由使用者保证
+ */
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr), len_(0)
+    {}
+    StringPiece(const char *str)
+        : ptr_(str), len_(strlen(str))
+    {}
+    StringPiece(const char *data, size_t len)
+        : ptr_(data), len_(len)
+    {}
+    StringPiece(const std::string &str)
+        : ptr_(str.data()), len_(str.size())
+    {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + len_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void clear() { ptr_ = nullptr; len_ = 0; }
+    void set(const char *data, size_t len) { ptr_ = data; len_ = len; }
+    void removePrefix(size_t n) { ptr_ += n; len_ -= n; }
+    void removeSuffix(size_t n) { len_ -= n; }
+
+    bool operator==(const StringPiece &rhs) const
+    {
+        return len_ == rhs.len_ && memcmp(ptr_, rhs.ptr_, len_) == 0;
+    }
+    bool operator!=(const StringPiece &rhs) const { return !(*this == rhs); }
+    //忽略大小写比较，HTTP的头部名字等
+    bool caseEqual(const StringPiece &rhs) const
+    {
+        return len_ == rhs.len_ && strncasecmp(ptr_, rhs.ptr_, len_) == 0;
+    }
+    bool startsWith(const StringPiece &prefix) const
+    {
+        return len_ >= prefix.len_ && memcmp(ptr_, prefix.ptr_, prefix.len_) == 0;
+    }
+
+    std::string toString() const { return std::string(ptr_, len_); }
+private:
+    const char *ptr_;
+    size_t len_;
+};
@@ -0,0 +1,146 @@
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/socket.h>
+#include <strings.h>
+#include <stdio.h>
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d client Loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+//TcpClient已经析构，连接关闭时只需要销毁连接
+static void removeConnectionAfterClient(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , retry_(false)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+}
+
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+    if (conn)
+    {
+        //连接比TcpClient活得久，关闭回调不能再访问this
+        //连接在connectDestroyed之前一直由自己的self_持有，引用计数判断不出有没有别人在用，
+        //TcpClient拥有这条连接，析构时总是关掉它，否则连接和fd会一直留着
+        conn->setCloseCallback(std::bind(&removeConnectionAfterClient, loop_, std::placeholders::_1));
+        conn->forceClose();
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect [%s] - connecting to %s \n",
+        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    sockaddr_un peer, local;//足够放下sockaddr_in和sockaddr_un
+    ::bzero(&peer, sizeof peer);
+    ::bzero(&local, sizeof local);
+    socklen_t peerlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &peerlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    socklen_t locallen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr*)&local, &locallen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress peerAddr(InetAddress::fromSockAddr((sockaddr*)&peer, peerlen));
+    InetAddress localAddr(InetAddress::fromSockAddr((sockaddr*)&local, locallen));
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    //和TcpServer一样从所在loop的池分配，连接在这个loop上创建和释放
+    TcpConnectionPtr conn(std::allocate_shared<TcpConnection>(
+                            PoolAllocator<TcpConnection>(loop_->connectionPool()),
+                            loop_, connName, sockfd, localAddr, peerAddr));
+    conn->applySocketOptions(socketOptions_);
+    if (!stageFactories_.empty())
+    {
+        std::unique_ptr<Pipeline> pipeline(new Pipeline(conn.get()));
+        for (const StageFactory &factory : stageFactories_)
+        {
+            pipeline->addStage(factory(conn));
+        }
+        conn->setPipeline(std::move(pipeline));
+    }
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_, tlsServerName_);
+    }
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection [%s] - reconnecting to %s \n",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+#include "Pipeline.h"
+
+#include <mutex>
+#include <string>
+#include <atomic>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 客户端，一个TcpClient管理一条到服务器的连接
+ * Connector负责建立连接，连上以后和TcpServer一样创建TcpConnection，收发数据完全复用TcpConnection
+ * 开启retry以后连接断开会自动重连
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~TcpClient();//只能在loop线程中析构
+
+    void connect();
+    void disconnect();//发送完数据以后关闭连接
+    void stop();//停止正在进行的连接
+
+    //可以在任意线程调用
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+    const std::string& name() const { return name_; }
+
+    //在connect之前设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+    //和TcpServer::addStage一样，每次建立连接时按顺序创建stage
+    void addStage(const StageFactory &factory) { stageFactories_.push_back(factory); }
+    //每次建立连接都做TLS，serverName用于SNI和校验证书
+    void setTlsContext(const TlsContextPtr &ctx, const std::string &serverName = std::string())
+    { tlsContext_ = ctx; tlsServerName_ = serverName; }
+private:
+    void newConnection(int sockfd);//Connector连接成功的回调
+    void removeConnection(const TcpConnectionPtr &conn);//连接断开的回调
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    SocketOptions socketOptions_;
+    std::vector<StageFactory> stageFactories_;
+    TlsContextPtr tlsContext_;
+    std::string tlsServerName_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_;//只在loop线程中使用
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;//被mutex_保护
+};
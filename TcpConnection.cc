@@ -3,6 +3,11 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "SendQueue.h"
+#include "Pipeline.h"
+#include "MemoryBudget.h"
+#include "BufferPool.h"
+#include "TlsSession.h"
 
 #include <functional>
 #include <errno.h>
@@ -12,6 +17,21 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <string>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -27,59 +47,199 @@ TcpConnection::TcpConnection(EventLoop *loop, //构造函数
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr)
+    : TcpConnection(loop, 0, nullptr, sockfd, peerAddr)
+{
+    std::call_once(nameOnce_, [&]() { name_ = nameArg; });
+    std::call_once(localAddrOnce_, [&]() { localAddr_ = localAddr; });
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                uint64_t id,
+                const std::shared_ptr<const std::string> &namePrefix,
+                int sockfd,
+                const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , id_(id)
+    , namePrefix_(namePrefix)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
-    , localAddr_(localAddr)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , peerAddr_(peerAddr)
     , highWaterMark_(64*1024*1024) //超过64M就到水位线了，要停止发送 
+    , lowWaterMark_(0)
+    , inputHighWaterMark_(64*1024*1024)
+    , inputLowWaterMark_(0)
+    , outputAboveHighWater_(false)
+    , inputAboveHighWater_(false)
+    , accountedBytes_(0)
+    , budgetPaused_(false)
+    , pipelinePaused_(false)
+    , shutdownHeld_(false)
+    , inputBuffer_(0)//第一次用到时才从loop的BufferPool取底层数组
+    , outputBuffer_(0)
+    , idleMode_(false)
+    , idleShrinkSeconds_(kIdleShrinkSeconds)
+    , idleShrinkScheduled_(false)
+    , ioCount_(0)
+    , flushScheduled_(false)
+    , deferredFlush_(false)
+    , deferredFlushThreshold_(kDeferredFlushThreshold)
+    , deferredFlushScheduled_(false)
+    , queuedPayloadBytes_(0)
+    , zeroCopy_(false)
+    , zeroCopyThreshold_(kZeroCopyThreshold)
+    , zeroCopyNextId_(0)
+    , quickAck_(false)
+    , tlsHandshaking_(false)
+    , relayPiped_(0)
+    , relayEof_(false)
 {
+    relayPipe_[0] = relayPipe_[1] = -1;
+
     //下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
+    channel_.setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
     );
-    channel_->setWriteCallback(
+    channel_.setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this)
     );
-    channel_->setCloseCallback(
+    channel_.setCloseCallback(
         std::bind(&TcpConnection::handleClose, this)
     );
-    channel_->setErrorCallback(
+    channel_.setErrorCallback(
         std::bind(&TcpConnection::handleError, this)
     );
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_DEBUG("TcpConnection::ctor id=%llu at fd=%d\n", static_cast<unsigned long long>(id_), sockfd);
+    socket_.setKeepAlive(true);//没有设置SocketOptions时的默认值
+}
+
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]() {
+        char buf[32] = {0};
+        snprintf(buf, sizeof buf, "#%llu", static_cast<unsigned long long>(id_));
+        name_ = namePrefix_ ? *namePrefix_ + buf : buf;
+    });
+    return name_;
+}
+
+const InetAddress& TcpConnection::localAddress() const
+{
+    std::call_once(localAddrOnce_, [this]() {
+        //通过sockfd获取其绑定的本机的ip地址和端口信息
+        sockaddr_un local;//足够放下sockaddr_in和sockaddr_un
+        ::bzero(&local, sizeof local);
+        socklen_t addrlen = sizeof local;
+        if (::getsockname(socket_.fd(), (sockaddr*)&local, &addrlen) < 0)
+        {
+            LOG_ERROR("sockets::getLocalAddr");
+        }
+        localAddr_ = InetAddress::fromSockAddr((sockaddr*)&local, addrlen);
+    });
+    return localAddr_;
+}
+
+bool TcpConnection::applySocketOptions(const SocketOptions &options)
+{
+    quickAck_ = options.quickAck && !peerAddr_.isUnix();//AF_UNIX没有TCP_QUICKACK
+    bool ok = socket_.applyOptions(options, false, peerAddr_.isUnix());
+    if (!ok)
+    {
+        LOG_ERROR("TcpConnection::applySocketOptions [%s] some options failed \n", name().c_str());
+    }
+    return ok;
+}
+
+SocketOptions TcpConnection::effectiveSocketOptions() const
+{
+    return socket_.effectiveOptions();
 }
 
 
 TcpConnection::~TcpConnection()//析构函数 
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
-        name_.c_str(), channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
+        name().c_str(), channel_.fd(), (int)state_);
+    closeRelay();
 }
 
-void TcpConnection::send(const std::string &buf)
+//超过内存预算并且策略是拒绝发送时，send返回false
+static bool rejectedByBudget()
 {
-    if (state_ == kConnected)
+    MemoryBudget &budget = MemoryBudget::instance();
+    if ((budget.policy() & MemoryBudget::kRejectSends) && budget.overBudget())
+    {
+        budget.countRejectedSend();
+        return true;
+    }
+    return false;
+}
+
+bool TcpConnection::send(const std::string &buf)
+{
+    if (state_ == kConnected && !rejectedByBudget())
+    {
+        if (pipeline_)
+        {
+            sendThroughPipeline(buf.data(), buf.size());
+        }
+        else if (loop_->isInLoopThread())//当前loop是不是在对应的线程 
+        {
+            sendInLoop(buf.c_str(), buf.size());
+        }
+        else
+        {
+            //数据拷贝进loop的发送队列，调用者的buf随后被销毁也没关系
+            loop_->sendQueue()->push(shared_from_this(), buf.c_str(), buf.size());
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TcpConnection::send(std::string &&buf)
+{
+    if (state_ == kConnected && !rejectedByBudget())
     {
-        if (loop_->isInLoopThread())//当前loop是不是在对应的线程 
+        if (pipeline_)
+        {
+            sendThroughPipeline(buf.data(), buf.size());
+        }
+        else if (loop_->isInLoopThread())
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
-            ));
+            loop_->sendQueue()->push(shared_from_this(), std::move(buf));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TcpConnection::send(Buffer &&buf)
+{
+    if (state_ == kConnected && !rejectedByBudget())
+    {
+        if (pipeline_)
+        {
+            sendThroughPipeline(std::move(buf));
+        }
+        else if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.peek(), buf.readableBytes());
+            buf.retrieveAll();
+        }
+        else
+        {
+            loop_->sendQueue()->push(shared_from_this(), std::move(buf));
         }
+        return true;
     }
+    return false;
 }
 
 /**
@@ -98,10 +258,24 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         return;
     }
 
+    if (deferredFlush_)
+    {
+        //cork：只追加到发送缓冲区，本轮loop结束前统一flush
+        if (!channel_.isWriting())
+        {
+            loop_->sendQueue()->countDeferredSend();
+        }
+        checkHighWaterMark(len);
+        appendOutput(static_cast<const char*>(data), len);
+        deferFlushInLoop();
+        updateBufferAccounting();
+        return;
+    }
+
     //表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = ::write(channel_.fd(), data, len);
         if (nwrote >= 0)
         {
             remaining = len - nwrote;
@@ -132,149 +306,1475 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     //也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
     if (!faultError && remaining > 0) 
     {
-        //目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_
-            && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+        checkHighWaterMark(remaining);
+        appendOutput((char*)data + nwrote, remaining);
+        if (!channel_.isWriting())
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
-            );
+            channel_.enableWriting();//这里一定要注册channel的写事件，否则poller不会给channel通知epollout
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        updateBufferAccounting();
+    }
+}
+
+/**
+ * 一批回复一次发出去：小块数据已经在text里，payload只排引用，
+ * 全部排进发送缓冲区以后flushOutputInLoop用一次writev写socket
+ */
+bool TcpConnection::sendBatch(Buffer *text, const std::vector<std::pair<size_t, PayloadPtr>> &payloads)
+{
+    if (state_ != kConnected || rejectedByBudget())
+    {
+        return false;
+    }
+    const char *base = text->peek();
+    const size_t total = text->readableBytes();
+    if (pipeline_ || !loop_->isInLoopThread())
+    {
+        //stage要变换数据或者不在loop线程，拼成一个Buffer走普通的send
+        Buffer merged(0);
+        size_t pos = 0;
+        for (const auto &piece : payloads)
+        {
+            merged.append(base + pos, piece.first - pos);
+            merged.append(piece.second->data(), piece.second->size());
+            pos = piece.first;
+        }
+        merged.append(base + pos, total - pos);
+        text->retrieveAll();
+        return send(std::move(merged));
+    }
+
+    if (payloads.empty())
+    {
+        queueOutputInLoop(text);//发送缓冲区是空的时直接交换，不拷贝
+    }
+    else
+    {
+        size_t pos = 0;
+        for (const auto &piece : payloads)
         {
-            channel_->enableWriting();//这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+            if (piece.first > pos)
+            {
+                queueOutputInLoop(base + pos, piece.first - pos);
+            }
+            queuePayloadInLoop(piece.second);
+            pos = piece.first;
+        }
+        if (total > pos)
+        {
+            queueOutputInLoop(base + pos, total - pos);
         }
+        text->retrieveAll();
+    }
+    if (deferredFlush_)
+    {
+        deferFlushInLoop();
+    }
+    else
+    {
+        flushOutputInLoop();
     }
+    return true;
 }
 
-//关闭连接
-void TcpConnection::shutdown()
+bool TcpConnection::send(const PayloadPtr &payload)
 {
-    if (state_ == kConnected)
+    if (state_ == kConnected && !rejectedByBudget())
     {
-        setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this)
-        );
+        if (pipeline_)
+        {
+            sendThroughPipeline(payload->data(), payload->size());//stage要变换数据，不能只持有引用
+        }
+        else if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            //和其他跨线程的send走同一个队列，保证发送顺序
+            loop_->sendQueue()->push(shared_from_this(), payload);
+        }
+        return true;
     }
+    return false;
 }
 
-void TcpConnection::shutdownInLoop()
+/**
+ * payload不拷贝进outputBuffer_，没发送完的部分以引用+偏移的形式放进outputQueue_
+ * 同一个payload广播给N个连接时内存只有一份，最后一个连接发送完以后释放
+ * 开启zero-copy时大块的payload用MSG_ZEROCOPY发送，内核直接从payload的内存取数据，
+ * 发送出去的payload记录在zeroCopyPending_中，直到错误队列上收到完成通知才释放引用
+ */
+void TcpConnection::sendPayloadInLoop(const PayloadPtr &payload)
 {
-    if (!channel_->isWriting())//说明outputBuffer中的数据已经全部发送完成
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+
+    if (deferredFlush_)
+    {
+        if (!channel_.isWriting())
+        {
+            loop_->sendQueue()->countDeferredSend();
+        }
+        checkHighWaterMark(payload->size());
+        appendPayload(payload, 0);
+        deferFlushInLoop();
+        updateBufferAccounting();
+        return;
+    }
+
+    size_t len = payload->size();
+    size_t nwrote = 0;
+    if (!channel_.isWriting() && pendingOutputBytes() == 0)
+    {
+        ssize_t n = writePayload(payload, 0, len);
+        if (n >= 0)
+        {
+            nwrote = n;
+            if (nwrote == len)
+            {
+                if (writeCompleteCallback_)
+                {
+                    loop_->queueInLoop(
+                        std::bind(writeCompleteCallback_, shared_from_this())
+                    );
+                }
+                return;
+            }
+        }
+        else if (errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendPayloadInLoop");
+            if (errno == EPIPE || errno == ECONNRESET)
+            {
+                return;
+            }
+        }
+    }
+
+    checkHighWaterMark(len - nwrote);
+    appendPayload(payload, nwrote);
+    if (!channel_.isWriting())
     {
-        socket_->shutdownWrite();//关闭写端
+        channel_.enableWriting();
     }
+    updateBufferAccounting();
 }
 
-//连接建立
-void TcpConnection::connectEstablished()
+//发送缓冲区将要增加len字节，从高水位以下越过高水位时回调
+void TcpConnection::checkHighWaterMark(size_t len)
 {
-    setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading();//向poller注册channel的epollin事件
+    //目前发送缓冲区剩余的待发送数据的长度
+    size_t oldLen = pendingOutputBytes();
+    if (oldLen + len >= highWaterMark_ && oldLen < highWaterMark_)
+    {
+        outputAboveHighWater_ = true;
+        if (pipeline_)
+        {
+            notifyPipelineWritable(false);
+        }
+        if (highWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+len)
+            );
+        }
+    }
+}
 
-    //新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+//越过高水位以后，发送缓冲区降到低水位以下时回调，通知上游恢复生产
+void TcpConnection::checkLowWaterMark()
+{
+    size_t len = pendingOutputBytes();
+    if (outputAboveHighWater_ && len <= lowWaterMark_)
+    {
+        outputAboveHighWater_ = false;
+        if (pipeline_)
+        {
+            notifyPipelineWritable(true);
+        }
+        if (lowWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(lowWaterMarkCallback_, shared_from_this(), len)
+            );
+        }
+    }
 }
 
-//连接销毁
-void TcpConnection::connectDestroyed()
+/**
+ * 接收缓冲区中用户还没有取走的数据越过高水位时回调，一般在回调中stopRead
+ * 越过高水位以后又降到低水位以下时回调，一般在回调中startRead
+ */
+void TcpConnection::checkInputWaterMark()
 {
-    if (state_ == kConnected)
+    size_t len = inputBuffer_.readableBytes();
+    if (!inputAboveHighWater_ && len >= inputHighWaterMark_)
     {
-        setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        inputAboveHighWater_ = true;
+        if (inputHighWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(inputHighWaterMarkCallback_, shared_from_this(), len)
+            );
+        }
+    }
+    else if (inputAboveHighWater_ && len <= inputLowWaterMark_)
+    {
+        inputAboveHighWater_ = false;
+        if (inputLowWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(inputLowWaterMarkCallback_, shared_from_this(), len)
+            );
+        }
     }
-    channel_->remove();//把channel从poller中删除掉
 }
 
-void TcpConnection::handleRead(Timestamp receiveTime)
+void TcpConnection::inputConsumed()
 {
-    int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0)
+    loop_->runInLoop(std::bind(&TcpConnection::inputConsumedInLoop, shared_from_this()));
+}
+
+void TcpConnection::inputConsumedInLoop()
+{
+    checkInputWaterMark();
+    updateBufferAccounting();
+}
+
+/**
+ * 缓冲区中的数据量有变化时记到所属loop上，loop每轮循环汇总到MemoryBudget
+ * 数据量增加并且超过预算时，按MemoryBudget的策略暂停读或者关闭连接
+ */
+void TcpConnection::updateBufferAccounting()
+{
+    if (idleMode_)
     {
-        //已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        recycleIdleBuffers();
     }
-    else if (n == 0)
+    int64_t bytes = inputBuffer_.readableBytes() + pendingOutputBytes();
+    if (bytes == accountedBytes_)
     {
-        handleClose();
+        return;
     }
-    else
+    loop_->adjustBufferBytes(bytes - accountedBytes_);
+    bool grew = bytes > accountedBytes_;
+    accountedBytes_ = bytes;
+
+    MemoryBudget &budget = MemoryBudget::instance();
+    //输入缓冲区不到底线的连接总是可以读，否则缓冲区中的半条消息可能永远凑不齐
+    bool belowFloor = static_cast<int64_t>(inputBuffer_.readableBytes()) < budget.pauseFloor();
+    if (budgetPaused_ && belowFloor)
     {
-        errno = savedErrno;
-        LOG_ERROR("TcpConnection::handleRead");
-        handleError();
+        budgetPaused_ = false;//用户取走了数据，不用等全局的恢复线
+        budget.removePaused(shared_from_this());
+        updateReading();
+    }
+    if (!grew || state_ != kConnected || !budget.overBudget())
+    {
+        return;
+    }
+    int policy = budget.policy();
+    int64_t share = budget.connectionShare();
+    if ((policy & MemoryBudget::kCloseOffenders) && accountedBytes_ >= share * MemoryBudget::kOffenderFactor)
+    {
+        LOG_ERROR("TcpConnection::updateBufferAccounting [%s] holds %ld bytes over budget, closing \n",
+            name().c_str(), accountedBytes_);
+        budget.countClosedConnection();
+        forceClose();
+    }
+    else if ((policy & MemoryBudget::kPauseReads) && !budgetPaused_ && !belowFloor && accountedBytes_ >= share)
+    {
+        budgetPaused_ = true;
+        if (channel_.isReading())
+        {
+            channel_.disableReading();
+        }
+        budget.addPaused(shared_from_this());
     }
 }
 
-void TcpConnection::handleWrite()
+void TcpConnection::setIdleMode(bool on, double shrinkAfterSeconds)
+{
+    idleMode_ = on;
+    idleShrinkSeconds_ = shrinkAfterSeconds;
+}
+
+/**
+ * 空闲模式下缓冲区取空就把底层数组还给loop的BufferPool
+ * 还有数据没取走的缓冲区如果扩容过，安静一段时间以后再缩回去
+ */
+void TcpConnection::recycleIdleBuffers()
 {
-    if (channel_->isWriting())
+    ++ioCount_;
+    BufferPool *pool = loop_->bufferPool();
+    pool->recycle(&inputBuffer_);
+    if (pendingOutputBytes() == 0)
     {
-        int savedErrno = 0;
-        // 缓冲区的可读数据写到clientfd中
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
-        {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+        pool->recycle(&outputBuffer_);
+    }
+
+    bool grown = inputBuffer_.capacity() > BufferPool::kStorageSize
+        || outputBuffer_.capacity() > BufferPool::kStorageSize;
+    if (grown && !idleShrinkScheduled_ && state_ == kConnected)
+    {
+        idleShrinkScheduled_ = true;
+        uint64_t ioCount = ioCount_;
+        std::weak_ptr<TcpConnection> weakConn(self_);//定时器不延长连接的生命期
+        loop_->runAfter(idleShrinkSeconds_, [weakConn, ioCount]() {
+            TcpConnectionPtr conn(weakConn.lock());
+            if (conn)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    //唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                conn->shrinkIdleBuffers(ioCount);
             }
-        }
-        else
-        {
-            LOG_ERROR("TcpConnection::handleWrite");
-        }
+        });
     }
-    else
+}
+
+void TcpConnection::shrinkIdleBuffers(uint64_t ioCount)
+{
+    idleShrinkScheduled_ = false;
+    if (state_ != kConnected)
+    {
+        return;
+    }
+    if (ioCount != ioCount_)
+    {
+        recycleIdleBuffers();//这段时间里还有收发，重新计时
+        return;
+    }
+    if (inputBuffer_.capacity() > BufferPool::kStorageSize)
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        inputBuffer_.shrink(0);
+    }
+    if (outputBuffer_.capacity() > BufferPool::kStorageSize)
+    {
+        outputBuffer_.shrink(0);
     }
 }
 
-//poller => channel::closeCallback => TcpConnection::handleClose
-void TcpConnection::handleClose()
+void TcpConnection::resumeFromBudget()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
-    setState(kDisconnected);
-    channel_->disableAll();
+    loop_->runInLoop(std::bind(&TcpConnection::resumeFromBudgetInLoop, shared_from_this()));
+}
 
-    TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr);//有新连接或连接断开时都要执行此回调
-    closeCallback_(connPtr);//关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+void TcpConnection::resumeFromBudgetInLoop()
+{
+    if (!budgetPaused_)
+    {
+        return;//排队期间已经自己恢复了
+    }
+    //排队期间可能自己恢复以后又暂停了一次，列表中有新加的记录，一起删掉
+    budgetPaused_ = false;
+    MemoryBudget::instance().removePaused(shared_from_this());
+    updateReading();//用户自己stopRead的连接保持停止
 }
 
-void TcpConnection::handleError()
+void TcpConnection::setPipeline(std::unique_ptr<Pipeline> pipeline)
 {
-    int optval;
-    socklen_t optlen = sizeof optval;
-    int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    pipeline_ = std::move(pipeline);
+}
+
+void TcpConnection::sendThroughPipeline(const char *data, size_t len)
+{
+    Buffer buf(len);
+    buf.append(data, len);
+    sendThroughPipeline(std::move(buf));
+}
+
+//stage只在loop线程中运行，其他线程send的数据按顺序投递到loop中再经过pipeline
+void TcpConnection::sendThroughPipeline(Buffer &&buf)
+{
+    if (loop_->isInLoopThread())
     {
-        err = errno;
+        pipeline_->write(&buf);
+        updateBufferAccounting();
+    }
+    else
+    {
+        std::shared_ptr<Buffer> shared = std::make_shared<Buffer>(0);
+        shared->swap(buf);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::writePipelineInLoop, shared_from_this(), shared));
+    }
+}
+
+void TcpConnection::writePipelineInLoop(const std::shared_ptr<Buffer> &buf)
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        pipeline_->write(buf.get());
+        updateBufferAccounting();
+    }
+}
+
+void TcpConnection::redrivePipeline(size_t index)
+{
+    if (state_ != kDisconnected)
+    {
+        pipeline_->redrive(index);
+        updateBufferAccounting();
+        resumeHeldShutdown();
+    }
+}
+
+void TcpConnection::setPipelinePaused(bool paused)
+{
+    pipelinePaused_ = paused;
+    if (paused)
+    {
+        if (state_ != kDisconnected && channel_.isReading())
+        {
+            channel_.disableReading();
+        }
+    }
+    else
+    {
+        updateReading();
+    }
+}
+
+//在下一次loop中通知，stage可能正在自己的onWrite中，避免重入
+void TcpConnection::notifyPipelineWritable(bool writable)
+{
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::setPipelineWritable, shared_from_this(), writable));
+}
+
+void TcpConnection::setPipelineWritable(bool writable)
+{
+    pipeline_->setWritable(writable);
+}
+
+void TcpConnection::notifyPipelineDrained()
+{
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::pipelineDrained, shared_from_this()));
+}
+
+void TcpConnection::pipelineDrained()
+{
+    if (state_ != kDisconnected && pendingOutputBytes() == 0)
+    {
+        pipeline_->drained();
+    }
+}
+
+void TcpConnection::resumeHeldShutdown()
+{
+    if (shutdownHeld_ && state_ == kDisconnecting && !pipeline_->hasPendingOutput())
+    {
+        shutdownHeld_ = false;
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::startTls(const TlsContextPtr &ctx, const std::string &serverName)
+{
+    tls_.reset(new TlsSession(ctx, channel_.fd(), serverName));
+}
+
+//握手期间连接保持kConnecting，用户send不到socket上，handleRead/handleWrite只推进握手
+void TcpConnection::handshakeTls()
+{
+    switch (tls_->handshake())
+    {
+    case TlsSession::kDone:
+        finishTlsHandshake();
+        break;
+    case TlsSession::kWantRead:
+        if (channel_.isWriting())
+        {
+            channel_.disableWriting();
+        }
+        break;
+    case TlsSession::kWantWrite:
+        if (!channel_.isWriting())
+        {
+            channel_.enableWriting();
+        }
+        break;
+    case TlsSession::kFailed:
+        LOG_ERROR("TcpConnection::handshakeTls [%s] handshake with %s failed \n",
+            name().c_str(), peerAddr_.toIpPort().c_str());
+        handleClose();
+        break;
+    }
+}
+
+void TcpConnection::tlsHandshakeTimeout()
+{
+    if (tlsHandshaking_ && state_ != kDisconnected)
+    {
+        LOG_ERROR("TcpConnection::tlsHandshakeTimeout [%s] handshake with %s timed out \n",
+            name().c_str(), peerAddr_.toIpPort().c_str());
+        handleClose();
+    }
+}
+
+void TcpConnection::finishTlsHandshake()
+{
+    tlsHandshaking_ = false;
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+    LOG_DEBUG("TcpConnection::finishTlsHandshake [%s] %s %s kernel send:%d recv:%d \n",
+        name().c_str(), tls_->version(), tls_->cipher(), tls_->kernelSend(), tls_->kernelRecv());
+    StagePtr stage(tls_->userSpaceStage());
+    if (stage)
+    {
+        if (!pipeline_)
+        {
+            pipeline_.reset(new Pipeline(this));
+        }
+        pipeline_->addFirst(std::move(stage));
+    }
+    setState(kConnected);
+    if (pipeline_)
+    {
+        pipeline_->connected();
+    }
+    connectionCallback_(self_);
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        //不在当前调用栈里关闭，避免在用户的回调中重入connectionCallback_
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReading();
+}
+
+//用户没有stopRead、没有因为预算或者pipeline的背压暂停时才从socket读
+void TcpConnection::updateReading()
+{
+    if (state_ == kDisconnected || channel_.isReading())
+    {
+        return;
+    }
+    if (!reading_ || budgetPaused_ || pipelinePaused_)
+    {
+        return;
+    }
+    //对接中因为背压或者EOF停掉的读由relayDrain恢复
+    if (relayPeer_ && (relayPiped_ > 0 || relayEof_))
+    {
+        return;
+    }
+    channel_.enableReading();
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    if (state_ != kDisconnected && channel_.isReading())
+    {
+        channel_.disableReading();
+    }
+}
+
+//payload从offset开始的数据排到发送队列末尾，outputBuffer_中已有的数据排在它前面
+void TcpConnection::appendPayload(const PayloadPtr &payload, size_t offset)
+{
+    if (outputQueue_.empty() && outputBuffer_.readableBytes() > 0)
+    {
+        outputQueue_.push_back(OutputChunk{PayloadPtr(), 0, outputBuffer_.readableBytes()});
+    }
+    outputQueue_.push_back(OutputChunk{payload, offset, payload->size() - offset});
+    queuedPayloadBytes_ += payload->size() - offset;
+}
+
+//把数据拷贝到outputBuffer_，outputQueue_不为空时同时记录在队尾，保证发送顺序
+void TcpConnection::appendOutput(const char *data, size_t len)
+{
+    if (!outputQueue_.empty())
+    {
+        OutputChunk &back = outputQueue_.back();
+        if (back.payload)
+        {
+            outputQueue_.push_back(OutputChunk{PayloadPtr(), 0, len});
+        }
+        else
+        {
+            back.len += len;
+        }
+    }
+    if (len <= Buffer::kInitialSize)
+    {
+        loop_->bufferPool()->fill(&outputBuffer_);//更大的数据直接按实际大小分配
+    }
+    outputBuffer_.append(data, len);
+}
+
+ssize_t TcpConnection::sendZeroCopy(const PayloadPtr &payload, size_t offset, size_t len)
+{
+    ssize_t n = ::send(channel_.fd(), payload->data() + offset, len, MSG_ZEROCOPY);
+    if (n > 0)
+    {
+        //每一次成功的MSG_ZEROCOPY发送，内核都分配一个递增的序号，完成通知按序号区间上报
+        zeroCopyPending_.push_back(ZeroCopyPending{zeroCopyNextId_++, payload});
+    }
+    return n;
+}
+
+//发送payload中[offset, offset+len)的数据，达到阈值的走zero-copy
+ssize_t TcpConnection::writePayload(const PayloadPtr &payload, size_t offset, size_t len)
+{
+    if (useZeroCopy(len))
+    {
+        ssize_t n = sendZeroCopy(payload, offset, len);
+        if (n >= 0 || errno != ENOBUFS)
+        {
+            return n;
+        }
+        //超过了optmem的限制，内核无法再锁定更多的用户内存，这次退回拷贝发送
+    }
+    return ::write(channel_.fd(), payload->data() + offset, len);
+}
+
+//发送完的n个字节从outputQueue_队头移除，payload发送完就释放引用
+void TcpConnection::retrieveOutputQueue(size_t n)
+{
+    while (n > 0)
+    {
+        OutputChunk &chunk = outputQueue_.front();
+        size_t len = std::min(n, chunk.len);
+        if (chunk.payload)
+        {
+            chunk.offset += len;
+            queuedPayloadBytes_ -= len;
+        }
+        else
+        {
+            outputBuffer_.retrieve(len);
+        }
+        chunk.len -= len;
+        n -= len;
+        if (chunk.len == 0)
+        {
+            outputQueue_.pop_front();
+        }
+    }
+}
+
+/**
+ * outputQueue_不为空时的handleWrite，按顺序发送缓冲区数据和payload
+ * 连续的非zero-copy块合并成一次writev，zero-copy的块单独发送
+ * 返回false表示发生了EWOULDBLOCK以外的错误
+ */
+bool TcpConnection::flushOutputQueue(int *savedErrno)
+{
+    while (!outputQueue_.empty())
+    {
+        const OutputChunk &front = outputQueue_.front();
+        ssize_t n = 0;
+        size_t expected = 0;
+        if (front.payload && useZeroCopy(front.len))
+        {
+            expected = front.len;
+            n = writePayload(front.payload, front.offset, front.len);
+        }
+        else
+        {
+            struct iovec vec[kMaxIovecs];
+            int iovcnt = 0;
+            size_t bufferOffset = 0;//outputBuffer_中的数据按顺序分布在各个缓冲区块中
+            for (auto it = outputQueue_.begin(); it != outputQueue_.end() && iovcnt < kMaxIovecs; ++it)
+            {
+                if (it->payload && useZeroCopy(it->len))
+                {
+                    break;
+                }
+                if (it->payload)
+                {
+                    vec[iovcnt].iov_base = const_cast<char*>(it->payload->data() + it->offset);
+                }
+                else
+                {
+                    vec[iovcnt].iov_base = const_cast<char*>(outputBuffer_.peek() + bufferOffset);
+                    bufferOffset += it->len;
+                }
+                vec[iovcnt].iov_len = it->len;
+                expected += it->len;
+                ++iovcnt;
+            }
+            n = ::writev(channel_.fd(), vec, iovcnt);
+        }
+
+        if (n < 0)
+        {
+            *savedErrno = errno;
+            return errno == EWOULDBLOCK;
+        }
+        retrieveOutputQueue(n);
+        if (static_cast<size_t>(n) < expected)
+        {
+            break;//tcp发送缓冲区满了，等下一次epollout
+        }
+    }
+    return true;
+}
+
+/**
+ * zero-copy的完成通知在socket的错误队列上，epoll以EPOLLERR上报
+ * 每条通知是一个序号区间[ee_info, ee_data]，这些发送内核已经不再引用用户内存，可以释放payload
+ * 返回是否读到了完成通知
+ */
+bool TcpConnection::handleZeroCopyCompletion()
+{
+    bool handled = false;
+    for (;;)
+    {
+        char control[128];
+        msghdr msg;
+        bzero(&msg, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_.fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            break;//错误队列读空了
+        }
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            sock_extended_err *serr = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            handled = true;
+
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            for (ZeroCopyPending &pending : zeroCopyPending_)
+            {
+                //序号会回绕，用差值比较
+                if (static_cast<int32_t>(pending.id - lo) >= 0 && static_cast<int32_t>(hi - pending.id) >= 0)
+                {
+                    pending.payload.reset();
+                }
+            }
+            while (!zeroCopyPending_.empty() && !zeroCopyPending_.front().payload)
+            {
+                zeroCopyPending_.pop_front();
+            }
+
+            //内核退回了拷贝发送（比如loopback），zero-copy只剩下锁页的开销，关掉它
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                LOG_DEBUG("TcpConnection::handleZeroCopyCompletion [%s] kernel copied, disable zero-copy\n", name().c_str());
+                zeroCopy_ = false;
+            }
+        }
+    }
+    return handled;
+}
+
+bool TcpConnection::setZeroCopy(bool on, size_t threshold)
+{
+    zeroCopyThreshold_ = threshold;
+    if (on == zeroCopy_)
+    {
+        return true;
+    }
+    //SO_ZEROCOPY一旦打开就不需要关闭，关闭时只是不再带MSG_ZEROCOPY标志
+    if (on && !socket_.setZeroCopy(true))
+    {
+        return false;
+    }
+    zeroCopy_ = on;
+    return true;
+}
+
+void TcpConnection::startRelay(const TcpConnectionPtr &a, const TcpConnectionPtr &b)
+{
+    if (a->getLoop() != b->getLoop())
+    {
+        LOG_ERROR("TcpConnection::startRelay [%s] and [%s] are not in the same loop \n",
+            a->name().c_str(), b->name().c_str());
+        return;
+    }
+    a->getLoop()->runInLoop(std::bind(&TcpConnection::startRelayInLoop, a, b));
+}
+
+void TcpConnection::startRelayInLoop(const TcpConnectionPtr &a, const TcpConnectionPtr &b)
+{
+    if (a == b || !a->connected() || !b->connected() || a->relayPeer_ || b->relayPeer_)
+    {
+        LOG_ERROR("TcpConnection::startRelay [%s] <=> [%s] refused \n", a->name().c_str(), b->name().c_str());
+        return;
+    }
+    //splice直接搬socket上的字节，会绕过TLS和pipeline的stage，把密文或者没有分帧的数据转给对端
+    if (a->tls_ || a->pipeline_ || b->tls_ || b->pipeline_)
+    {
+        LOG_ERROR("TcpConnection::startRelay [%s] <=> [%s] refused: TLS or pipeline installed \n",
+            a->name().c_str(), b->name().c_str());
+        return;
+    }
+    if (!a->openRelayPipe() || !b->openRelayPipe())
+    {
+        a->closeRelay();
+        b->closeRelay();
+        return;
+    }
+    a->relayPeer_ = b;
+    b->relayPeer_ = a;
+
+    //对接之前已经读进inputBuffer_的数据，拷贝转发一次，之后的数据都走pipe
+    if (a->inputBuffer_.readableBytes() > 0)
+    {
+        b->sendInLoop(a->inputBuffer_.peek(), a->inputBuffer_.readableBytes());
+        a->inputBuffer_.retrieveAll();
+    }
+    if (b->inputBuffer_.readableBytes() > 0)
+    {
+        a->sendInLoop(b->inputBuffer_.peek(), b->inputBuffer_.readableBytes());
+        b->inputBuffer_.retrieveAll();
+    }
+}
+
+void TcpConnection::stopRelay()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopRelayInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopRelayInLoop()
+{
+    if (relayPeer_)
+    {
+        TcpConnectionPtr peer(relayPeer_);
+        detachRelay();
+        peer->detachRelay();
+    }
+}
+
+bool TcpConnection::openRelayPipe()
+{
+    if (::pipe2(relayPipe_, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("TcpConnection::openRelayPipe [%s] errno:%d \n", name().c_str(), errno);
+        relayPipe_[0] = relayPipe_[1] = -1;
+        return false;
+    }
+    relayPiped_ = 0;
+    relayEof_ = false;
+    return true;
+}
+
+//只释放本端的对接状态，pipe中的数据丢弃
+void TcpConnection::closeRelay()
+{
+    relayPeer_.reset();
+    if (relayPipe_[0] >= 0)
+    {
+        ::close(relayPipe_[0]);
+        ::close(relayPipe_[1]);
+        relayPipe_[0] = relayPipe_[1] = -1;
+    }
+    relayPiped_ = 0;
+}
+
+//解除对接，pipe中还没转发的数据读出来交给对端正常发送
+void TcpConnection::detachRelay()
+{
+    TcpConnectionPtr peer(relayPeer_);
+    if (relayPiped_ > 0)
+    {
+        //pipe最多有几百K，在堆上分配，不占回调的栈
+        const size_t chunkSize = relayPiped_ < kRelayChunk ? relayPiped_ : kRelayChunk;
+        std::unique_ptr<char[]> chunk(new char[chunkSize]);
+        while (relayPiped_ > 0)
+        {
+            ssize_t n = ::read(relayPipe_[0], chunk.get(), std::min(relayPiped_, chunkSize));
+            if (n <= 0)
+            {
+                break;
+            }
+            relayPiped_ -= n;
+            peer->sendInLoop(chunk.get(), n);
+        }
+    }
+    closeRelay();
+
+    //因为背压或者EOF停掉的读重新打开，已经EOF的连接会再读到0，走正常的关闭流程
+    if (state_ != kDisconnected && reading_ && !channel_.isReading())
+    {
+        channel_.enableReading();
+    }
+    relayEof_ = false;
+}
+
+void TcpConnection::handleRelayRead()
+{
+    ssize_t n = ::splice(channel_.fd(), nullptr, relayPipe_[1], nullptr,
+                        kRelayChunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+        relayPiped_ += n;
+    }
+    else if (n == 0)
+    {
+        relayEof_ = true;
+        channel_.disableReading();
+    }
+    else if (errno != EAGAIN)//EAGAIN说明pipe满了，relayDrain会停掉读等对端可写
+    {
+        LOG_ERROR("TcpConnection::handleRelayRead [%s] errno:%d \n", name().c_str(), errno);
+        handleClose();
+        return;
+    }
+    relayDrain();
+}
+
+/**
+ * 把本连接pipe中的数据splice给对端
+ * 对端写不下时停止读本连接，给对端注册epollout，对端可写时handleWrite再调用这里
+ * pipe清空后恢复读；如果本连接已经EOF，则关闭对端的写
+ */
+void TcpConnection::relayDrain()
+{
+    TcpConnectionPtr peer(relayPeer_);
+    //对端outputBuffer_中还有对接之前的数据，要先发完
+    if (peer->pendingOutputBytes() == 0)
+    {
+        while (relayPiped_ > 0)
+        {
+            ssize_t n = ::splice(relayPipe_[0], nullptr, peer->channel_.fd(), nullptr,
+                                relayPiped_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0)
+            {
+                relayPiped_ -= n;
+            }
+            else if (n < 0 && errno != EAGAIN)
+            {
+                LOG_ERROR("TcpConnection::relayDrain [%s] errno:%d \n", peer->name().c_str(), errno);
+                handleClose();
+                return;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    if (relayPiped_ > 0)
+    {
+        if (channel_.isReading())
+        {
+            channel_.disableReading();
+        }
+        if (!peer->channel_.isWriting())
+        {
+            peer->channel_.enableWriting();
+        }
+        return;
+    }
+
+    if (peer->channel_.isWriting() && peer->pendingOutputBytes() == 0)
+    {
+        peer->channel_.disableWriting();
+    }
+    if (!relayEof_)
+    {
+        if (reading_ && !channel_.isReading())//用户stopRead的连接不恢复
+        {
+            channel_.enableReading();
+        }
+    }
+    else
+    {
+        if (peer->state_ == kConnected)
+        {
+            //半关闭传递：本端不会再有数据了，关闭对端的写
+            peer->setState(kDisconnecting);
+            peer->shutdownInLoop();
+        }
+        //对端已经在kDisconnecting（之前传过半关闭或者用户shutdown过）时同样要检查
+        if (peer->state_ == kDisconnecting && peer->relayEof_ && peer->relayPiped_ == 0)
+        {
+            handleClose();//两个方向都结束了
+        }
+    }
+}
+
+/**
+ * SendQueue把一批跨线程的数据先追加到发送缓冲区，然后调用flushOutputInLoop，
+ * 每个连接一次write/writev把整批数据发出去
+ */
+void TcpConnection::queueOutputInLoop(const char *data, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    checkHighWaterMark(len);
+    appendOutput(data, len);
+    updateBufferAccounting();
+}
+
+void TcpConnection::queueOutputInLoop(Buffer *buf)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    size_t len = buf->readableBytes();
+    checkHighWaterMark(len);
+    if (pendingOutputBytes() == 0)
+    {
+        outputBuffer_.swap(*buf);//发送缓冲区是空的，直接交换，不拷贝
+    }
+    else
+    {
+        appendOutput(buf->peek(), len);
+    }
+    buf->retrieveAll();
+    updateBufferAccounting();
+}
+
+void TcpConnection::queuePayloadInLoop(const PayloadPtr &payload)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    checkHighWaterMark(payload->size());
+    appendPayload(payload, 0);
+    updateBufferAccounting();
+}
+
+//返回是否真的写了socket
+bool TcpConnection::flushOutputInLoop()
+{
+    //已经注册了epollout的连接，数据等handleWrite发送
+    if (state_ == kDisconnected || channel_.isWriting() || pendingOutputBytes() == 0)
+    {
+        return false;
+    }
+
+    int savedErrno = 0;
+    bool ok = true;
+    if (!outputQueue_.empty())
+    {
+        ok = flushOutputQueue(&savedErrno);
+    }
+    else
+    {
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+        if (n > 0)
+        {
+            outputBuffer_.retrieve(n);
+        }
+        ok = n >= 0 || savedErrno == EWOULDBLOCK;
+    }
+    if (!ok)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::flushOutputInLoop");
+        return true;
+    }
+    checkLowWaterMark();
+    updateBufferAccounting();
+
+    if (pendingOutputBytes() > 0)
+    {
+        channel_.enableWriting();
+    }
+    else
+    {
+        if (writeCompleteCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this())
+            );
+        }
+        if (pipeline_)
+        {
+            notifyPipelineDrained();
+        }
+        if (state_ == kDisconnecting)
+        {
+            shutdownInLoop();
+        }
+    }
+    return true;
+}
+
+/**
+ * 延迟flush：发送缓冲区积累到阈值时立即发送，否则登记到loop的延迟列表，
+ * 本轮loop结束、poll阻塞之前由SendQueue::flushDeferred统一发送
+ */
+void TcpConnection::deferFlushInLoop()
+{
+    if (channel_.isWriting())
+    {
+        return;//已经在等epollout，数据由handleWrite发送
+    }
+    if (pendingOutputBytes() >= deferredFlushThreshold_)
+    {
+        if (flushOutputInLoop())
+        {
+            loop_->sendQueue()->countDeferredFlush();
+        }
+    }
+    else if (!deferredFlushScheduled_)
+    {
+        deferredFlushScheduled_ = true;
+        loop_->sendQueue()->deferFlush(shared_from_this());
+    }
+}
+
+void TcpConnection::setDeferredFlush(bool on, size_t threshold)
+{
+    deferredFlush_ = on;
+    deferredFlushThreshold_ = threshold;
+}
+
+//关闭连接
+void TcpConnection::shutdown()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnecting);
+        loop_->runInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::shutdownInLoop()
+{
+    //没有注册epollout并且没有延迟发送的数据，说明outputBuffer中的数据已经全部发送完成
+    if (!channel_.isWriting() && pendingOutputBytes() == 0)
+    {
+        if (pipeline_)
+        {
+            //stage中可能还有等发送缓冲区写空才flush的数据（比如压缩stage的Z_SYNC_FLUSH），
+            //排在队列里的pipelineDrained会在关闭写端之后才执行，这里先让它们交下来
+            pipeline_->drained();
+            if (pendingOutputBytes() > 0)
+            {
+                return;//发送完以后handleWrite/flushOutputInLoop再回到这里
+            }
+            //还有stage在等对端的数据才能输出（比如压缩的握手），读到数据以后resumeHeldShutdown再回到这里
+            shutdownHeld_ = pipeline_->hasPendingOutput();
+            if (shutdownHeld_)
+            {
+                return;
+            }
+        }
+        Buffer alert(0);
+        if (tls_ && tls_->shutdown(&alert))
+        {
+            //先发close_notify，发送完以后handleWrite再回到这里关闭写端
+            sendInLoop(alert.peek(), alert.readableBytes());
+            if (pendingOutputBytes() > 0)
+            {
+                return;
+            }
+        }
+        socket_.shutdownWrite();//关闭写端
+    }
+}
+
+//连接建立
+void TcpConnection::connectEstablished()
+{
+    MemoryBudget::instance().addConnection(1);
+    //loop持有连接直到connectDestroyed，channel_是连接的成员，在poller中注册期间连接一定存活
+    //所以不再用channel_.tie，处理事件时不需要weak_ptr::lock
+    self_ = shared_from_this();
+    channel_.enableReading();//向poller注册channel的epollin事件
+    if (tls_)
+    {
+        //握手完成以后finishTlsHandshake再通知pipeline和用户
+        tlsHandshaking_ = true;
+        double timeout = tls_->handshakeTimeout();
+        if (timeout > 0)
+        {
+            std::weak_ptr<TcpConnection> weakConn(self_);//定时器不延长连接的生命期
+            loop_->runAfter(timeout, [weakConn]() {
+                TcpConnectionPtr conn(weakConn.lock());
+                if (conn)
+                {
+                    conn->tlsHandshakeTimeout();
+                }
+            });
+        }
+        handshakeTls();
+        return;
+    }
+    setState(kConnected);
+    if (pipeline_)
+    {
+        pipeline_->connected();
+    }
+
+    //新连接建立，执行回调
+    connectionCallback_(self_);
+}
+
+//连接销毁
+void TcpConnection::connectDestroyed()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnected);
+        channel_.disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
+        connectionCallback_(self_);
+    }
+    else if (tlsHandshaking_ && state_ != kDisconnected)
+    {
+        setState(kDisconnected);//握手还没完成，用户没见过这条连接
+        channel_.disableAll();
+    }
+    channel_.remove();//把channel从poller中删除掉
+    if (pipeline_ && !tlsHandshaking_)
+    {
+        pipeline_->disconnected();
+    }
+    loop_->bufferPool()->recycle(&inputBuffer_);//空的底层数组留给这个loop上的下一条连接
+    loop_->bufferPool()->recycle(&outputBuffer_);
+    loop_->adjustBufferBytes(-accountedBytes_);//连接的缓冲区不再计入预算
+    accountedBytes_ = 0;
+    MemoryBudget::instance().addConnection(-1);
+    if (budgetPaused_)
+    {
+        budgetPaused_ = false;
+        MemoryBudget::instance().removePaused(self_);
+    }
+    if (relayPeer_)
+    {
+        relayPeer_->closeRelay();
+        closeRelay();
+    }
+    TcpConnectionPtr self;
+    self.swap(self_);//channel已经从poller中删除，loop不再持有连接
+}
+
+void TcpConnection::handleRead(Timestamp receiveTime)
+{
+    if (relayPeer_)
+    {
+        handleRelayRead();
+        return;
+    }
+    if (tlsHandshaking_)
+    {
+        handshakeTls();
+        return;
+    }
+
+    int savedErrno = 0;
+    bool peerClosed = false;
+    ssize_t n = 0;
+    const bool kernelTls = tls_ && tls_->kernelRecv();
+    loop_->bufferPool()->fill(&inputBuffer_);
+    if (kernelTls)
+    {
+        n = readKernelTls(&peerClosed);
+    }
+    else
+    {
+        n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+        peerClosed = n == 0;
+    }
+    if (n > 0)
+    {
+        if (quickAck_)
+        {
+            socket_.setQuickAck(true);//内核会自动退回延迟确认模式
+        }
+        //已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
+        //有pipeline时数据先经过各级stage，最后一级交出来的数据才给onMessage
+        if (pipeline_)
+        {
+            pipeline_->read(&inputBuffer_, receiveTime);
+            resumeHeldShutdown();
+        }
+        else
+        {
+            messageCallback_(self_, &inputBuffer_, receiveTime);
+        }
+        checkInputWaterMark();//用户没有取走的数据决定是否越过了水位线
+        updateBufferAccounting();
+    }
+    if (peerClosed || (n < 0 && kernelTls))
+    {
+        handleClose();
+    }
+    else if (n < 0)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+    }
+}
+
+//内核解密时read遇到非数据的记录会返回EIO，改由OpenSSL按记录类型读，
+//NewSessionTicket、KeyUpdate这些握手后消息由OpenSSL处理，不当作对端关闭
+ssize_t TcpConnection::readKernelTls(bool *peerClosed)
+{
+    Buffer reply(0);
+    ssize_t n = tls_->readKernel(&inputBuffer_, &reply, peerClosed);
+    if (reply.readableBytes() > 0 && n >= 0)
+    {
+        sendInLoop(reply.peek(), reply.readableBytes());//发送方向在用户态时，KeyUpdate的回复已经加密好了
+    }
+    return n;
+}
+
+void TcpConnection::handleWrite()
+{
+    if (relayPeer_ && pendingOutputBytes() == 0)
+    {
+        relayPeer_->relayDrain();//对接的另一端pipe中还有数据等着写给本连接
+        return;
+    }
+    if (tlsHandshaking_)
+    {
+        handshakeTls();
+        return;
+    }
+
+    if (channel_.isWriting())
+    {
+        int savedErrno = 0;
+        ssize_t n = 0;
+        if (!outputQueue_.empty())
+        {
+            n = flushOutputQueue(&savedErrno) ? 1 : -1;
+        }
+        else
+        {
+            // 缓冲区的可读数据写到clientfd中
+            n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n);
+            }
+        }
+        if (n > 0)
+        {
+            checkLowWaterMark();
+            updateBufferAccounting();
+            if (pendingOutputBytes() == 0)
+            {
+                channel_.disableWriting();
+                if (writeCompleteCallback_)
+                {
+                    //唤醒loop_对应的thread线程，执行回调
+                    loop_->queueInLoop(
+                        std::bind(writeCompleteCallback_, shared_from_this())
+                    );
+                }
+                if (pipeline_)
+                {
+                    notifyPipelineDrained();
+                }
+                if (state_ == kDisconnecting)
+                {
+                    shutdownInLoop();
+                }
+                if (relayPeer_)
+                {
+                    relayPeer_->relayDrain();
+                }
+            }
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::handleWrite");
+        }
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+
+//poller => channel::closeCallback => TcpConnection::handleClose
+void TcpConnection::handleClose()
+{
+    LOG_DEBUG("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(), (int)state_);
+    if (state_ == kDisconnected)
+    {
+        return;//对接的连接可能已经被另一端一起关闭了
+    }
+    if (relayPeer_)
+    {
+        //对接中的连接一起关闭
+        TcpConnectionPtr peer(relayPeer_);
+        peer->closeRelay();
+        closeRelay();
+        peer->handleClose();
+    }
+    setState(kDisconnected);
+    channel_.disableAll();
+
+    //self_要到connectDestroyed才释放，这里直接传引用
+    if (!tlsHandshaking_)
+    {
+        connectionCallback_(self_);//有新连接或连接断开时都要执行此回调，TLS握手没完成的连接用户没见过
+    }
+    closeCallback_(self_);//关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+}
+
+void TcpConnection::handleError()
+{
+    //开启zero-copy以后，EPOLLERR大多是错误队列上的完成通知，不是真正的错误
+    bool completion = !zeroCopyPending_.empty() && handleZeroCopyCompletion();
+
+    int optval;
+    socklen_t optlen = sizeof optval;
+    int err = 0;
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        err = errno;
     }
     else
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    if (completion && err == 0)
+    {
+        return;
+    }
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
 }
@@ -5,14 +5,24 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "Payload.h"
+#include "SocketOptions.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "TlsContext.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <utility>
 
-class Channel;
 class EventLoop;
-class Socket;
+class SendQueue;
+class Pipeline;
+class TlsSession;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -22,24 +32,77 @@ class Socket;
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    static const size_t kZeroCopyThreshold = 16 * 1024;// 小于这个长度的数据拷贝发送更划算
+    static const size_t kRelayChunk = 64 * 1024;// 一次splice最多搬运的字节数
+    static const int kMaxIovecs = 64;// 发送队列一次writev最多合并的块数
+    static const size_t kDeferredFlushThreshold = 64 * 1024;// 延迟flush时积累到这么多立即发送
+    static constexpr double kIdleShrinkSeconds = 10.0;// 空闲模式下扩容过的缓冲区安静这么久以后缩回去
+
     TcpConnection(EventLoop *loop, 
                 const std::string &name, 
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr);
+    //TcpServer用的构造函数，名字和本端地址在第一次用到的时候才生成
+    //名字是namePrefix#id，namePrefix由同一个server的所有连接共享
+    TcpConnection(EventLoop *loop,
+                uint64_t id,
+                const std::shared_ptr<const std::string> &namePrefix,
+                int sockfd,
+                const InetAddress& peerAddr);
     ~TcpConnection();
 
     EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
-    const InetAddress& localAddress() const { return localAddr_; }
+    uint64_t id() const { return id_; }
+    const std::string& name() const;
+    const InetAddress& localAddress() const;
     const InetAddress& peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
-    //发送数据
-    void send(const std::string &buf);
+    //设置socket参数，失败的选项会打印错误并返回false
+    bool applySocketOptions(const SocketOptions &options);
+    //通过getsockopt读回内核实际生效的参数
+    SocketOptions effectiveSocketOptions() const;
+
+    //发送数据，在其他线程调用时数据会拷贝一份
+    //连接已经断开，或者超过了MemoryBudget并且策略是拒绝发送时返回false
+    bool send(const std::string &buf);
+    //发送数据，在其他线程调用时数据被移动到loop的发送队列，不拷贝
+    bool send(std::string &&buf);
+    bool send(Buffer &&buf);
+    //发送共享数据，只持有引用不拷贝进outputBuffer_，广播给多个连接时内存只有一份
+    //开启zero-copy时大块数据由内核直接读取
+    bool send(const PayloadPtr &payload);
     //关闭连接
     void shutdown();
+    //不等数据发送完，直接关闭连接
+    void forceClose();
+
+    //开始/停止读这条连接，在所属loop中修改channel的读事件
+    //停止读以后内核接收缓冲区写满，tcp的流量控制会让对端停止发送
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    Buffer* inputBuffer() { return &inputBuffer_; }
+    //在messageCallback之外取走了inputBuffer()的数据以后调用，检查是否降到了低水位
+    void inputConsumed();
+
+    /**
+     * 空闲模式，适合大量大部分时间没有数据的长连接
+     * 缓冲区取空就把底层数组还给loop的BufferPool，扩容过的缓冲区安静shrinkAfterSeconds秒以后缩回去
+     * 在connectEstablished之前或者loop线程中调用
+     */
+    void setIdleMode(bool on, double shrinkAfterSeconds = kIdleShrinkSeconds);
+    bool idleMode() const { return idleMode_; }
+
+    //缓冲区中的数据量，计入MemoryBudget
+    int64_t bufferedBytes() const { return accountedBytes_; }
+    //还没有写进socket的数据量，只在loop线程中使用
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes() + queuedPayloadBytes_; }
+    //MemoryBudget降到恢复线以下时调用，恢复因为预算暂停的读
+    void resumeFromBudget();
 
     void setConnectionCallback(const ConnectionCallback& cb)
     { connectionCallback_ = cb; }
@@ -53,14 +116,75 @@ public:
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
 
+    // 发送缓冲区越过高水位以后，降到lowWaterMark以下时回调
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb, size_t lowWaterMark)
+    { lowWaterMarkCallback_ = cb; lowWaterMark_ = lowWaterMark; }
+
+    // 接收缓冲区中没有被取走的数据越过高水位时回调，用来stopRead做背压
+    void setInputHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
+    { inputHighWaterMarkCallback_ = cb; inputHighWaterMark_ = highWaterMark; }
+
+    // 接收缓冲区越过高水位以后，降到lowWaterMark以下时回调，用来startRead
+    void setInputLowWaterMarkCallback(const LowWaterMarkCallback& cb, size_t lowWaterMark)
+    { inputLowWaterMarkCallback_ = cb; inputLowWaterMark_ = lowWaterMark; }
+
     void setCloseCallback(const CloseCallback& cb)
     { closeCallback_ = cb; }
 
+    /**
+     * 在socket和messageCallback之间加入stage链，收到的数据经过各级stage以后才交给messageCallback，
+     * send的数据经过各级stage以后才写进发送缓冲区，见Pipeline
+     * 在connectEstablished之前设置，TcpServer::addStage会为每条连接设置
+     */
+    void setPipeline(std::unique_ptr<Pipeline> pipeline);
+    Pipeline* pipeline() const { return pipeline_.get(); }
+
+    /**
+     * 在这条连接上做TLS，connectEstablished之前调用，TcpServer/TcpClient::setTlsContext会为每条连接调用
+     * 握手完成以后才调用connectionCallback和各级stage的onConnected，握手失败直接关闭连接
+     * kTLS生效的方向由内核加解密，其余方向在pipeline最靠近socket的位置加入用户态加解密的stage
+     * serverName是客户端的SNI和校验证书用的主机名
+     */
+    void startTls(const TlsContextPtr &ctx, const std::string &serverName = std::string());
+    TlsSession* tlsSession() const { return tls_.get(); }
+
+    //上层协议保存在连接上的数据，比如解析的状态，只在连接所属的loop线程中使用
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void>& getContext() const { return context_; }
+
+    // 开启MSG_ZEROCOPY发送，长度不小于threshold的Payload直接由内核读取用户内存
+    // 内核不支持SO_ZEROCOPY时返回false，仍然走拷贝发送
+    bool setZeroCopy(bool on, size_t threshold = kZeroCopyThreshold);
+    bool zeroCopy() const { return zeroCopy_; }
+    size_t zeroCopyInflight() const { return zeroCopyPending_.size(); }//已发送但内核还没通知完成的次数
+
+    // 延迟flush（cork）：一轮loop中多次send的数据只追加到发送缓冲区，
+    // 本轮loop结束、poll阻塞之前统一write一次，积累到threshold时提前发送
+    // 只能在连接所属的loop线程中调用，比如在connectionCallback中
+    void setDeferredFlush(bool on, size_t threshold = kDeferredFlushThreshold);
+    bool deferredFlush() const { return deferredFlush_; }
+
+    /**
+     * 把两条连接对接起来做转发（代理），每个方向用一个pipe，通过splice(2)在内核中搬运数据
+     * 对接期间数据不经过inputBuffer_/outputBuffer_，也不会调用messageCallback_
+     * 一端读到EOF并且数据转发完以后，关闭另一端的写（半关闭传递），两端都结束后关闭两条连接
+     * 两条连接必须属于同一个loop；开启了TLS或者设置了pipeline的连接拒绝对接，splice会绕过它们
+     */
+    static void startRelay(const TcpConnectionPtr &a, const TcpConnectionPtr &b);
+    // 解除对接，pipe中还没转发的数据放回对端的outputBuffer_，之后恢复正常的收发
+    void stopRelay();
+    bool relaying() const { return relayPeer_ != nullptr; }
+
     //连接建立
     void connectEstablished();
     //连接销毁
     void connectDestroyed();
 private:
+    friend class SendQueue;
+    friend class BatchReply;
+    friend class Pipeline;
+    friend class StageContext;
+
     enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
     void setState(StateE state) { state_ = state; }
 
@@ -70,18 +194,94 @@ private:
     void handleError();
 
     void sendInLoop(const void* message, size_t len);
+    //BatchReply使用：text和payloads按顺序排进发送缓冲区，最后一次flush，payloads[i].first是在text中的插入位置
+    bool sendBatch(Buffer *text, const std::vector<std::pair<size_t, PayloadPtr>> &payloads);
+    void sendPayloadInLoop(const PayloadPtr &payload);
     void shutdownInLoop();
 
+    // SendQueue使用：只追加到发送缓冲区，最后flushOutputInLoop统一发送
+    void queueOutputInLoop(const char *data, size_t len);
+    void queueOutputInLoop(Buffer *buf);
+    void queuePayloadInLoop(const PayloadPtr &payload);
+    bool flushOutputInLoop();
+    void deferFlushInLoop();
+
+    void startReadInLoop();
+    void stopReadInLoop();
+    void checkLowWaterMark();
+    void checkInputWaterMark();
+    void inputConsumedInLoop();
+    void updateBufferAccounting();
+    void recycleIdleBuffers();
+    void shrinkIdleBuffers(uint64_t ioCount);
+    void resumeFromBudgetInLoop();
+    void forceCloseInLoop();
+    void updateReading();
+
+    void sendThroughPipeline(const char *data, size_t len);
+    void sendThroughPipeline(Buffer &&buf);
+    void writePipelineInLoop(const std::shared_ptr<Buffer> &buf);
+    void redrivePipeline(size_t index);
+    void setPipelinePaused(bool paused);
+    void notifyPipelineWritable(bool writable);
+    void setPipelineWritable(bool writable);
+    void notifyPipelineDrained();
+    void pipelineDrained();
+    void resumeHeldShutdown();
+    void handshakeTls();
+    void tlsHandshakeTimeout();
+    void finishTlsHandshake();
+    ssize_t readKernelTls(bool *peerClosed);
+
+    // 发送队列：outputQueue_不为空时，outputBuffer_的数据也按顺序记录在队列里
+    // payload为空的块表示outputBuffer_中接下来的len个字节
+    struct OutputChunk
+    {
+        PayloadPtr payload;
+        size_t offset;//payload中还没发送的数据的起始位置
+        size_t len;//还没发送的长度
+    };
+    // 已经交给内核的zero-copy发送，id是这个socket上MSG_ZEROCOPY发送的序号
+    struct ZeroCopyPending
+    {
+        uint32_t id;
+        PayloadPtr payload;
+    };
+
+    bool useZeroCopy(size_t len) const { return zeroCopy_ && len >= zeroCopyThreshold_; }
+    void checkHighWaterMark(size_t len);
+    void appendOutput(const char *data, size_t len);
+    void appendPayload(const PayloadPtr &payload, size_t offset);
+    ssize_t sendZeroCopy(const PayloadPtr &payload, size_t offset, size_t len);
+    ssize_t writePayload(const PayloadPtr &payload, size_t offset, size_t len);
+    void retrieveOutputQueue(size_t n);
+    bool flushOutputQueue(int *savedErrno);
+    bool handleZeroCopyCompletion();
+
+    static void startRelayInLoop(const TcpConnectionPtr &a, const TcpConnectionPtr &b);
+    void stopRelayInLoop();
+    bool openRelayPipe();
+    void closeRelay();
+    void detachRelay();
+    void handleRelayRead();
+    void relayDrain();
+
     EventLoop *loop_;//这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
+    TcpConnectionPtr self_;//connectEstablished到connectDestroyed期间loop持有的引用，事件回调直接传它，不需要原子操作
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;//第一次调用name()时生成
     std::atomic_int state_;
     bool reading_;
 
     //这里和Acceptor类似   Acceptor=》mainLoop    TcpConenction=》subLoop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    //Socket和Channel直接放在连接对象里，一条连接只有一次内存分配
+    Socket socket_;
+    Channel channel_;
 
-    const InetAddress localAddr_;//当前主机IP地址端口号 
+    mutable std::once_flag localAddrOnce_;
+    mutable InetAddress localAddr_;//当前主机IP地址端口号，第一次调用localAddress()时getsockname 
     const InetAddress peerAddr_;//对端IP地址端口号 
 
     ConnectionCallback connectionCallback_;//有新连接时的回调
@@ -89,8 +289,48 @@ private:
     WriteCompleteCallback writeCompleteCallback_;//消息发送完成以后的回调
     HighWaterMarkCallback highWaterMarkCallback_;// 读得慢发得快，要控制发送速度，否则读缓冲区满了（高水位）
     CloseCallback closeCallback_;
+    LowWaterMarkCallback lowWaterMarkCallback_;//发送缓冲区降到低水位，通知上游恢复
+    HighWaterMarkCallback inputHighWaterMarkCallback_;//接收缓冲区越过高水位，处理不过来了
+    LowWaterMarkCallback inputLowWaterMarkCallback_;//接收缓冲区降到低水位，可以恢复读
     size_t highWaterMark_;
+    size_t lowWaterMark_;
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    bool outputAboveHighWater_;
+    bool inputAboveHighWater_;
+    int64_t accountedBytes_;//已经记到loop上的缓冲区数据量
+    bool budgetPaused_;//因为超过MemoryBudget暂停了读
+    bool pipelinePaused_;//pipeline中有stage暂停了读
+    bool shutdownHeld_;//shutdown时stage中还有没交下来的发送数据，等它们交下来再关闭写端
 
     Buffer inputBuffer_;//接收数据的缓冲区
     Buffer outputBuffer_;//发送数据的缓冲区
+    bool idleMode_;
+    double idleShrinkSeconds_;
+    bool idleShrinkScheduled_;
+    uint64_t ioCount_;//缓冲区变化的次数，用来判断安静了多久
+    bool flushScheduled_;//已经在SendQueue这一批的flush列表中
+    bool deferredFlush_;
+    size_t deferredFlushThreshold_;
+    bool deferredFlushScheduled_;//已经在SendQueue的延迟flush列表中
+
+    std::deque<OutputChunk> outputQueue_;
+    size_t queuedPayloadBytes_;//outputQueue_中payload还没发送的字节数
+
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextId_;
+    std::deque<ZeroCopyPending> zeroCopyPending_;//内核还在引用的payload
+
+    bool quickAck_;//每次读完重新设置TCP_QUICKACK
+
+    std::shared_ptr<void> context_;
+    std::unique_ptr<TlsSession> tls_;//要比pipeline_活得久，TLS的stage引用它
+    bool tlsHandshaking_;
+    std::unique_ptr<Pipeline> pipeline_;
+
+    TcpConnectionPtr relayPeer_;//对接的另一条连接，对接期间两条连接互相持有，解除对接时打破循环引用
+    int relayPipe_[2];//本连接读到的数据先splice进这个pipe，再从pipe splice给relayPeer_
+    size_t relayPiped_;//pipe中还没转发出去的字节数
+    bool relayEof_;//本连接已经读到EOF
 };
@@ -23,11 +23,15 @@ TcpServer::TcpServer(EventLoop *loop,
                 , name_(nameArg)
                 , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
                 , threadPool_(new EventLoopThreadPool(loop, name_))
-                , connectionCallback_()
-                , messageCallback_()
-                , nextConnId_(1)
+                , state_(std::make_shared<State>())
                 , started_(0)
 {
+    state_->server = this;
+    state_->loop = loop_;
+    state_->name = name_;
+    state_->connNamePrefix = std::make_shared<const std::string>(nameArg + "-" + ipPort_);
+    state_->idleMode = false;
+
     //当有新用户连接时，会执行TcpServer::newConnection回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, 
         std::placeholders::_1, std::placeholders::_2));
@@ -35,17 +39,33 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    //之后到达baseLoop的登记和删除任务看到server为空，不再访问this
+    std::unordered_map<uint64_t, TcpConnectionPtr> creating;
+    {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->server = nullptr;
+        creating.swap(state_->creating);
+    }
+    //已经在ioLoop中建立、还没有登记的连接，connectDestroyed排在connectEstablished后面
+    for (auto &item : creating)
     {
+        TcpConnectionPtr conn(item.second);
+        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    }
+    connections_.forEach([](TcpConnectionPtr &item) {
         //这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源了
-        TcpConnectionPtr conn(item.second); 
-        item.second.reset();
+        TcpConnectionPtr conn(item);
+        item.reset();
+        if (!conn)
+        {
+            return;//还在ioLoop中创建的连接，上面已经销毁或者创建时发现server为空不再建立
+        }
 
         //销毁连接
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn)
         );
-    }
+    });
 }
 
 //设置底层subloop的个数
@@ -54,6 +74,12 @@ void TcpServer::setThreadNum(int numThreads)
     threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setSocketOptions(const SocketOptions &options)
+{
+    state_->socketOptions = options;
+    acceptor_->setSocketOptions(options);
+}
+
 //开启服务器监听   loop.loop()
 void TcpServer::start()
 {
@@ -69,59 +95,98 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     //轮询算法，选择一个subLoop，来管理channel
     EventLoop *ioLoop = threadPool_->getNextLoop(); 
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-
-    //通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
-    InetAddress localAddr(local);
 
-    //根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+    //先占一个槽位拿到连接id，连接名和本端地址等到用的时候再生成
+    ConnectionMap::Id id = connections_.insert(TcpConnectionPtr());
+    //连接对象在ioLoop线程中创建，内存来自ioLoop的池，连接在同一个线程释放，不走池的跨线程释放
+    ioLoop->runInLoop(std::bind(&TcpServer::newConnectionInLoop, state_, ioLoop, id, sockfd, peerAddr));
+}
+
+void TcpServer::newConnectionInLoop(const StatePtr &state, EventLoop *ioLoop, uint64_t id,
+                                    int sockfd, const InetAddress &peerAddr)
+{
+    //连接对象、Socket、Channel和shared_ptr的控制块是一次分配
+    TcpConnectionPtr conn(std::allocate_shared<TcpConnection>(
+                            PoolAllocator<TcpConnection>(ioLoop->connectionPool()),
                             ioLoop,
-                            connName,
+                            id,
+                            state->connNamePrefix,
                             sockfd,   // Socket Channel
-                            localAddr,
                             peerAddr));
-    connections_[connName] = conn;
+    conn->applySocketOptions(state->socketOptions);
+    conn->setIdleMode(state->idleMode);
+    if (!state->stageFactories.empty())
+    {
+        std::unique_ptr<Pipeline> pipeline(new Pipeline(conn.get()));
+        for (const StageFactory &factory : state->stageFactories)
+        {
+            pipeline->addStage(factory(conn));
+        }
+        conn->setPipeline(std::move(pipeline));
+    }
+    if (state->tlsContext)
+    {
+        conn->startTls(state->tlsContext);
+    }
+
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
+        state->name.c_str(), conn->name().c_str(), peerAddr.toIpPort().c_str());
     //下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setConnectionCallback(state->connectionCallback);
+    conn->setMessageCallback(state->messageCallback);
+    conn->setWriteCompleteCallback(state->writeCompleteCallback);
 
     //设置了如何关闭连接的回调   conn->shutDown()
     conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
+        std::bind(&TcpServer::removeConnection, state, std::placeholders::_1)
     );
 
-    //直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (state->server == nullptr)
+        {
+            return;//TcpServer已经析构，连接没有建立，析构时关闭sockfd
+        }
+        state->creating[id] = conn;
+    }
+    //先在baseLoop中登记，连接关闭时的removeConnectionInLoop排在它后面
+    state->loop->runInLoop(std::bind(&TcpServer::addConnectionInLoop, state, conn));
+    conn->connectEstablished();
+}
+
+void TcpServer::addConnectionInLoop(const StatePtr &state, const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (state->creating.erase(conn->id()) == 0)
+        {
+            return;//~TcpServer已经安排了connectDestroyed
+        }
+    }
+    TcpConnectionPtr *slot = state->server->connections_.find(conn->id());
+    if (slot != nullptr)
+    {
+        *slot = conn;
+    }
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+void TcpServer::removeConnection(const StatePtr &state, const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn)
+    state->loop->runInLoop(
+        std::bind(&TcpServer::removeConnectionInLoop, state, conn)
     );
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+void TcpServer::removeConnectionInLoop(const StatePtr &state, const TcpConnectionPtr &conn)
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n", 
-        name_.c_str(), conn->name().c_str());
+    if (state->server == nullptr)
+    {
+        return;//~TcpServer已经安排了connectDestroyed
+    }
+    LOG_DEBUG("TcpServer::removeConnectionInLoop [%s] - connection %s\n", 
+        state->name.c_str(), conn->name().c_str());
 
-    connections_.erase(conn->name());
+    state->server->connections_.erase(conn->id());
     EventLoop *ioLoop = conn->getLoop(); 
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn)
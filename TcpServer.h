@@ -11,12 +11,16 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "SlotMap.h"
+#include "Pipeline.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
-#include <unordered_map>//哈希表 
+#include <vector>
+#include <mutex>
+#include <unordered_map>
 
 //我们把需要用到的头文件都包含在这里，方便用户使用 
 //对外的服务器编程使用的类
@@ -39,22 +43,70 @@ public:
     
     //用户在使用muduo库必须设置的 
     void setThreadInitcallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    void setConnectionCallback(const ConnectionCallback &cb) { state_->connectionCallback = cb; }
+    void setMessageCallback(const MessageCallback &cb) { state_->messageCallback = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { state_->writeCompleteCallback = cb; }
+
+    const std::string& ipPort() const { return ipPort_; }
+    const std::string& name() const { return name_; }
+    EventLoop* getLoop() const { return loop_; }
+    //处理连接的所有loop，start之后调用，没有工作线程时只有baseLoop
+    std::vector<EventLoop*> getAllLoops() const { return threadPool_->getAllLoops(); }
 
     //设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    //监听socket和accept得到的socket的参数，必须在start之前设置
+    void setSocketOptions(const SocketOptions &options);
+    const SocketOptions& socketOptions() const { return state_->socketOptions; }
+    //新连接都开启空闲模式，见TcpConnection::setIdleMode
+    void setIdleMode(bool on) { state_->idleMode = on; }
+    //在socket和messageCallback之间加一级stage，先加的靠近socket，必须在start之前设置
+    void addStage(const StageFactory &factory) { state_->stageFactories.push_back(factory); }
+    //所有连接都做TLS，见TcpConnection::startTls，必须在start之前设置
+    void setTlsContext(const TlsContextPtr &ctx) { state_->tlsContext = ctx; }
+
+    //监听socket上实际生效的参数
+    SocketOptions effectiveSocketOptions() const { return acceptor_->effectiveSocketOptions(); }
+
     //开启服务器监听 实际上就是开启mainloop的accptor的listen 
     void start();
 private:
+    /**
+     * 创建连接用到的参数和回调，投递到ioLoop的任务和连接的关闭回调持有它而不是TcpServer的this，
+     * 连接还在创建的途中TcpServer就析构了也不会访问已经释放的TcpServer
+     * server在析构时置空；ioLoop中创建好、还没到baseLoop登记的连接放在creating中，析构时由TcpServer销毁
+     */
+    struct State
+    {
+        std::mutex mutex;//保护server和creating，baseLoop线程中读server不用加锁
+        TcpServer *server;
+        std::unordered_map<uint64_t, TcpConnectionPtr> creating;
+        EventLoop *loop;//baseLoop
+        std::string name;
+        std::shared_ptr<const std::string> connNamePrefix;//"name-ip:port"，所有连接共享，用来生成连接名
+
+        ConnectionCallback connectionCallback;//有新连接时的回调
+        MessageCallback messageCallback;//已连接用户有读写消息时的回调 reactor调用 
+        WriteCompleteCallback writeCompleteCallback;//消息发送完成以后的回调
+
+        SocketOptions socketOptions;
+        bool idleMode;
+        std::vector<StageFactory> stageFactories;//每条连接按顺序创建pipeline的各级stage
+        TlsContextPtr tlsContext;
+    };
+    using StatePtr = std::shared_ptr<State>;
+
 	//私有的内部使用的接口 
     void newConnection(int sockfd, const InetAddress &peerAddr);//有新连接来了 
-    void removeConnection(const TcpConnectionPtr &conn);//有连接断开了，不要这条连接了 
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    static void newConnectionInLoop(const StatePtr &state, EventLoop *ioLoop, uint64_t id,
+                                    int sockfd, const InetAddress &peerAddr);
+    static void addConnectionInLoop(const StatePtr &state, const TcpConnectionPtr &conn);
+    static void removeConnection(const StatePtr &state, const TcpConnectionPtr &conn);//有连接断开了，不要这条连接了 
+    static void removeConnectionInLoop(const StatePtr &state, const TcpConnectionPtr &conn);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    //连接id就是SlotMap的id，增删不需要哈希连接名
+    using ConnectionMap = SlotMap<TcpConnectionPtr>;
 
     EventLoop *loop_;//baseLoop 用户定义的loop 一个线程一个loop循环 
 
@@ -65,14 +117,11 @@ private:
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;//线程池 one loop per thread
 
-    ConnectionCallback connectionCallback_;//有新连接时的回调
-    MessageCallback messageCallback_;//已连接用户有读写消息时的回调 reactor调用 
-    WriteCompleteCallback writeCompleteCallback_;//消息发送完成以后的回调
-
     ThreadInitCallback threadInitCallback_;//loop线程初始化的回调
 
+    const StatePtr state_;
+
     std::atomic_int started_;//标志 
 
-    int nextConnId_;
     ConnectionMap connections_;//保存所有的连接
 };
@@ -0,0 +1,157 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <strings.h>
+#include <vector>
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d timerfd_create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return timerfd;
+}
+
+//单调时钟的微秒数，不受系统时间调整影响
+static int64_t monotonicMicroSeconds()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+    , nextId_(1)
+    , callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+}
+
+TimerQueue::TimerId TimerQueue::addTimer(TimerCallback cb, double delay, double interval)
+{
+    TimerId timerId = nextId_.fetch_add(1, std::memory_order_relaxed);
+    int64_t when = monotonicMicroSeconds() + static_cast<int64_t>(delay * 1000000);
+    int64_t intervalUs = interval > 0 ? static_cast<int64_t>(interval * 1000000) : 0;
+    if (loop_->isInLoopThread())
+    {
+        addTimerInLoop(timerId, cb, when, intervalUs);
+    }
+    else
+    {
+        //cb移动进lambda，避免std::function再拷贝一次
+        std::shared_ptr<TimerCallback> callback = std::make_shared<TimerCallback>(std::move(cb));
+        loop_->queueInLoop([this, timerId, callback, when, intervalUs]() {
+            addTimerInLoop(timerId, *callback, when, intervalUs);
+        });
+    }
+    return timerId;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(TimerId timerId, TimerCallback &cb, int64_t when, int64_t interval)
+{
+    bool earliest = timers_.empty() || when < timers_.begin()->first.first;
+    timers_.emplace(Key(when, timerId), Timer{std::move(cb), interval});
+    expirations_[timerId] = when;
+    if (earliest)
+    {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    auto it = expirations_.find(timerId);
+    if (it != expirations_.end())
+    {
+        timers_.erase(Key(it->second, timerId));
+        expirations_.erase(it);
+    }
+    else if (callingExpiredTimers_)
+    {
+        cancelingTimers_.insert(timerId);//正在执行的周期定时器在自己的回调里取消
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany && errno != EAGAIN)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+
+    int64_t now = monotonicMicroSeconds();
+    std::vector<std::pair<TimerId, Timer>> expired;
+    auto end = timers_.lower_bound(Key(now + 1, 0));
+    for (auto it = timers_.begin(); it != end; ++it)
+    {
+        expirations_.erase(it->first.second);
+        expired.emplace_back(it->first.second, std::move(it->second));
+    }
+    timers_.erase(timers_.begin(), end);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (auto &item : expired)
+    {
+        item.second.callback();
+    }
+    callingExpiredTimers_ = false;
+
+    //周期定时器重新加入队列
+    for (auto &item : expired)
+    {
+        Timer &timer = item.second;
+        if (timer.interval > 0 && cancelingTimers_.find(item.first) == cancelingTimers_.end())
+        {
+            int64_t when = now + timer.interval;
+            timers_.emplace(Key(when, item.first), std::move(timer));
+            expirations_[item.first] = when;
+        }
+    }
+    resetTimerfd();
+}
+
+void TimerQueue::resetTimerfd()
+{
+    struct itimerspec newValue;
+    ::bzero(&newValue, sizeof newValue);
+    if (!timers_.empty())
+    {
+        int64_t delta = timers_.begin()->first.first - monotonicMicroSeconds();
+        if (delta < 100)
+        {
+            delta = 100;//已经到期的也要让timerfd触发一次，it_value全0表示停止定时器
+        }
+        newValue.it_value.tv_sec = static_cast<time_t>(delta / 1000000);
+        newValue.it_value.tv_nsec = static_cast<long>((delta % 1000000) * 1000);
+    }
+    if (::timerfd_settime(timerfd_, 0, &newValue, nullptr) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
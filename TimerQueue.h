@@ -0,0 +1,55 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Channel.h"
+
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <atomic>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 基于timerfd的定时器队列，定时器到期和其他fd一样通过poller通知loop
+ * 定时器按到期时间排序，timerfd只设置成最早到期的那个时间
+ * addTimer/cancel可以在任意线程调用，实际的修改都在loop线程中做
+ */
+class TimerQueue : noncopyable
+{
+public:
+    using TimerCallback = std::function<void()>;
+    using TimerId = uint64_t;
+
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    //delay秒以后执行cb，interval大于0时之后每隔interval秒执行一次
+    TimerId addTimer(TimerCallback cb, double delay, double interval);
+    void cancel(TimerId timerId);
+private:
+    struct Timer
+    {
+        TimerCallback callback;
+        int64_t interval;//微秒，0表示只执行一次
+    };
+    using Key = std::pair<int64_t, TimerId>;//到期时间(微秒，单调时钟) + id
+
+    void addTimerInLoop(TimerId timerId, TimerCallback &cb, int64_t when, int64_t interval);
+    void cancelInLoop(TimerId timerId);
+    void handleRead();//timerfd可读，执行所有到期的定时器
+    void resetTimerfd();
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    std::map<Key, Timer> timers_;
+    std::unordered_map<TimerId, int64_t> expirations_;//id => 到期时间，用来取消定时器
+    std::atomic<TimerId> nextId_;
+
+    bool callingExpiredTimers_;
+    std::set<TimerId> cancelingTimers_;//执行到期回调期间被取消的周期定时器，不再重新加入
+};
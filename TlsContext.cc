@@ -0,0 +1,167 @@
+#include "TlsContext.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <mutex>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+static void logSslErrors(const char *what)
+{
+    unsigned long err = 0;
+    while ((err = ::ERR_get_error()) != 0)
+    {
+        char errbuf[256];
+        ::ERR_error_string_n(err, errbuf, sizeof errbuf);
+        LOG_ERROR("%s: %s\n", what, errbuf);
+    }
+}
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, bool server, bool verifyPeer)
+    : ctx_(ctx)
+    , server_(server)
+    , verifyPeer_(verifyPeer)
+    , kernelTls_(false)
+    , handshakeTimeout_(kDefaultHandshakeTimeout)
+{
+    //非阻塞socket上SSL_write可能只写一部分
+    ::SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    setKernelTls(true);
+}
+
+TlsContext::~TlsContext()
+{
+    ::SSL_CTX_free(ctx_);
+}
+
+TlsContextPtr TlsContext::newServerContext(const std::string &certFile, const std::string &keyFile)
+{
+    SSL_CTX *ctx = ::SSL_CTX_new(::TLS_server_method());
+    if (ctx == nullptr)
+    {
+        logSslErrors("SSL_CTX_new");
+        return TlsContextPtr();
+    }
+    if (::SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1
+        || ::SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || ::SSL_CTX_check_private_key(ctx) != 1)
+    {
+        logSslErrors("TlsContext::newServerContext");
+        ::SSL_CTX_free(ctx);
+        return TlsContextPtr();
+    }
+    //TLS 1.3握手以后服务器发的NewSessionTicket是加密的记录，不发可以让kTLS从序号0开始
+    ::SSL_CTX_set_num_tickets(ctx, 0);
+    return TlsContextPtr(new TlsContext(ctx, true, false));
+}
+
+TlsContextPtr TlsContext::newClientContext(const std::string &caFile, bool verifyPeer)
+{
+    SSL_CTX *ctx = ::SSL_CTX_new(::TLS_client_method());
+    if (ctx == nullptr)
+    {
+        logSslErrors("SSL_CTX_new");
+        return TlsContextPtr();
+    }
+    if (verifyPeer)
+    {
+        int ok = caFile.empty() ? ::SSL_CTX_set_default_verify_paths(ctx)
+                                : ::SSL_CTX_load_verify_locations(ctx, caFile.c_str(), nullptr);
+        if (ok != 1)
+        {
+            logSslErrors("TlsContext::newClientContext");
+            ::SSL_CTX_free(ctx);
+            return TlsContextPtr();
+        }
+        ::SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    }
+    return TlsContextPtr(new TlsContext(ctx, false, verifyPeer));
+}
+
+void TlsContext::setKernelTls(bool on)
+{
+    kernelTls_ = on && kernelTlsAvailable();
+    if (kernelTls_)
+    {
+        ::SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+    else
+    {
+        ::SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+}
+
+//在一条本机的tcp连接上试一次TCP_ULP，没有加载tls模块时是ENOENT
+static bool probeKernelTls()
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int clientfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool ok = false;
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    if (listenfd >= 0 && clientfd >= 0
+        && ::bind(listenfd, (sockaddr*)&addr, sizeof addr) == 0
+        && ::listen(listenfd, 1) == 0
+        && ::getsockname(listenfd, (sockaddr*)&addr, &len) == 0
+        && ::connect(clientfd, (sockaddr*)&addr, sizeof addr) == 0)
+    {
+        ok = ::setsockopt(clientfd, SOL_TCP, TCP_ULP, "tls", sizeof "tls") == 0;
+    }
+    if (listenfd >= 0) ::close(listenfd);
+    if (clientfd >= 0) ::close(clientfd);
+    return ok;
+}
+
+bool TlsContext::kernelTlsAvailable()
+{
+    static std::once_flag once;
+    static bool available = false;
+    std::call_once(once, []() {
+        available = probeKernelTls();
+        LOG_INFO("kernel TLS %s\n", available ? "available" : "not available, using user-space TLS");
+    });
+    return available;
+}
+
+#else // MYMUDUO_HAVE_OPENSSL
+
+TlsContext::~TlsContext()
+{
+}
+
+TlsContextPtr TlsContext::newServerContext(const std::string&, const std::string&)
+{
+    LOG_ERROR("TlsContext: built without OpenSSL\n");
+    return TlsContextPtr();
+}
+
+TlsContextPtr TlsContext::newClientContext(const std::string&, bool)
+{
+    LOG_ERROR("TlsContext: built without OpenSSL\n");
+    return TlsContextPtr();
+}
+
+void TlsContext::setKernelTls(bool)
+{
+}
+
+bool TlsContext::kernelTlsAvailable()
+{
+    return false;
+}
+
+#endif // MYMUDUO_HAVE_OPENSSL
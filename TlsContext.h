@@ -0,0 +1,49 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+
+struct ssl_ctx_st;
+class TlsContext;
+
+using TlsContextPtr = std::shared_ptr<TlsContext>;
+
+/**
+ * OpenSSL的SSL_CTX，一个TcpServer/TcpClient的所有连接共享
+ * 默认开启kTLS（SSL_OP_ENABLE_KTLS），握手完成以后由内核加解密，内核或者OpenSSL不支持时退回用户态TLS
+ * 需要编译时找到OpenSSL（MYMUDUO_HAVE_OPENSSL），否则创建函数返回nullptr
+ */
+class TlsContext : noncopyable
+{
+public:
+    static constexpr double kDefaultHandshakeTimeout = 10.0;
+
+    //证书和私钥都是PEM文件，失败时打印错误并返回nullptr
+    static TlsContextPtr newServerContext(const std::string &certFile, const std::string &keyFile);
+    //caFile为空时使用系统默认的CA，verifyPeer为false时不校验服务器证书
+    static TlsContextPtr newClientContext(const std::string &caFile = std::string(), bool verifyPeer = true);
+    ~TlsContext();
+
+    bool isServer() const { return server_; }
+    bool verifyPeer() const { return verifyPeer_; }
+    //开关kTLS，在建立连接之前设置
+    void setKernelTls(bool on);
+    bool kernelTls() const { return kernelTls_; }
+    //握手超过这么多秒还没完成就关闭连接，避免握手到一半不动的对端一直占着连接，<=0时不限制
+    void setHandshakeTimeout(double seconds) { handshakeTimeout_ = seconds; }
+    double handshakeTimeout() const { return handshakeTimeout_; }
+    ssl_ctx_st* get() const { return ctx_; }
+
+    //内核是否支持TCP_ULP "tls"，进程内只探测一次
+    static bool kernelTlsAvailable();
+private:
+    TlsContext(ssl_ctx_st *ctx, bool server, bool verifyPeer);
+
+    ssl_ctx_st *ctx_;
+    const bool server_;
+    const bool verifyPeer_;
+    bool kernelTls_;
+    double handshakeTimeout_;
+};
@@ -0,0 +1,355 @@
+#include "TlsSession.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <algorithm>
+#include <errno.h>
+
+static const size_t kMaxRecordSize = 16 * 1024;// 一条TLS记录最多16K明文
+
+static void logSslErrors(const char *what, int sslError)
+{
+    unsigned long err = ::ERR_get_error();
+    if (err == 0)
+    {
+        LOG_ERROR("%s: ssl error %d errno %d\n", what, sslError, errno);
+    }
+    for (; err != 0; err = ::ERR_get_error())
+    {
+        char errbuf[256];
+        ::ERR_error_string_n(err, errbuf, sizeof errbuf);
+        LOG_ERROR("%s: %s\n", what, errbuf);
+    }
+}
+
+/**
+ * 用户态加解密，在pipeline最靠近socket的位置
+ * 入站：密文写进rbio，SSL_read解出明文交给下一级；出站：SSL_write加密以后从wbio取出密文写进连接
+ * 方向已经交给内核时这个方向原样传递
+ */
+class TlsStage : public Stage
+{
+public:
+    explicit TlsStage(TlsSession *session)
+        : session_(session)
+        , plain_(0)
+        , cipher_(0)
+    {}
+
+    void onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime) override
+    {
+        if (session_->kernelRecv())
+        {
+            ctx.fireRead(in, receiveTime);
+            return;
+        }
+        SSL *ssl = session_->ssl_;
+        BIO *rbio = ::SSL_get_rbio(ssl);
+        while (in->readableBytes() > 0)
+        {
+            int n = ::BIO_write(rbio, in->peek(), static_cast<int>(in->readableBytes()));
+            if (n <= 0)
+            {
+                break;
+            }
+            in->retrieve(n);
+        }
+
+        bool peerClosed = false;
+        for (;;)
+        {
+            plain_.ensureWriteableBytes(kMaxRecordSize);
+            int n = ::SSL_read(ssl, plain_.beginWrite(), static_cast<int>(plain_.writableBytes()));
+            if (n > 0)
+            {
+                plain_.hasWritten(n);
+                continue;
+            }
+            int err = ::SSL_get_error(ssl, n);
+            if (err == SSL_ERROR_WANT_READ)
+            {
+                break;
+            }
+            if (err == SSL_ERROR_ZERO_RETURN)
+            {
+                peerClosed = true;//对端发了close_notify
+                break;
+            }
+            logSslErrors("TlsStage::onRead", err);
+            ctx.connection()->forceClose();
+            return;
+        }
+        //KeyUpdate之类的握手后消息可能要回复
+        flushOutput(ctx);
+
+        if (plain_.readableBytes() > 0)
+        {
+            ctx.fireRead(&plain_, receiveTime);
+        }
+        if (peerClosed)
+        {
+            ctx.connection()->shutdown();
+        }
+    }
+
+    void onWrite(StageContext &ctx, Buffer *out) override
+    {
+        if (session_->kernelSend())
+        {
+            ctx.fireWrite(out);
+            return;
+        }
+        SSL *ssl = session_->ssl_;
+        while (out->readableBytes() > 0)
+        {
+            size_t len = std::min(out->readableBytes(), kMaxRecordSize);
+            int n = ::SSL_write(ssl, out->peek(), static_cast<int>(len));
+            if (n <= 0)
+            {
+                logSslErrors("TlsStage::onWrite", ::SSL_get_error(ssl, n));
+                out->retrieveAll();
+                break;
+            }
+            out->retrieve(n);
+            session_->drainOutput(&cipher_);
+        }
+        if (cipher_.readableBytes() > 0)
+        {
+            ctx.fireWrite(&cipher_);
+        }
+    }
+private:
+    void flushOutput(StageContext &ctx)
+    {
+        if (session_->kernelSend())
+        {
+            return;
+        }
+        session_->drainOutput(&cipher_);
+        if (cipher_.readableBytes() > 0)
+        {
+            ctx.fireWrite(&cipher_);
+        }
+    }
+
+    TlsSession *session_;
+    Buffer plain_;//解密出来还没被下一级取走的明文
+    Buffer cipher_;//加密好的密文，交给连接以后就取空了
+};
+
+TlsSession::TlsSession(const TlsContextPtr &ctx, int sockfd, const std::string &serverName)
+    : ctx_(ctx)
+    , ssl_(::SSL_new(ctx->get()))
+    , handshakeDone_(false)
+    , kernelSend_(false)
+    , kernelRecv_(false)
+{
+    if (ssl_ == nullptr)
+    {
+        LOG_FATAL("SSL_new failed\n");
+    }
+    //握手期间OpenSSL直接读写socket，开启kTLS时握手完成以后由OpenSSL在这个socket上设置密钥
+    ::SSL_set_fd(ssl_, sockfd);
+    if (ctx->isServer())
+    {
+        ::SSL_set_accept_state(ssl_);
+    }
+    else
+    {
+        ::SSL_set_connect_state(ssl_);
+        if (!serverName.empty())
+        {
+            ::SSL_set_tlsext_host_name(ssl_, serverName.c_str());
+            if (ctx->verifyPeer())
+            {
+                ::SSL_set1_host(ssl_, serverName.c_str());
+            }
+        }
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    ::SSL_free(ssl_);
+}
+
+TlsSession::HandshakeResult TlsSession::handshake()
+{
+    ::ERR_clear_error();
+    int ret = ::SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+        handshakeDone_ = true;
+        kernelSend_ = BIO_get_ktls_send(::SSL_get_wbio(ssl_)) > 0;
+        kernelRecv_ = BIO_get_ktls_recv(::SSL_get_rbio(ssl_)) > 0;
+        return kDone;
+    }
+    int err = ::SSL_get_error(ssl_, ret);
+    if (err == SSL_ERROR_WANT_READ)
+    {
+        return kWantRead;
+    }
+    if (err == SSL_ERROR_WANT_WRITE)
+    {
+        return kWantWrite;
+    }
+    logSslErrors("TlsSession::handshake", err);
+    return kFailed;
+}
+
+const char* TlsSession::version() const
+{
+    return ::SSL_get_version(ssl_);
+}
+
+const char* TlsSession::cipher() const
+{
+    return ::SSL_get_cipher_name(ssl_);
+}
+
+StagePtr TlsSession::userSpaceStage()
+{
+    if (kernelSend_ && kernelRecv_)
+    {
+        return StagePtr();
+    }
+    //用户态的方向不再直接读写socket，数据由连接的缓冲区经过stage交给内存BIO
+    //SSL_set_fd创建的socket BIO是BIO_NOCLOSE，换掉时不会关闭fd
+    if (!kernelRecv_)
+    {
+        ::SSL_set0_rbio(ssl_, ::BIO_new(::BIO_s_mem()));
+    }
+    if (!kernelSend_)
+    {
+        ::SSL_set0_wbio(ssl_, ::BIO_new(::BIO_s_mem()));
+    }
+    return StagePtr(new TlsStage(this));
+}
+
+ssize_t TlsSession::readKernel(Buffer *in, Buffer *out, bool *peerClosed)
+{
+    *peerClosed = false;
+    ssize_t total = 0;
+    //一次最多读这么多，和readFd一样把socket留给同一个loop上的其他连接，剩下的数据等下一次可读事件
+    //OpenSSL已经读进来但还没取走的明文不会再触发可读事件，要取完
+    while (total < static_cast<ssize_t>(kMaxRecordSize * 4) || ::SSL_pending(ssl_) > 0)
+    {
+        ::ERR_clear_error();
+        in->ensureWriteableBytes(kMaxRecordSize);
+        int n = ::SSL_read(ssl_, in->beginWrite(), static_cast<int>(in->writableBytes()));
+        if (n > 0)
+        {
+            in->hasWritten(n);
+            total += n;
+            continue;
+        }
+        int err = ::SSL_get_error(ssl_, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            break;//socket读空了，或者控制记录的回复暂时写不出去，OpenSSL下次再写
+        }
+        if (err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && errno == 0))
+        {
+            *peerClosed = true;//close_notify或者对端直接关闭了socket
+            break;
+        }
+        logSslErrors("TlsSession::readKernel", err);
+        total = -1;
+        break;
+    }
+    if (!kernelSend_)
+    {
+        drainOutput(out);
+    }
+    return total;
+}
+
+bool TlsSession::shutdown(Buffer *out)
+{
+    if (!handshakeDone_ || (::SSL_get_shutdown(ssl_) & SSL_SENT_SHUTDOWN))
+    {
+        return false;
+    }
+    ::SSL_shutdown(ssl_);//只发出close_notify，不等对端回复
+    if (kernelSend_)
+    {
+        return false;
+    }
+    drainOutput(out);
+    return out->readableBytes() > 0;
+}
+
+void TlsSession::drainOutput(Buffer *out)
+{
+    BIO *wbio = ::SSL_get_wbio(ssl_);
+    size_t pending = 0;
+    while ((pending = BIO_ctrl_pending(wbio)) > 0)
+    {
+        out->ensureWriteableBytes(pending);
+        int n = ::BIO_read(wbio, out->beginWrite(), static_cast<int>(pending));
+        if (n <= 0)
+        {
+            break;
+        }
+        out->hasWritten(n);
+    }
+}
+
+#else // MYMUDUO_HAVE_OPENSSL
+
+//没有OpenSSL时TlsContext创建不出来，TcpConnection::startTls不会创建会话
+TlsSession::TlsSession(const TlsContextPtr&, int, const std::string&)
+    : ssl_(nullptr)
+    , handshakeDone_(false)
+    , kernelSend_(false)
+    , kernelRecv_(false)
+{
+    LOG_FATAL("TlsSession: built without OpenSSL\n");
+}
+
+TlsSession::~TlsSession()
+{
+}
+
+TlsSession::HandshakeResult TlsSession::handshake()
+{
+    return kFailed;
+}
+
+const char* TlsSession::version() const
+{
+    return "";
+}
+
+const char* TlsSession::cipher() const
+{
+    return "";
+}
+
+ssize_t TlsSession::readKernel(Buffer*, Buffer*, bool *peerClosed)
+{
+    *peerClosed = true;
+    return -1;
+}
+
+StagePtr TlsSession::userSpaceStage()
+{
+    return StagePtr();
+}
+
+bool TlsSession::shutdown(Buffer*)
+{
+    return false;
+}
+
+void TlsSession::drainOutput(Buffer*)
+{
+}
+
+#endif // MYMUDUO_HAVE_OPENSSL
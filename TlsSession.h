@@ -0,0 +1,68 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TlsContext.h"
+#include "Pipeline.h"
+
+#include <string>
+#include <sys/types.h>
+
+struct ssl_st;
+class Buffer;
+
+/**
+ * 一条连接上的TLS会话，由TcpConnection持有
+ * 握手阶段OpenSSL直接在socket上收发；握手完成以后，开启了kTLS的方向由内核加解密，
+ * 连接按明文写socket，sendfile/writev/zero-copy不受影响，接收时经readKernel由OpenSSL按记录读；
+ * 没有交给内核的方向换成内存BIO，由userSpaceStage()返回的stage在pipeline最靠近socket的位置加解密
+ */
+class TlsSession : noncopyable
+{
+public:
+    enum HandshakeResult { kDone, kWantRead, kWantWrite, kFailed };
+
+    //serverName是客户端的SNI和校验证书用的主机名
+    TlsSession(const TlsContextPtr &ctx, int sockfd, const std::string &serverName = std::string());
+    ~TlsSession();
+
+    //非阻塞握手，socket可读或者可写时重复调用，直到返回kDone或者kFailed
+    HandshakeResult handshake();
+    bool handshakeDone() const { return handshakeDone_; }
+    double handshakeTimeout() const { return ctx_->handshakeTimeout(); }
+
+    //握手完成以后哪个方向由内核加解密
+    bool kernelSend() const { return kernelSend_; }
+    bool kernelRecv() const { return kernelRecv_; }
+    const char* version() const;
+    const char* cipher() const;
+
+    /**
+     * 内核解密时代替直接read socket：非数据的记录（NewSessionTicket、KeyUpdate、告警）read会返回EIO，
+     * 所以由OpenSSL用recvmsg按记录类型读，控制记录交给OpenSSL处理，明文追加到in
+     * 处理控制记录要回复的数据在用户态发送时取到out中，由调用者写进socket
+     * 返回这次读到的明文字节数，只有控制记录时为0；对端关闭时peerClosed为true；出错返回-1
+     */
+    ssize_t readKernel(Buffer *in, Buffer *out, bool *peerClosed);
+
+    //握手完成以后调用一次，两个方向都交给了内核时返回nullptr
+    StagePtr userSpaceStage();
+
+    /**
+     * 发送close_notify，只发一次
+     * 用户态发送时告警写进out，返回true，由调用者写进socket；内核发送时直接写socket，返回false
+     */
+    bool shutdown(Buffer *out);
+
+    ssl_st* get() const { return ssl_; }
+private:
+    friend class TlsStage;
+
+    //内存BIO中加密好的数据取到out中
+    void drainOutput(Buffer *out);
+
+    TlsContextPtr ctx_;//SSL_CTX要比SSL活得久
+    ssl_st *ssl_;
+    bool handshakeDone_;
+    bool kernelSend_;
+    bool kernelRecv_;
+};
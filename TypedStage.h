@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Pipeline.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "EventLoop.h"
+
+#include <functional>
+#include <utility>
+
+/**
+ * pipeline的最后一级，把字节流解码成T类型的消息交给用户，用户发送的T编码以后进入pipeline
+ * decoder在buf开头有一条完整的消息时解出来、从buf中取走并返回true，数据不够时返回false
+ * 用户在messageHandler中pause以后不再解码，剩下的数据留在上一级的Buffer中，resume以后继续
+ */
+template <typename T>
+class TypedStage : public Stage
+{
+public:
+    using Decoder = std::function<bool (const TcpConnectionPtr&, Buffer*, T*)>;
+    using Encoder = std::function<void (const T&, Buffer*)>;
+    using MessageHandler = std::function<void (const TcpConnectionPtr&, T&, Timestamp)>;
+    //出站背压：连接的发送缓冲区越过高水位时writable为false，降到低水位以下时为true
+    using WritabilityHandler = std::function<void (const TcpConnectionPtr&, bool)>;
+
+    TypedStage(const Decoder &decoder,
+                const Encoder &encoder,
+                const MessageHandler &handler,
+                const WritabilityHandler &writabilityHandler = WritabilityHandler())
+        : decoder_(decoder)
+        , encoder_(encoder)
+        , handler_(handler)
+        , writabilityHandler_(writabilityHandler)
+        , ctx_(nullptr)
+    {}
+
+    //TcpServer::addStage用的工厂，每条连接一个TypedStage
+    static StageFactory factory(const Decoder &decoder,
+                const Encoder &encoder,
+                const MessageHandler &handler,
+                const WritabilityHandler &writabilityHandler = WritabilityHandler())
+    {
+        return [=](const TcpConnectionPtr&) {
+            return StagePtr(new TypedStage(decoder, encoder, handler, writabilityHandler));
+        };
+    }
+
+    //编码以后从pipeline的用户一端发送，可以在任意线程调用
+    //查找stage要遍历pipeline，TLS握手以后会在loop线程中插入stage，所以在其他线程调用时消息拷贝一份转到loop线程，
+    //这时只要连接还没断开就返回true
+    static bool send(const TcpConnectionPtr &conn, const T &message)
+    {
+        EventLoop *loop = conn->getLoop();
+        if (!loop->isInLoopThread())
+        {
+            if (!conn->connected())
+            {
+                return false;
+            }
+            loop->queueInLoop([conn, message]() { send(conn, message); });
+            return true;
+        }
+        TypedStage *stage = of(conn);
+        if (stage == nullptr)
+        {
+            return false;
+        }
+        Buffer buf;
+        stage->encoder_(message, &buf);
+        return conn->send(std::move(buf));
+    }
+
+    //只能在连接所属的loop线程中调用
+    static void pause(const TcpConnectionPtr &conn)
+    {
+        TypedStage *stage = of(conn);
+        if (stage != nullptr && stage->ctx_ != nullptr)
+        {
+            stage->ctx_->pauseRead();
+        }
+    }
+    static void resume(const TcpConnectionPtr &conn)
+    {
+        TypedStage *stage = of(conn);
+        if (stage != nullptr && stage->ctx_ != nullptr)
+        {
+            stage->ctx_->resumeRead();
+        }
+    }
+
+    void onConnected(StageContext &ctx) override
+    {
+        ctx_ = &ctx;
+    }
+
+    void onRead(StageContext &ctx, Buffer *in, Timestamp receiveTime) override
+    {
+        while (!ctx.readPaused() && in->readableBytes() > 0)
+        {
+            T message;
+            if (!decoder_(ctx.connection(), in, &message))
+            {
+                break;
+            }
+            handler_(ctx.connection(), message, receiveTime);
+        }
+    }
+
+    void onWritabilityChanged(StageContext &ctx, bool writable) override
+    {
+        if (writabilityHandler_)
+        {
+            writabilityHandler_(ctx.connection(), writable);
+        }
+    }
+private:
+    static TypedStage* of(const TcpConnectionPtr &conn)
+    {
+        Pipeline *pipeline = conn->pipeline();
+        return pipeline != nullptr ? pipeline->find<TypedStage>() : nullptr;
+    }
+
+    Decoder decoder_;
+    Encoder encoder_;
+    MessageHandler handler_;
+    WritabilityHandler writabilityHandler_;
+    StageContext *ctx_;
+};
@@ -0,0 +1,367 @@
+#include "UdpEndpoint.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // linux 4.18
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104 // linux 5.0
+#endif
+
+const int UdpEndpoint::kMaxReadRounds;
+const int UdpEndpoint::kMaxGsoSegments;
+const size_t UdpEndpoint::kMaxGsoBytes;
+
+static int createNonblockingUdp()
+{
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static const size_t kGroControlSize = CMSG_SPACE(sizeof(int));
+static const size_t kGsoControlSize = CMSG_SPACE(sizeof(uint16_t));
+
+UdpEndpoint::UdpEndpoint(EventLoop *loop, const InetAddress &listenAddr, const UdpOptions &options)
+    : loop_(loop)
+    , options_(options)
+    , socket_(createNonblockingUdp())
+    , channel_(loop, socket_.fd())
+    , sendHead_(0)
+    , flushScheduled_(false)
+    , packetsReceived_(0)
+    , packetsSent_(0)
+    , packetsDropped_(0)
+    , recvCalls_(0)
+    , sendCalls_(0)
+{
+    if (options_.batchSize <= 0)
+    {
+        options_.batchSize = 1;
+    }
+    socket_.setReuseAddr(true);
+    if (options_.reusePort)
+    {
+        socket_.setReusePort(true);
+    }
+    if (options_.recvBuffer > 0)
+    {
+        socket_.setRecvBuffer(options_.recvBuffer);
+    }
+    if (options_.sendBuffer > 0)
+    {
+        socket_.setSendBuffer(options_.sendBuffer);
+    }
+    if (options_.gro)
+    {
+        int on = 1;
+        if (::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &on, sizeof on) < 0)
+        {
+            LOG_ERROR("UdpEndpoint setsockopt UDP_GRO fail errno:%d, gro disabled \n", errno);
+            options_.gro = false;
+        }
+        else
+        {
+            options_.maxDatagram = std::max<size_t>(options_.maxDatagram, 65536);//合并以后的数据报最大64K
+        }
+    }
+    socket_.bindAddress(listenAddr);
+
+    size_t batch = options_.batchSize;
+    recvBuffers_.resize(batch * options_.maxDatagram);
+    recvMsgs_.resize(batch);
+    recvIovecs_.resize(batch);
+    recvAddrs_.resize(batch);
+    recvControl_.resize(options_.gro ? batch * kGroControlSize : 0);
+    for (size_t i = 0; i < batch; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvBuffers_[i * options_.maxDatagram];
+        recvIovecs_[i].iov_len = options_.maxDatagram;
+    }
+
+    channel_.setReadCallback(std::bind(&UdpEndpoint::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpEndpoint::handleWrite, this));
+}
+
+//没有stop就析构时也要从poller中摘掉channel，否则poller留着悬空的Channel*
+UdpEndpoint::~UdpEndpoint()
+{
+    removeChannel();
+}
+
+void UdpEndpoint::removeChannel()
+{
+    if (!loop_->hasChannel(&channel_))
+    {
+        return;//没有start过，或者已经stop了
+    }
+    if (!channel_.isNoneEvent())
+    {
+        channel_.disableAll();
+    }
+    channel_.remove();
+}
+
+void UdpEndpoint::start()
+{
+    channel_.enableReading();
+}
+
+void UdpEndpoint::stop()
+{
+    removeChannel();
+    sendQueue_.clear();
+    sendArena_.clear();
+    sendHead_ = 0;
+}
+
+void UdpEndpoint::handleRead(Timestamp receiveTime)
+{
+    size_t batch = options_.batchSize;
+    for (int round = 0; round < kMaxReadRounds; ++round)
+    {
+        //每次recvmmsg之前重置内核会改写的长度字段
+        for (size_t i = 0; i < batch; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            ::memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = &recvAddrs_[i];
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &recvIovecs_[i];
+            hdr.msg_iovlen = 1;
+            if (options_.gro)
+            {
+                hdr.msg_control = &recvControl_[i * kGroControlSize];
+                hdr.msg_controllen = kGroControlSize;
+            }
+            recvMsgs_[i].msg_len = 0;
+        }
+
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), static_cast<unsigned int>(batch), MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpEndpoint::handleRead recvmmsg errno:%d \n", errno);
+            }
+            break;
+        }
+        add(recvCalls_, 1);
+
+        for (int i = 0; i < n; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            size_t segment = 0;//gro合并的数据报中每个原始数据报的长度
+            if (options_.gro)
+            {
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+                {
+                    if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+                    {
+                        int gsoSize;
+                        ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof gsoSize);
+                        segment = gsoSize;
+                    }
+                }
+            }
+            InetAddress peer(recvAddrs_[i]);
+            deliver(static_cast<const char*>(recvIovecs_[i].iov_base), recvMsgs_[i].msg_len, segment, peer, receiveTime);
+        }
+
+        if (n < static_cast<int>(batch))
+        {
+            break;//socket已经读空
+        }
+    }
+    //这一批接收的回调里产生的回复一次sendmmsg发出去
+    flush();
+}
+
+void UdpEndpoint::deliver(const char *data, size_t len, size_t segment, const InetAddress &peer, Timestamp receiveTime)
+{
+    if (segment == 0 || segment >= len)
+    {
+        add(packetsReceived_, 1);
+        if (datagramCallback_)
+        {
+            datagramCallback_(this, data, len, peer, receiveTime);
+        }
+        return;
+    }
+    //gro合并的数据报按原来的边界拆开，最后一个可以比segment短
+    for (size_t offset = 0; offset < len; offset += segment)
+    {
+        add(packetsReceived_, 1);
+        if (datagramCallback_)
+        {
+            datagramCallback_(this, data + offset, std::min(segment, len - offset), peer, receiveTime);
+        }
+    }
+}
+
+void UdpEndpoint::send(const char *data, size_t len, const InetAddress &peer)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(data, len, *peer.getSockAddr());
+    }
+    else
+    {
+        std::shared_ptr<std::string> copy = std::make_shared<std::string>(data, len);
+        sockaddr_in addr = *peer.getSockAddr();
+        UdpEndpointPtr self(shared_from_this());//回调执行之前endpoint不能析构
+        loop_->queueInLoop([self, copy, addr]() {
+            self->sendInLoop(copy->data(), copy->size(), addr);
+        });
+    }
+}
+
+void UdpEndpoint::sendInLoop(const char *data, size_t len, const sockaddr_in &peer)
+{
+    if (sendArena_.size() + len > options_.maxQueuedBytes)
+    {
+        add(packetsDropped_, 1);//发送太快，内核缓冲区也满了，UDP直接丢弃
+        return;
+    }
+    size_t offset = sendArena_.size();
+    sendArena_.insert(sendArena_.end(), data, data + len);
+    sendQueue_.push_back(OutPacket{offset, len, peer});
+
+    if (!flushScheduled_ && !channel_.isWriting())
+    {
+        //本轮循环中所有的send合并成一次sendmmsg
+        flushScheduled_ = true;
+        UdpEndpointPtr self(shared_from_this());
+        loop_->queueInLoop([self]() {
+            self->flushScheduled_ = false;
+            self->flush();
+        });
+    }
+}
+
+/**
+ * 从sendQueue_[first]开始填一个mmsghdr
+ * 开启gso时，发给同一个对端的等长数据报（最后一个可以更短）在sendArena_中是连续的，合并成一个iovec
+ */
+int UdpEndpoint::buildSendBatch(size_t first, size_t *consumed)
+{
+    size_t batch = options_.batchSize;
+    sendMsgs_.resize(batch);
+    sendIovecs_.resize(batch);
+    sendControl_.resize(options_.gso ? batch * kGsoControlSize : 0);
+
+    size_t index = first;
+    int nmsgs = 0;
+    while (index < sendQueue_.size() && static_cast<size_t>(nmsgs) < batch)
+    {
+        const OutPacket &head = sendQueue_[index];
+        size_t count = 1;
+        size_t bytes = head.len;
+        if (options_.gso)
+        {
+            while (index + count < sendQueue_.size() && count < static_cast<size_t>(kMaxGsoSegments))
+            {
+                const OutPacket &next = sendQueue_[index + count];
+                if (next.len > head.len || bytes + next.len > kMaxGsoBytes
+                    || next.peer.sin_port != head.peer.sin_port
+                    || next.peer.sin_addr.s_addr != head.peer.sin_addr.s_addr
+                    || sendQueue_[index + count - 1].len != head.len)
+                {
+                    break;
+                }
+                bytes += next.len;
+                ++count;
+            }
+        }
+
+        msghdr &hdr = sendMsgs_[nmsgs].msg_hdr;
+        ::memset(&hdr, 0, sizeof hdr);
+        hdr.msg_name = const_cast<sockaddr_in*>(&head.peer);
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        sendIovecs_[nmsgs].iov_base = &sendArena_[head.offset];
+        sendIovecs_[nmsgs].iov_len = bytes;
+        hdr.msg_iov = &sendIovecs_[nmsgs];
+        hdr.msg_iovlen = 1;
+        if (count > 1)
+        {
+            char *control = &sendControl_[nmsgs * kGsoControlSize];
+            ::memset(control, 0, kGsoControlSize);
+            hdr.msg_control = control;
+            hdr.msg_controllen = kGsoControlSize;
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = static_cast<uint16_t>(head.len);
+            ::memcpy(CMSG_DATA(cmsg), &segment, sizeof segment);
+        }
+        consumed[nmsgs] = count;
+        index += count;
+        ++nmsgs;
+    }
+    return nmsgs;
+}
+
+void UdpEndpoint::flush()
+{
+    std::vector<size_t> consumed(options_.batchSize);
+    while (sendHead_ < sendQueue_.size())
+    {
+        int nmsgs = buildSendBatch(sendHead_, consumed.data());
+        int n = ::sendmmsg(socket_.fd(), sendMsgs_.data(), nmsgs, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            {
+                //内核发送缓冲区满了，等可写再发
+                if (!channel_.isWriting())
+                {
+                    channel_.enableWriting();
+                }
+                return;
+            }
+            if (consumed[0] > 1 && (errno == EIO || errno == EINVAL))
+            {
+                //内核或者网卡不支持UDP_SEGMENT，关掉gso，这一批拆开逐个重发
+                LOG_ERROR("UdpEndpoint::flush UDP_SEGMENT rejected errno:%d, gso disabled \n", errno);
+                options_.gso = false;
+                continue;
+            }
+            LOG_ERROR("UdpEndpoint::flush sendmmsg errno:%d \n", errno);
+            size_t dropped = consumed[0];
+            add(packetsDropped_, dropped);//这个数据报发不出去（比如对端不可达），跳过它
+            sendHead_ += dropped;
+            continue;
+        }
+        add(sendCalls_, 1);
+        for (int i = 0; i < n; ++i)
+        {
+            add(packetsSent_, consumed[i]);
+            sendHead_ += consumed[i];
+        }
+    }
+    sendQueue_.clear();
+    sendArena_.clear();//保留容量，下一批直接复用
+    sendHead_ = 0;
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+}
+
+void UdpEndpoint::handleWrite()
+{
+    flush();
+}
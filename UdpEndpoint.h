@@ -0,0 +1,118 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+//UDP socket的参数
+struct UdpOptions
+{
+    int batchSize = 32;//一次recvmmsg/sendmmsg最多收发的数据报个数
+    size_t maxDatagram = 2048;//每个接收缓冲区的大小，开启gro时至少64K
+    bool reusePort = true;//多个loop各自bind同一个地址，由内核分流
+    bool gro = false;//UDP_GRO，内核把同一个流的多个数据报合并成一次接收
+    bool gso = false;//UDP_SEGMENT，发给同一个对端的等长数据报合并成一次发送
+    int recvBuffer = 0;//SO_RCVBUF，0表示使用系统默认值
+    int sendBuffer = 0;
+    size_t maxQueuedBytes = 4 * 1024 * 1024;//等待sendmmsg的数据超过这么多时丢弃新的数据报
+};
+
+/**
+ * 一个loop上的一个UDP socket
+ * 收：可读时循环recvmmsg，一次系统调用收一批数据报到预先分配好的缓冲区，逐个交给datagramCallback_
+ * 发：send只是把数据报排进发送队列，处理完一批接收或者本轮循环结束时一次sendmmsg发出去
+ * 除了send，其他接口都只能在loop线程中调用
+ */
+class UdpEndpoint : noncopyable, public std::enable_shared_from_this<UdpEndpoint>
+{
+public:
+    using DatagramCallback = std::function<void (UdpEndpoint*, const char *data, size_t len,
+                                                const InetAddress &peer, Timestamp receiveTime)>;
+
+    static const int kMaxReadRounds = 8;//一次可读事件最多recvmmsg的次数，避免一个socket占住loop
+    static const int kMaxGsoSegments = 64;
+    static const size_t kMaxGsoBytes = 65000;
+
+    UdpEndpoint(EventLoop *loop, const InetAddress &listenAddr, const UdpOptions &options);
+    ~UdpEndpoint();
+
+    void setDatagramCallback(const DatagramCallback &cb) { datagramCallback_ = cb; }
+
+    void start();//开始接收
+    void stop();//停止接收，丢弃没发出去的数据；没有stop就析构时析构函数会摘掉channel，但必须在loop线程中析构
+
+    //在其他线程调用时数据拷贝一份转到loop线程
+    void send(const char *data, size_t len, const InetAddress &peer);
+    void send(const std::string &data, const InetAddress &peer) { send(data.data(), data.size(), peer); }
+    //立即把发送队列中的数据报发出去
+    void flush();
+
+    EventLoop* getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+
+    uint64_t packetsReceived() const { return packetsReceived_.load(std::memory_order_relaxed); }
+    uint64_t packetsSent() const { return packetsSent_.load(std::memory_order_relaxed); }
+    uint64_t packetsDropped() const { return packetsDropped_.load(std::memory_order_relaxed); }
+    uint64_t recvCalls() const { return recvCalls_.load(std::memory_order_relaxed); }
+    uint64_t sendCalls() const { return sendCalls_.load(std::memory_order_relaxed); }
+private:
+    struct OutPacket
+    {
+        size_t offset;//在sendArena_中的位置
+        size_t len;
+        sockaddr_in peer;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void removeChannel();//从poller中摘掉channel，没有注册过时什么也不做
+    void sendInLoop(const char *data, size_t len, const sockaddr_in &peer);
+    void deliver(const char *data, size_t len, size_t segment, const InetAddress &peer, Timestamp receiveTime);
+    int buildSendBatch(size_t first, size_t *consumed);
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    EventLoop *loop_;
+    UdpOptions options_;
+    Socket socket_;
+    Channel channel_;
+    DatagramCallback datagramCallback_;
+
+    //接收用的缓冲区，构造时一次分配好，之后每次recvmmsg复用
+    std::vector<char> recvBuffers_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in> recvAddrs_;
+    std::vector<char> recvControl_;
+
+    //发送队列，数据报按顺序拷贝在sendArena_中，相邻的可以直接合并成gso的一个iovec
+    std::vector<char> sendArena_;
+    std::vector<OutPacket> sendQueue_;
+    size_t sendHead_;//sendQueue_中第一个还没发出去的数据报
+    bool flushScheduled_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<char> sendControl_;
+
+    std::atomic<uint64_t> packetsReceived_;
+    std::atomic<uint64_t> packetsSent_;
+    std::atomic<uint64_t> packetsDropped_;
+    std::atomic<uint64_t> recvCalls_;
+    std::atomic<uint64_t> sendCalls_;
+};
+
+using UdpEndpointPtr = std::shared_ptr<UdpEndpoint>;
@@ -0,0 +1,97 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <future>
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+                const UdpOptions &options)
+    : loop_(loop)
+    , listenAddr_(listenAddr)
+    , name_(nameArg)
+    , options_(options)
+    , threadPool_(new EventLoopThreadPool(loop, nameArg))
+    , started_(0)
+{
+    if (loop_ == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainLoop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+}
+
+UdpServer::~UdpServer()
+{
+    //endpoint的channel要在各自的loop线程中从poller删除，等删除完再析构线程池
+    for (const UdpEndpointPtr &endpoint : endpoints_)
+    {
+        EventLoop *loop = endpoint->getLoop();
+        if (loop->isInLoopThread())
+        {
+            endpoint->stop();
+        }
+        else
+        {
+            std::promise<void> done;
+            loop->queueInLoop([&endpoint, &done]() {
+                endpoint->stop();
+                done.set_value();
+            });
+            done.get_future().wait();
+        }
+    }
+}
+
+void UdpServer::start()
+{
+    if (started_++ != 0)
+    {
+        return;
+    }
+    threadPool_->start(threadInitCallback_);
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    //多个endpoint bind同一个地址需要SO_REUSEPORT
+    if (loops.size() > 1 && !options_.reusePort)
+    {
+        LOG_ERROR("UdpServer [%s] uses %zu loops, enabling SO_REUSEPORT \n", name_.c_str(), loops.size());
+        options_.reusePort = true;
+    }
+    for (EventLoop *ioLoop : loops)
+    {
+        UdpEndpointPtr endpoint(std::make_shared<UdpEndpoint>(ioLoop, listenAddr_, options_));
+        endpoint->setDatagramCallback(datagramCallback_);
+        endpoints_.push_back(endpoint);
+        ioLoop->runInLoop(std::bind(&UdpEndpoint::start, endpoint));
+    }
+    LOG_INFO("UdpServer [%s] listening on %s with %zu sockets \n",
+        name_.c_str(), listenAddr_.toIpPort().c_str(), endpoints_.size());
+}
+
+uint64_t UdpServer::packetsReceived() const
+{
+    uint64_t n = 0;
+    for (const UdpEndpointPtr &endpoint : endpoints_)
+    {
+        n += endpoint->packetsReceived();
+    }
+    return n;
+}
+
+uint64_t UdpServer::packetsSent() const
+{
+    uint64_t n = 0;
+    for (const UdpEndpointPtr &endpoint : endpoints_)
+    {
+        n += endpoint->packetsSent();
+    }
+    return n;
+}
+
+uint64_t UdpServer::packetsDropped() const
+{
+    uint64_t n = 0;
+    for (const UdpEndpointPtr &endpoint : endpoints_)
+    {
+        n += endpoint->packetsDropped();
+    }
+    return n;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "UdpEndpoint.h"
+#include "EventLoopThreadPool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+
+/**
+ * UDP服务器，baseLoop和每个subLoop上各有一个bind同一个地址的UdpEndpoint（SO_REUSEPORT），
+ * 内核按四元组把数据报分到不同的socket，同一个对端的数据报总是在同一个loop上处理
+ * datagramCallback_在endpoint所属的loop线程中调用，用回调参数里的endpoint回复就不用跨线程
+ */
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+                const UdpOptions &options = UdpOptions());
+    ~UdpServer();
+
+    //在start之前设置
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setDatagramCallback(const UdpEndpoint::DatagramCallback &cb) { datagramCallback_ = cb; }
+
+    void start();
+
+    const std::string& name() const { return name_; }
+    //所有endpoint的统计之和
+    uint64_t packetsReceived() const;
+    uint64_t packetsSent() const;
+    uint64_t packetsDropped() const;
+private:
+    EventLoop *loop_;
+    const InetAddress listenAddr_;
+    const std::string name_;
+    UdpOptions options_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    UdpEndpoint::DatagramCallback datagramCallback_;
+    std::atomic_int started_;
+    std::vector<UdpEndpointPtr> endpoints_;//start以后不再修改
+};
@@ -0,0 +1,124 @@
+#include "UpstreamPool.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+UpstreamPool::UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                size_t maxConnections)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , name_(name)
+    , maxConnections_(maxConnections > 0 ? maxConnections : 1)
+    , connecting_(0)
+{
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    idle_.clear();
+    std::deque<AcquireCallback> waiters;
+    waiters.swap(waiters_);
+    for (const AcquireCallback &cb : waiters)
+    {
+        cb(TcpConnectionPtr());
+    }
+    //clients_析构时关闭各自的连接，连接关闭时不能再回调到已经析构的池
+    for (const std::unique_ptr<TcpClient> &client : clients_)
+    {
+        TcpConnectionPtr conn(client->connection());
+        if (conn)
+        {
+            conn->setConnectionCallback([](const TcpConnectionPtr&) {});
+        }
+    }
+}
+
+void UpstreamPool::assertInLoopThread() const
+{
+    if (!loop_->isInLoopThread())
+    {
+        LOG_FATAL("UpstreamPool [%s] used outside its loop thread \n", name_.c_str());
+    }
+}
+
+void UpstreamPool::warmUp(size_t n)
+{
+    assertInLoopThread();
+    while (clients_.size() < std::min(n, maxConnections_))
+    {
+        addClient();
+    }
+}
+
+void UpstreamPool::acquire(AcquireCallback cb)
+{
+    assertInLoopThread();
+    while (!idle_.empty())
+    {
+        TcpConnectionPtr conn(std::move(idle_.back()));
+        idle_.pop_back();
+        if (conn->connected())
+        {
+            cb(conn);
+            return;
+        }
+    }
+    waiters_.push_back(std::move(cb));
+    //正在建立的连接不够分给等待的请求时，再新建一条
+    if (waiters_.size() > connecting_ && clients_.size() < maxConnections_)
+    {
+        addClient();
+    }
+}
+
+void UpstreamPool::release(const TcpConnectionPtr &conn)
+{
+    assertInLoopThread();
+    if (!conn || !conn->connected())
+    {
+        return;//TcpClient会重连，连上以后在onConnection中重新进入池
+    }
+    if (!waiters_.empty())
+    {
+        AcquireCallback cb(std::move(waiters_.front()));
+        waiters_.pop_front();
+        cb(conn);
+        return;
+    }
+    idle_.push_back(conn);
+}
+
+void UpstreamPool::addClient()
+{
+    char buf[32] = {0};
+    snprintf(buf, sizeof buf, "-upstream%zu", clients_.size());
+    std::unique_ptr<TcpClient> client(new TcpClient(loop_, serverAddr_, name_ + buf));
+    client->setConnectionCallback(std::bind(&UpstreamPool::onConnection, this, std::placeholders::_1));
+    client->setMessageCallback(messageCallback_);
+    client->setSocketOptions(socketOptions_);
+    client->enableRetry();
+    client->connect();
+    clients_.push_back(std::move(client));
+    ++connecting_;
+}
+
+void UpstreamPool::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        if (connecting_ > 0)
+        {
+            --connecting_;
+        }
+        release(conn);//新连接交给等待的请求或者放进空闲列表
+    }
+    else
+    {
+        //断开的连接从空闲列表中去掉，TcpClient重连期间算作正在建立的连接
+        idle_.erase(std::remove(idle_.begin(), idle_.end(), conn), idle_.end());
+        ++connecting_;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "SocketOptions.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * 一个loop到一个上游地址的长连接池，只在所属loop线程中使用，不加锁
+ * 每个loop各建一个UpstreamPool（比如在ThreadInitCallback里），
+ * 在这个loop上处理的请求只使用这个loop的上游连接，连接的读写和请求在同一个线程
+ *
+ * acquire拿到一条空闲连接独占使用，用完release放回池中；没有空闲连接时新建，
+ * 连接数达到上限时排队等待release。上游断开的连接由TcpClient按退避时间重连
+ */
+class UpstreamPool : noncopyable
+{
+public:
+    //conn为空表示拿不到连接（池已经关闭）
+    using AcquireCallback = std::function<void (const TcpConnectionPtr &conn)>;
+
+    UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                size_t maxConnections);
+    ~UpstreamPool();
+
+    //上游连接上收到数据的回调，所有连接共用，在acquire之前设置
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+
+    //预先建立n条连接
+    void warmUp(size_t n);
+
+    //有空闲连接时直接回调，否则等连接建立或者其他请求release
+    void acquire(AcquireCallback cb);
+    //用完的连接放回池中，已经断开的连接直接丢弃
+    void release(const TcpConnectionPtr &conn);
+
+    size_t idleConnections() const { return idle_.size(); }
+    size_t totalConnections() const { return clients_.size(); }
+    size_t waiters() const { return waiters_.size(); }
+private:
+    void addClient();
+    void onConnection(const TcpConnectionPtr &conn);
+    void assertInLoopThread() const;
+
+    EventLoop *loop_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+    const size_t maxConnections_;
+    MessageCallback messageCallback_;
+    SocketOptions socketOptions_;
+
+    std::vector<std::unique_ptr<TcpClient>> clients_;//每个TcpClient维护一条连接，断开以后自动重连
+    std::vector<TcpConnectionPtr> idle_;//后进先出，最近用过的连接更可能还在缓存里
+    std::deque<AcquireCallback> waiters_;
+    size_t connecting_;//还没连上的client数
+};
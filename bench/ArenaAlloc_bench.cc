@@ -0,0 +1,157 @@
+#include "Arena.h"
+#include "HttpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * 每个请求的malloc次数：
+ * 1. 解析完一个请求要做的临时分配（10个头部的列表加上拼好的响应头），堆上的vector/string和
+ *    每轮reset的Arena比较，打印每个请求的malloc次数和耗时
+ * 2. HttpServer流水线处理请求时，稳定以后平均每个请求的malloc次数（头部列表和响应头都在loop的arena上）
+ * 用glibc的__libc_malloc替换malloc来计数，operator new也经过这里
+ */
+extern "C" void* __libc_malloc(size_t size);
+
+static std::atomic<uint64_t> g_mallocs(0);
+
+extern "C" void* malloc(size_t size)
+{
+    g_mallocs.store(g_mallocs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+static const int kHeaders = 10;
+
+template <typename HeaderList, typename HeaderString>
+static size_t buildRequest(HeaderList &headers, HeaderString &response)
+{
+    for (int i = 0; i < kHeaders; ++i)
+    {
+        headers.push_back(std::make_pair(StringPiece("X-Header"), StringPiece("value")));
+    }
+    for (const auto &header : headers)
+    {
+        response.append(header.first.data(), header.first.size());
+        response.append(": ", 2);
+        response.append(header.second.data(), header.second.size());
+        response.append("\r\n", 2);
+    }
+    return response.size();
+}
+
+static void tempAllocations()
+{
+    const int kRequests = 1000000;
+    volatile size_t sink = 0;
+    using Header = std::pair<StringPiece, StringPiece>;
+
+    uint64_t before = g_mallocs.load();
+    Stopwatch watch;
+    for (int i = 0; i < kRequests; ++i)
+    {
+        std::vector<Header> headers;
+        std::string response;
+        sink = buildRequest(headers, response);
+    }
+    double heapSeconds = watch.seconds();
+    uint64_t heapMallocs = g_mallocs.load() - before;
+
+    Arena arena;
+    before = g_mallocs.load();
+    watch.reset();
+    for (int i = 0; i < kRequests; ++i)
+    {
+        ArenaVector<Header> headers{ArenaAllocator<Header>(&arena)};
+        ArenaString response{ArenaAllocator<char>(&arena)};
+        sink = buildRequest(headers, response);
+        arena.reset();
+    }
+    double arenaSeconds = watch.seconds();
+    uint64_t arenaMallocs = g_mallocs.load() - before;
+    (void)sink;
+
+    printf("temporaries, heap:  %6.2f mallocs/request  %7.1f ns/request\n",
+        static_cast<double>(heapMallocs) / kRequests, heapSeconds * 1e9 / kRequests);
+    printf("temporaries, arena: %6.2f mallocs/request  %7.1f ns/request\n",
+        static_cast<double>(arenaMallocs) / kRequests, arenaSeconds * 1e9 / kRequests);
+}
+
+static void httpServer()
+{
+    const int kBatch = 50;
+    const int kWarmupRounds = 20;
+    const int kRounds = 400;
+    EventLoop loop;
+    InetAddress addr(19431);
+    HttpServer server(&loop, addr, "arena");
+    server.setHttpCallback([](const HttpRequest &req, HttpResponse *resp) {
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setStatusMessage("OK");
+        resp->setContentType("text/plain");
+        resp->addHeader("X-Request-Path", req.path());
+        resp->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+        resp->setBody(std::string("hello"));
+    });
+    server.start();
+
+    std::string batch;
+    for (int i = 0; i < kBatch; ++i)
+    {
+        batch += "GET /some/longer/path/for/testing HTTP/1.1\r\n"
+                 "Host: localhost\r\nUser-Agent: bench\r\nAccept: */*\r\nAccept-Encoding: gzip\r\n"
+                 "X-A: 1\r\nX-B: 2\r\nX-C: 3\r\nX-D: 4\r\nX-E: 5\r\nX-F: 6\r\n\r\n";
+    }
+    int rounds = 0;
+    int received = 0;
+    uint64_t start = 0;
+    TcpClient client(&loop, addr, "client");
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->send(batch);
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        const char *found;
+        while ((found = buf->find("hello", 5)) != nullptr)
+        {
+            buf->retrieve(found + 5 - buf->peek());
+            ++received;
+        }
+        if (received < kBatch * (rounds + 1))
+        {
+            return;
+        }
+        if (++rounds == kWarmupRounds)
+        {
+            start = g_mallocs.load();
+        }
+        if (rounds < kRounds)
+        {
+            conn->send(batch);
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    client.connect();
+    loop.loop();
+    //客户端在同一个线程里，它每批的分配也算在内
+    printf("HttpServer pipelined: %6.2f mallocs/request (client included)\n",
+        static_cast<double>(g_mallocs.load() - start) / ((kRounds - kWarmupRounds) * kBatch));
+}
+
+int main()
+{
+    quietLogs();
+    tempAllocations();
+    httpServer();
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//库的日志直接写std::cout，关掉以后只输出测试结果
+inline void quietLogs()
+{
+    std::cout.setstate(std::ios::failbit);
+}
+
+//从/proc/thread-self/io或者/proc/self/status中取一个字段的数值
+inline uint64_t procField(const char *file, const char *field)
+{
+    std::ifstream in(file);
+    std::string line;
+    size_t len = strlen(field);
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, len, field) == 0)
+        {
+            return strtoull(line.c_str() + len, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+//当前线程累计的write类系统调用次数
+inline uint64_t threadWriteSyscalls() { return procField("/proc/thread-self/io", "syscw:"); }
+//当前线程累计的read类系统调用次数
+inline uint64_t threadReadSyscalls() { return procField("/proc/thread-self/io", "syscr:"); }
+
+class Stopwatch
+{
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+    void reset() { start_ = std::chrono::steady_clock::now(); }
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start_;
+};
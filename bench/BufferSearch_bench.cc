@@ -0,0 +1,75 @@
+#include "Buffer.h"
+#include "BenchCommon.h"
+
+#include <string.h>
+#include <string>
+
+/**
+ * Buffer的分隔符查找和glibc的memmem/memchr比较：
+ * 不同长度的可读数据，分隔符只出现在最后，每种长度扫描的总字节数相同，打印每秒扫描的GB数
+ */
+static const size_t kTotalBytes = 256ull << 20;
+static const char *volatile sink;
+
+static void report(const char *label, size_t size, double seconds)
+{
+    printf("  %-18s %8zu bytes  %6.2f GB/s\n", label, size, kTotalBytes / seconds / 1e9);
+}
+
+static void run(size_t size)
+{
+    //HTTP头部一样的文本，没有空行，结尾是"\r\n\r\n"
+    std::string text;
+    while (text.size() + 4 < size)
+    {
+        text += "X-Header-Name: some header value\r\n";
+    }
+    text.resize(size - 4);
+    text += "\r\n\r\n";
+    Buffer buf;
+    buf.append(text.data(), text.size());
+    //每次从volatile读一遍地址，免得编译器把memmem/memchr当作循环不变量提出循环
+    const char *volatile begin = buf.peek();
+    size_t iterations = kTotalBytes / size;
+
+    Stopwatch watch;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        sink = buf.find("\r\n\r\n", 4);
+    }
+    report("Buffer::find", size, watch.seconds());
+
+    watch.reset();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        sink = static_cast<const char*>(::memmem(begin, size, "\r\n\r\n", 4));
+    }
+    report("memmem", size, watch.seconds());
+
+    //找一个不存在于文本中的字节，扫描整个缓冲区
+    watch.reset();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        sink = buf.findAnyOf("\t\x01", 2);
+    }
+    report("Buffer::findAnyOf", size, watch.seconds());
+
+    watch.reset();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        const char *p = static_cast<const char*>(::memchr(begin, '\t', size));
+        sink = p != nullptr ? p : static_cast<const char*>(::memchr(begin, '\x01', size));
+    }
+    report("memchr x2", size, watch.seconds());
+}
+
+int main()
+{
+    printf("search implementation: %s\n", Buffer::searchImpl());
+    const size_t sizes[] = { 64, 512, 4096, 65536, 1024 * 1024 };
+    for (size_t size : sizes)
+    {
+        run(size);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "TcpServer.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "ObjectPool.h"
+#include "CurrentThread.h"
+#include "BenchCommon.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * 连接对象池：
+ * 1. 和连接一样大的对象，allocate_shared走ObjectPool和make_shared走malloc的分配+释放耗时，
+ *    分别测一次只有一个对象存活和很多对象同时存活的情形
+ * 2. 短连接反复建立、关闭时每秒的连接数，以及每个io loop的池复用了多少块
+ */
+struct ConnectionSized
+{
+    char bytes[sizeof(TcpConnection)];
+};
+
+//live个对象同时存活：先全部分配再全部释放，重复到总共kAllocations次
+//live为1时是malloc最擅长的情形，live接近kMaxCached时接近大量连接同时存在、成批断开
+static void allocationCost(size_t live)
+{
+    const size_t kAllocations = 2000000;
+    ObjectPoolPtr pool = std::make_shared<ObjectPool>(CurrentThread::tid());
+    PoolAllocator<ConnectionSized> alloc(pool);
+    std::vector<std::shared_ptr<ConnectionSized>> objects(live);
+    size_t rounds = kAllocations / live;
+
+    Stopwatch watch;
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (size_t i = 0; i < live; ++i)
+        {
+            objects[i] = std::make_shared<ConnectionSized>();
+            objects[i]->bytes[0] = static_cast<char>(i);
+        }
+        for (size_t i = 0; i < live; ++i)
+        {
+            objects[i].reset();
+        }
+    }
+    double heap = watch.seconds();
+
+    watch.reset();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (size_t i = 0; i < live; ++i)
+        {
+            objects[i] = std::allocate_shared<ConnectionSized>(alloc);
+            objects[i]->bytes[0] = static_cast<char>(i);
+        }
+        for (size_t i = 0; i < live; ++i)
+        {
+            objects[i].reset();
+        }
+    }
+    double pooled = watch.seconds();
+    size_t total = rounds * live;
+    printf("%zu-byte objects, %5zu live: make_shared %6.1f ns, allocate_shared from ObjectPool %6.1f ns\n",
+        sizeof(ConnectionSized), live, heap * 1e9 / total, pooled * 1e9 / total);
+}
+
+static void connectionChurn()
+{
+    const int kConnections = 20000;
+    EventLoop loop;
+    InetAddress addr(19351);
+    TcpServer server(&loop, addr, "churn");
+    server.setThreadNum(2);
+    std::atomic<int> closed(0);
+    server.setConnectionCallback([&closed](const TcpConnectionPtr &conn) {
+        if (!conn->connected())
+        {
+            ++closed;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    double elapsed = 0;
+    std::thread client([&]() {
+        Stopwatch watch;
+        for (int i = 0; i < kConnections; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            while (::connect(fd, addr.getSockAddrGeneric(), sizeof(sockaddr_in)) != 0)
+            {
+                ::usleep(1000);
+            }
+            ::close(fd);
+        }
+        while (closed < kConnections)
+        {
+            ::usleep(100);
+        }
+        elapsed = watch.seconds();
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+
+    printf("connection churn: %.0f connections/s\n", kConnections / elapsed);
+    for (EventLoop *ioLoop : server.getAllLoops())
+    {
+        const ObjectPoolPtr &pool = ioLoop->connectionPool();
+        printf("  io loop %p: pool reused %lu, allocated %lu, cached %zu\n",
+            static_cast<void*>(ioLoop), pool->reused(), pool->allocated(), pool->cachedBlocks());
+    }
+}
+
+int main()
+{
+    quietLogs();
+    allocationCost(1);
+    allocationCost(ObjectPool::kMaxCached);
+    connectionChurn();
+    return 0;
+}
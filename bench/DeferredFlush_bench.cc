@@ -0,0 +1,91 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "SendQueue.h"
+#include "BenchCommon.h"
+
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+/**
+ * 延迟flush（cork）的效果：每个请求服务器分kReplies次send小的回复，
+ * 比较开关setDeferredFlush时服务器loop线程每个请求的write系统调用次数和请求速率
+ */
+static const int kRounds = 20000;
+static const int kReplies = 16;
+static const size_t kReplySize = 64;
+
+static void run(bool deferred, uint16_t port)
+{
+    EventLoop loop;
+    InetAddress addr(port);
+    TcpServer server(&loop, addr, "cork");
+    std::string reply(kReplySize, 'r');
+    server.setConnectionCallback([deferred](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setDeferredFlush(deferred);
+        }
+    });
+    server.setMessageCallback([&reply](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        size_t requests = buf->readableBytes();
+        buf->retrieveAll();
+        for (size_t i = 0; i < requests * kReplies; ++i)
+        {
+            conn->send(reply);
+        }
+    });
+    server.start();
+
+    double elapsed = 0;
+    std::thread client([&]() {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        while (::connect(fd, addr.getSockAddrGeneric(), sizeof(sockaddr_in)) != 0)
+        {
+            ::usleep(1000);
+        }
+        std::vector<char> buf(kReplies * kReplySize);
+        Stopwatch watch;
+        for (int r = 0; r < kRounds; ++r)
+        {
+            //一个字节的请求，等齐这个请求的所有回复再发下一个
+            if (::write(fd, "q", 1) != 1)
+            {
+                break;
+            }
+            size_t got = 0;
+            while (got < buf.size())
+            {
+                ssize_t n = ::read(fd, buf.data(), buf.size() - got);
+                if (n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+        }
+        elapsed = watch.seconds();
+        ::close(fd);
+        loop.quit();
+    });
+
+    uint64_t writesBefore = threadWriteSyscalls();
+    loop.loop();
+    uint64_t writes = threadWriteSyscalls() - writesBefore;
+    client.join();
+    printf("deferredFlush=%d  %8.0f req/s  %6.2f server writes/req  (%d replies of %zu bytes per request)\n",
+        deferred, kRounds / elapsed, static_cast<double>(writes) / kRounds, kReplies, kReplySize);
+}
+
+int main()
+{
+    quietLogs();
+    run(false, 19301);
+    run(true, 19302);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * 连接由loop持有以后，Channel::handleEvent不再对tie的weak_ptr做lock：
+ * 1. 单独测每个事件省掉的weak_ptr::lock加上释放的耗时（两次原子操作）
+ * 2. 多条连接同时ping-pong时服务器loop每秒处理的读事件数
+ */
+static void lockCost()
+{
+    const int kIterations = 20000000;
+    std::shared_ptr<int> owner = std::make_shared<int>(1);
+    std::weak_ptr<int> tie(owner);
+    int *raw = owner.get();
+    volatile long sink = 0;
+
+    Stopwatch watch;
+    for (int i = 0; i < kIterations; ++i)
+    {
+        std::shared_ptr<int> guard(tie.lock());
+        if (guard)
+        {
+            sink += *guard;
+        }
+    }
+    double locked = watch.seconds();
+
+    watch.reset();
+    for (int i = 0; i < kIterations; ++i)
+    {
+        sink += *raw;
+    }
+    double direct = watch.seconds();
+    printf("per event: weak_ptr::lock + release %.1f ns, raw pointer %.1f ns\n",
+        locked * 1e9 / kIterations, direct * 1e9 / kIterations);
+}
+
+static void pingPong()
+{
+    const int kConnections = 64;
+    const int kRounds = 5000;
+    EventLoop loop;
+    InetAddress addr(19361);
+    TcpServer server(&loop, addr, "dispatch");
+    std::atomic<uint64_t> events(0);
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([&events](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        events.store(events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    double elapsed = 0;
+    std::thread client([&]() {
+        std::vector<int> fds;
+        for (int i = 0; i < kConnections; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            while (::connect(fd, addr.getSockAddrGeneric(), sizeof(sockaddr_in)) != 0)
+            {
+                ::usleep(1000);
+            }
+            fds.push_back(fd);
+        }
+        char byte = 'x';
+        Stopwatch watch;
+        for (int r = 0; r < kRounds; ++r)
+        {
+            //所有连接先各发一个字节，服务器一次epoll_wait拿到一批事件
+            for (int fd : fds)
+            {
+                if (::write(fd, &byte, 1) != 1)
+                {
+                    return;
+                }
+            }
+            for (int fd : fds)
+            {
+                if (::read(fd, &byte, 1) != 1)
+                {
+                    return;
+                }
+            }
+        }
+        elapsed = watch.seconds();
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+    printf("%d connections ping-pong: %.0f read events/s on the server loop\n",
+        kConnections, events.load() / elapsed);
+}
+
+int main()
+{
+    quietLogs();
+    lockCost();
+    pingPong();
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "HttpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <string>
+
+/**
+ * HttpServer的请求吞吐：客户端和服务器在同一个loop上，每次发depth个流水线请求，
+ * 收齐depth个响应再发下一批；depth=1是普通的一问一答，比较每秒处理的请求数和
+ * 服务器平均每个请求的write次数（流水线的响应合并发送）
+ */
+static const int kRequests = 200000;
+
+static const char kRequest[] =
+    "GET /some/longer/path/for/testing?x=1 HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "User-Agent: bench\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: gzip\r\n"
+    "\r\n";
+static const char kBody[] = "hello";
+
+static void run(int depth, uint16_t port)
+{
+    EventLoop loop;
+    InetAddress addr(port);
+    HttpServer server(&loop, addr, "pipeline");
+    server.setHttpCallback([](const HttpRequest &req, HttpResponse *resp) {
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setStatusMessage("OK");
+        resp->setContentType("text/plain");
+        resp->addHeader("X-Request-Path", req.path());
+        resp->setBody(std::string(kBody));
+    });
+    server.start();
+
+    std::string batch;
+    for (int i = 0; i < depth; ++i)
+    {
+        batch += kRequest;
+    }
+    int sent = 0;
+    int received = 0;
+    uint64_t writesBefore = 0;
+    Stopwatch watch;
+    TcpClient client(&loop, addr, "client");
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            writesBefore = threadWriteSyscalls();
+            watch.reset();
+            conn->send(batch);
+            sent += depth;
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        //每个响应以响应体结尾，数过的部分取走，留下可能被截断的尾巴
+        const char *found;
+        while ((found = buf->find(kBody, sizeof kBody - 1)) != nullptr)
+        {
+            buf->retrieve(found + sizeof kBody - 1 - buf->peek());
+            ++received;
+        }
+        if (received < sent)
+        {
+            return;
+        }
+        if (sent < kRequests)
+        {
+            conn->send(batch);
+            sent += depth;
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    client.connect();
+    loop.loop();
+
+    double elapsed = watch.seconds();
+    //客户端和服务器在同一个线程，write次数里一半是客户端的
+    double writes = static_cast<double>(threadWriteSyscalls() - writesBefore);
+    printf("pipeline depth %3d: %9.0f requests/s  server writes/request %.3f\n",
+        depth, received / elapsed, (writes - sent / depth) / received);
+}
+
+int main()
+{
+    quietLogs();
+    run(1, 19381);
+    run(16, 19383);
+    run(64, 19385);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "TcpServer.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * 空闲连接的内存：kConnections条连接各收发一次kMessageSize的消息以后不再有数据，
+ * 比较开关空闲模式时每条连接占用的堆内存和RSS
+ * 每种模式在单独的子进程中运行，互不影响
+ */
+static const int kConnections = 5000;
+static const size_t kMessageSize = 4096;
+
+static size_t heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static size_t rssBytes()
+{
+    return procField("/proc/self/status", "VmRSS:") * 1024;
+}
+
+static void run(bool idleMode)
+{
+    EventLoop loop;
+    InetAddress addr(idleMode ? 19372 : 19371);
+    TcpServer server(&loop, addr, "idle");
+    std::atomic<int> echoed(0);
+    server.setConnectionCallback([idleMode](const TcpConnectionPtr &conn) {
+        if (conn->connected() && idleMode)
+        {
+            conn->setIdleMode(true, 0.2);
+        }
+    });
+    server.setMessageCallback([&echoed](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        if (buf->readableBytes() >= kMessageSize)
+        {
+            conn->send(buf->retrieveAllAsString());
+            ++echoed;
+        }
+    });
+    server.start();
+
+    size_t heapBefore = heapInUse();
+    size_t rssBefore = rssBytes();
+    size_t heapAfter = 0;
+    size_t rssAfter = 0;
+    std::thread client([&]() {
+        std::vector<int> fds;
+        std::string message(kMessageSize, 'm');
+        std::vector<char> reply(kMessageSize);
+        for (int i = 0; i < kConnections; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            while (::connect(fd, addr.getSockAddrGeneric(), sizeof(sockaddr_in)) != 0)
+            {
+                ::usleep(1000);
+            }
+            if (::write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+            {
+                break;
+            }
+            size_t got = 0;
+            while (got < kMessageSize)
+            {
+                ssize_t n = ::read(fd, reply.data(), kMessageSize - got);
+                if (n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+            fds.push_back(fd);
+        }
+        //等空闲模式的缩容定时器都触发
+        ::usleep(500 * 1000);
+        loop.runInLoop([&]() {
+            heapAfter = heapInUse();
+            rssAfter = rssBytes();
+            loop.quit();
+        });
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+    });
+    loop.loop();
+    client.join();
+    printf("idleMode=%d  %d idle connections: heap %6.0f bytes/conn, RSS %6.0f bytes/conn\n",
+        idleMode, echoed.load(),
+        static_cast<double>(heapAfter - heapBefore) / kConnections,
+        static_cast<double>(rssAfter - rssBefore) / kConnections);
+}
+
+int main()
+{
+    quietLogs();
+    for (int idleMode = 0; idleMode < 2; ++idleMode)
+    {
+        pid_t pid = ::fork();
+        if (pid == 0)
+        {
+            run(idleMode != 0);
+            fflush(stdout);
+            _exit(0);
+        }
+        ::waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "LengthHeaderCodec.h"
+#include "BatchReply.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <string>
+
+/**
+ * LengthHeaderCodec的echo吞吐：客户端每次发一批kBatch个小帧，收齐回显再发下一批
+ * 服务器逐帧回调（每帧一次send）和batchCallback（一批一次writev）各跑一遍，
+ * 比较每秒回显的帧数和平均每帧的write次数
+ */
+static const int kFrames = 1000000;
+static const int kBatch = 64;
+static const size_t kFrameSize = 64;
+
+static void run(const char *label, bool batch, uint16_t port)
+{
+    EventLoop loop;
+    InetAddress addr(port);
+    TcpServer server(&loop, addr, "codec");
+    LengthHeaderCodec serverCodec([&serverCodec](const TcpConnectionPtr &conn, StringPiece frame, Timestamp) {
+        serverCodec.send(conn, frame);
+    });
+    if (batch)
+    {
+        serverCodec.setBatchCallback([](const TcpConnectionPtr&, const std::vector<StringPiece> &frames,
+                                        BatchReply *reply, Timestamp) {
+            for (const StringPiece &frame : frames)
+            {
+                reply->reply(frame);
+            }
+        });
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &serverCodec,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    server.start();
+
+    //客户端一次发出整批帧，只算一次write
+    std::string request;
+    for (int i = 0; i < kBatch; ++i)
+    {
+        Buffer frame;
+        std::string body(kFrameSize, 'f');
+        frame.append(body.data(), body.size());
+        frame.prependInt32(static_cast<int32_t>(body.size()));
+        request.append(frame.peek(), frame.readableBytes());
+    }
+    int sent = 0;
+    int received = 0;
+    uint64_t writesBefore = 0;
+    Stopwatch watch;
+    TcpClient client(&loop, addr, "client");
+    LengthHeaderCodec clientCodec([&](const TcpConnectionPtr &conn, StringPiece, Timestamp) {
+        if (++received < sent)
+        {
+            return;
+        }
+        if (sent < kFrames)
+        {
+            conn->send(request);
+            sent += kBatch;
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            writesBefore = threadWriteSyscalls();
+            watch.reset();
+            conn->send(request);
+            sent += kBatch;
+        }
+    });
+    client.setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &clientCodec,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    client.connect();
+    loop.loop();
+
+    double elapsed = watch.seconds();
+    //客户端和服务器在同一个线程，减掉客户端每批一次的write
+    double writes = static_cast<double>(threadWriteSyscalls() - writesBefore) - sent / kBatch;
+    printf("%-18s %9.0f frames/s  server writes/frame %.3f\n", label, received / elapsed, writes / received);
+}
+
+int main()
+{
+    quietLogs();
+    run("frame callback", false, 19401);
+    run("batch callback", true, 19403);
+    return 0;
+}
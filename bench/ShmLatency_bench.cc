@@ -0,0 +1,151 @@
+#include "ShmConnection.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "BenchCommon.h"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+/**
+ * 两个loop线程之间的ping-pong往返延迟：共享内存连接、TCP回环、AF_UNIX各跑一遍，
+ * 两端都在自己的loop上收发，比较的是整条路径（唤醒+收发+回调）的开销；
+ * 共享内存另外打印每条消息的eventfd通知次数
+ */
+static const int kRounds = 100000;
+static const size_t kMessageSize = 64;
+
+static void report(const char *label, double seconds)
+{
+    printf("%-18s rtt %6.2f us\n", label, seconds * 1e6 / kRounds);
+}
+
+static void shm()
+{
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) != 0)
+    {
+        return;
+    }
+    EventLoopThread peerThread;
+    EventLoop *peerLoop = peerThread.startLoop();
+    EventLoop loop;
+    ShmConnectionPtr conn = ShmConnection::create(&loop, "client", sv[0]);
+    std::promise<ShmConnectionPtr> accepted;
+    peerLoop->runInLoop([&]() {
+        ShmConnectionPtr peer = ShmConnection::accept(peerLoop, "server", sv[1]);
+        if (peer)
+        {
+            peer->setFrameCallback([](const ShmConnectionPtr &c, StringPiece frame, Timestamp) {
+                c->send(frame.data(), frame.size());
+            });
+            peer->start();
+        }
+        accepted.set_value(peer);
+    });
+    ShmConnectionPtr peer = accepted.get_future().get();
+    if (!conn || !peer)
+    {
+        printf("shared memory      unavailable\n");
+        return;
+    }
+
+    std::string message(kMessageSize, 's');
+    int rounds = 0;
+    Stopwatch watch;
+    conn->setFrameCallback([&](const ShmConnectionPtr &c, StringPiece, Timestamp) {
+        if (++rounds < kRounds)
+        {
+            c->send(message);
+        }
+        else
+        {
+            c->shutdown();
+        }
+    });
+    conn->setConnectionCallback([&](const ShmConnectionPtr &c) {
+        if (c->connected())
+        {
+            watch.reset();
+            c->send(message);
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    conn->start();
+    loop.loop();
+    report("shared memory", watch.seconds());
+    printf("%-18s notifications/message %.3f\n", "", static_cast<double>(conn->notifications()) / kRounds);
+}
+
+static void stream(const char *label, const InetAddress &addr)
+{
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::promise<void> started;
+    std::unique_ptr<TcpServer> server;
+    serverLoop->runInLoop([&]() {
+        server.reset(new TcpServer(serverLoop, addr, "latency"));
+        server->setConnectionCallback([](const TcpConnectionPtr&) {});
+        server->setMessageCallback([](const TcpConnectionPtr &c, Buffer *buf, Timestamp) {
+            c->send(buf->retrieveAllAsString());
+        });
+        server->start();
+        started.set_value();
+    });
+    started.get_future().wait();
+
+    EventLoop loop;
+    std::string message(kMessageSize, 't');
+    int rounds = 0;
+    Stopwatch watch;
+    TcpClient client(&loop, addr, "client");
+    client.setConnectionCallback([&](const TcpConnectionPtr &c) {
+        if (c->connected())
+        {
+            watch.reset();
+            c->send(message);
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr &c, Buffer *buf, Timestamp) {
+        if (buf->readableBytes() < kMessageSize)
+        {
+            return;
+        }
+        buf->retrieve(kMessageSize);
+        if (++rounds < kRounds)
+        {
+            c->send(message);
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    client.connect();
+    loop.loop();
+    report(label, watch.seconds());
+
+    client.disconnect();
+    //TcpServer要在自己的loop线程中析构
+    std::promise<void> stopped;
+    serverLoop->runInLoop([&]() {
+        server.reset();
+        stopped.set_value();
+    });
+    stopped.get_future().wait();
+}
+
+int main()
+{
+    quietLogs();
+    shm();
+    stream("TCP 127.0.0.1", InetAddress(19421));
+    stream("AF_UNIX abstract", InetAddress::fromUnixPath("mymuduo-shmbench", true));
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "TlsContext.h"
+#include "TlsSession.h"
+#include "BenchCommon.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#endif
+
+/**
+ * TLS的单向吞吐：客户端每发完一块再发下一块（writeCompleteCallback驱动），服务器只计数
+ * 明文、用户态TLS、kTLS（内核支持时）各跑一遍，打印MB/s
+ * 证书是启动时生成的自签名P-256证书，放在临时目录里，客户端不校验
+ */
+static const size_t kTotalBytes = 256 * 1024 * 1024;
+static const size_t kChunkSize = 64 * 1024;
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+//在dir下生成cert.pem和key.pem，失败时返回false
+static bool makeCertificate(const std::string &dir)
+{
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    bool ok = key != nullptr && cert != nullptr;
+    if (ok)
+    {
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+            reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        ok = X509_sign(cert, key, EVP_sha256()) > 0;
+    }
+    if (ok)
+    {
+        FILE *certFile = ::fopen((dir + "/cert.pem").c_str(), "w");
+        FILE *keyFile = ::fopen((dir + "/key.pem").c_str(), "w");
+        ok = certFile != nullptr && keyFile != nullptr
+            && PEM_write_X509(certFile, cert) == 1
+            && PEM_write_PrivateKey(keyFile, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+        if (certFile != nullptr)
+        {
+            ::fclose(certFile);
+        }
+        if (keyFile != nullptr)
+        {
+            ::fclose(keyFile);
+        }
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+#endif
+
+static void run(const char *label, const TlsContextPtr &serverCtx, const TlsContextPtr &clientCtx, uint16_t port)
+{
+    EventLoop loop;
+    InetAddress addr(port);
+    TcpServer server(&loop, addr, "tlsbench");
+    if (serverCtx)
+    {
+        server.setTlsContext(serverCtx);
+    }
+    size_t received = 0;
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([&](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        received += buf->readableBytes();
+        buf->retrieveAll();
+        if (received >= kTotalBytes)
+        {
+            loop.quit();
+        }
+    });
+    server.start();
+
+    std::string chunk(kChunkSize, 't');
+    size_t sent = 0;
+    bool kernel = false;
+    Stopwatch watch;
+    TcpClient client(&loop, addr, "client");
+    if (clientCtx)
+    {
+        client.setTlsContext(clientCtx, "localhost");
+    }
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            kernel = conn->tlsSession() != nullptr && conn->tlsSession()->kernelSend();
+            watch.reset();
+            conn->send(chunk);
+            sent += chunk.size();
+        }
+    });
+    client.setWriteCompleteCallback([&](const TcpConnectionPtr &conn) {
+        if (sent < kTotalBytes)
+        {
+            conn->send(chunk);
+            sent += chunk.size();
+        }
+    });
+    client.connect();
+    loop.loop();
+
+    double elapsed = watch.seconds();
+    printf("%-16s %8.1f MB/s%s\n", label, received / elapsed / (1024 * 1024),
+        clientCtx && !kernel ? "  (user-space TLS)" : "");
+}
+
+int main()
+{
+    quietLogs();
+    ::signal(SIGPIPE, SIG_IGN);
+    run("plaintext", TlsContextPtr(), TlsContextPtr(), 19411);
+#ifdef MYMUDUO_HAVE_OPENSSL
+    char dir[] = "/tmp/mymuduo-tlsbench-XXXXXX";
+    if (::mkdtemp(dir) == nullptr || !makeCertificate(dir))
+    {
+        printf("failed to generate a certificate\n");
+        return 1;
+    }
+    std::string certFile = std::string(dir) + "/cert.pem";
+    std::string keyFile = std::string(dir) + "/key.pem";
+
+    TlsContextPtr serverCtx = TlsContext::newServerContext(certFile, keyFile);
+    TlsContextPtr clientCtx = TlsContext::newClientContext(std::string(), false);
+    serverCtx->setKernelTls(false);
+    clientCtx->setKernelTls(false);
+    run("TLS user-space", serverCtx, clientCtx, 19413);
+
+    if (TlsContext::kernelTlsAvailable())
+    {
+        serverCtx = TlsContext::newServerContext(certFile, keyFile);
+        clientCtx = TlsContext::newClientContext(std::string(), false);
+        run("kTLS", serverCtx, clientCtx, 19415);
+    }
+    else
+    {
+        printf("kTLS             not available on this kernel\n");
+    }
+
+    ::unlink(certFile.c_str());
+    ::unlink(keyFile.c_str());
+    ::rmdir(dir);
+#else
+    printf("built without OpenSSL, TLS skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "UdpEndpoint.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * UDP批量收发：同一个loop上一个端点发、一个端点收，比较
+ * 每次一个数据报（batchSize=1）、sendmmsg/recvmmsg批量、再加上GSO/GRO时
+ * 每秒收到的数据报数，以及平均每个数据报的系统调用次数
+ */
+static const int kDatagrams = 200000;
+static const int kBurst = 64;//每轮循环发这么多个，避免淹没接收缓冲区
+static const size_t kDatagramSize = 1200;
+
+static void run(const char *label, int batchSize, bool gso, bool gro, uint16_t port)
+{
+    EventLoop loop;
+    UdpOptions options;
+    options.batchSize = batchSize;
+    options.gso = gso;
+    options.gro = gro;
+    options.maxDatagram = gro ? 65536 : 2048;
+    options.recvBuffer = 4 * 1024 * 1024;
+    options.sendBuffer = 4 * 1024 * 1024;
+    InetAddress receiverAddr(port, "127.0.0.1");
+    UdpEndpointPtr receiver(new UdpEndpoint(&loop, receiverAddr, options));
+    UdpEndpointPtr sender(new UdpEndpoint(&loop, InetAddress(port + 1, "127.0.0.1"), options));
+
+    long received = 0;
+    receiver->setDatagramCallback([&received](UdpEndpoint*, const char*, size_t, const InetAddress&, Timestamp) {
+        ++received;
+    });
+    receiver->start();
+    sender->start();
+
+    std::string payload(kDatagramSize, 'u');
+    int sent = 0;
+    std::function<void()> pump = [&]() {
+        for (int i = 0; i < kBurst && sent < kDatagrams; ++i, ++sent)
+        {
+            sender->send(payload, receiverAddr);
+        }
+        if (sent < kDatagrams)
+        {
+            loop.queueInLoop(pump);
+        }
+        else
+        {
+            loop.runAfter(0.2, [&loop]() { loop.quit(); });//等最后几批收完
+        }
+    };
+
+    Stopwatch watch;
+    loop.runAfter(0, pump);//loop()之前queueInLoop不会唤醒，第一次poll要等到超时
+    loop.loop();
+    double elapsed = watch.seconds() - 0.2;
+    printf("%-22s %9.0f datagrams/s  loss %5.2f%%  sends/datagram %.3f  recvs/datagram %.3f\n",
+        label, received / elapsed, 100.0 * (kDatagrams - received) / kDatagrams,
+        static_cast<double>(sender->sendCalls()) / kDatagrams,
+        received > 0 ? static_cast<double>(receiver->recvCalls()) / received : 0.0);
+    receiver->stop();
+    sender->stop();
+}
+
+int main()
+{
+    quietLogs();
+    run("one per syscall", 1, false, false, 19391);
+    run("sendmmsg/recvmmsg", 32, false, false, 19393);
+    run("batched + GSO", 32, true, false, 19395);
+    run("batched + GSO + GRO", 32, true, true, 19397);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "BenchCommon.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+/**
+ * 同一台机器上的echo服务器，TCP回环和AF_UNIX（abstract namespace）各跑一遍：
+ * 客户端阻塞地发一条消息等回显，统计往返延迟的平均值、中位数和p99
+ */
+static const int kRounds = 50000;
+static const size_t kMessageSize = 64;
+
+static void pingPong(const char *label, const InetAddress &addr)
+{
+    EventLoop loop;
+    TcpServer server(&loop, addr, "unixbench");
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    std::vector<double> rtts;
+    rtts.reserve(kRounds);
+    std::thread client([&]() {
+        int fd = ::socket(addr.family(), SOCK_STREAM, 0);
+        while (::connect(fd, addr.getSockAddrGeneric(), addr.getSockLen()) != 0)
+        {
+            ::usleep(1000);
+        }
+        if (!addr.isUnix())
+        {
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        }
+        char message[kMessageSize];
+        ::memset(message, 'p', sizeof message);
+        for (int r = 0; r < kRounds; ++r)
+        {
+            Stopwatch watch;
+            if (::write(fd, message, sizeof message) != static_cast<ssize_t>(sizeof message))
+            {
+                break;
+            }
+            size_t got = 0;
+            while (got < sizeof message)
+            {
+                ssize_t n = ::read(fd, message + got, sizeof message - got);
+                if (n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+            rtts.push_back(watch.seconds() * 1e6);
+        }
+        ::close(fd);
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+
+    std::sort(rtts.begin(), rtts.end());
+    double sum = 0;
+    for (double rtt : rtts)
+    {
+        sum += rtt;
+    }
+    printf("%-24s rtt avg %6.2f us  p50 %6.2f us  p99 %6.2f us\n", label,
+        sum / rtts.size(), rtts[rtts.size() / 2], rtts[rtts.size() * 99 / 100]);
+}
+
+int main()
+{
+    quietLogs();
+    pingPong("TCP 127.0.0.1", InetAddress(19371));
+    pingPong("AF_UNIX abstract", InetAddress::fromUnixPath("mymuduo-unixbench", true));
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "Arena.h"
+#include "TestCommon.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+//对齐和计数；reset以后从第一块的开头重新分配，不再向malloc要块
+static void testReset()
+{
+    Arena arena(4096);
+    char *first = static_cast<char*>(arena.allocate(10, 1));
+    CHECK(arena.used() == 10);
+    void *aligned = arena.allocate(24, 16);
+    CHECK(reinterpret_cast<uintptr_t>(aligned) % 16 == 0);
+    CHECK(arena.used() >= 34);
+    CHECK(arena.stats().blockAllocations == 1);
+
+    for (int round = 0; round < 100; ++round)
+    {
+        arena.reset();
+        CHECK(arena.used() == 0);
+        CHECK(arena.allocate(10, 1) == first);
+        for (int i = 0; i < 100; ++i)
+        {
+            arena.allocate(8);
+        }
+    }
+    arena.reset();
+    ArenaStats stats = arena.stats();
+    CHECK(stats.blockAllocations == 1);
+    CHECK(stats.reserved == 4096);
+    CHECK(stats.resets == 101);
+    CHECK(stats.allocations == 2 + 100 * 101);
+    CHECK(stats.highWater >= 100 * 8);
+
+    //这一轮什么都没分配，reset直接返回
+    arena.reset();
+    CHECK(arena.stats().resets == 101);
+}
+
+//create的对象在reset时按构造的逆序析构，析构函数里再从arena创建的对象也会被析构
+struct Tracked
+{
+    Tracked(std::vector<int> *log, int id, Arena *arena = nullptr) : log_(log), id_(id), arena_(arena) {}
+    ~Tracked()
+    {
+        log_->push_back(id_);
+        if (arena_ != nullptr)
+        {
+            arena_->create<Tracked>(log_, id_ * 10);
+        }
+    }
+    std::vector<int> *log_;
+    int id_;
+    Arena *arena_;
+};
+
+static void testCleanup()
+{
+    std::vector<int> log;
+    Arena arena;
+    arena.create<Tracked>(&log, 1);
+    arena.create<Tracked>(&log, 2, &arena);
+    arena.create<Tracked>(&log, 3);
+    int *plain = arena.create<int>(42);
+    CHECK(*plain == 42);
+    CHECK(log.empty());
+
+    arena.reset();
+    CHECK(log.size() == 4);
+    CHECK(log[0] == 3 && log[1] == 2 && log[2] == 1 && log[3] == 20);
+
+    //已经析构的对象不会在下一次reset时再析构一遍
+    arena.allocate(1);
+    arena.reset();
+    CHECK(log.size() == 4);
+}
+
+//超过blockSize/4的分配单独一块，reset时释放；块数超过kMaxRetainedBlocks的部分也还给malloc
+static void testRetainedBlocks()
+{
+    const size_t kBlock = 4096;
+    Arena arena(kBlock);
+    void *large = arena.allocate(kBlock * 2);
+    CHECK(large != nullptr);
+    CHECK(arena.stats().reserved >= kBlock * 2);
+    arena.reset();
+    CHECK(arena.stats().reserved == 0);
+
+    //每次分配将近四分之一块（不算大分配），一共用掉kMaxRetainedBlocks + 2块
+    for (size_t i = 0; i < 4 * (Arena::kMaxRetainedBlocks + 2); ++i)
+    {
+        arena.allocate(kBlock / 4 - 64);
+    }
+    CHECK(arena.stats().reserved > Arena::kMaxRetainedBlocks * kBlock);
+    arena.reset();
+    CHECK(arena.stats().reserved == Arena::kMaxRetainedBlocks * kBlock);
+    uint64_t blocks = arena.stats().blockAllocations;
+
+    //留下的块够用时不再向malloc要
+    for (size_t i = 0; i < Arena::kMaxRetainedBlocks * 3; ++i)
+    {
+        arena.allocate(kBlock / 4 - 64);
+    }
+    arena.reset();
+    CHECK(arena.stats().blockAllocations == blocks);
+}
+
+//promote以后的对象和字符串在reset以后仍然有效，容器的arena为空时从堆分配
+static void testPromote()
+{
+    Arena arena;
+    std::unique_ptr<std::string> kept;
+    std::string copied;
+    {
+        std::string *temp = arena.create<std::string>(100, 'p');
+        kept = arena.promote(temp);
+        StringPiece piece = arena.copy("arena string");
+        CHECK(piece == "arena string");
+        CHECK(piece.data()[piece.size()] == '\0');
+        copied = Arena::promote(piece);
+    }
+    arena.reset();
+    CHECK(*kept == std::string(100, 'p'));
+    CHECK(copied == "arena string");
+
+    size_t before = arena.used();
+    ArenaVector<int> onArena{ArenaAllocator<int>(&arena)};
+    onArena.assign(100, 7);
+    CHECK(arena.used() >= before + 100 * sizeof(int));
+
+    before = arena.used();
+    ArenaVector<int> onHeap;
+    onHeap.assign(100, 7);
+    CHECK(arena.used() == before);
+    CHECK(onHeap.get_allocator().arena() == nullptr);
+
+    //移动赋值时分配器跟着换，不会继续用旧arena的内存
+    onArena = ArenaVector<int>();
+    CHECK(onArena.get_allocator().arena() == nullptr);
+    arena.reset();
+}
+
+//长度为0的分配不换块，返回的指针不为空
+static void testZeroSize()
+{
+    Arena arena(4096);
+    CHECK(arena.allocate(0) != nullptr);
+    arena.allocate(100);
+    for (int i = 0; i < 1000; ++i)
+    {
+        CHECK(arena.allocate(0) != nullptr);
+    }
+    CHECK(arena.stats().blockAllocations == 1);
+    CHECK(arena.used() <= 100 + alignof(max_align_t));//只有对齐的填充
+    arena.reset();
+}
+
+int main()
+{
+    quietLogs();
+    testReset();
+    testCleanup();
+    testRetainedBlocks();
+    testPromote();
+    testZeroSize();
+    printf("Arena_unittest passed\n");
+    return 0;
+}
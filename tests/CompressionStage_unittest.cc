@@ -0,0 +1,98 @@
+#include "CompressionStage.h"
+#include "TcpClient.h"
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "TestCommon.h"
+
+#include <string>
+
+static std::string randomBytes(size_t len)
+{
+    std::string data(len, '\0');
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < len; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = static_cast<char>(seed >> 16);
+    }
+    return data;
+}
+
+/**
+ * 服务端send以后马上shutdown：先发一大段压缩不了的数据让发送缓冲区积压，
+ * 再发一条小消息，它的Z_SYNC_FLUSH按flushOnDrain要等发送缓冲区写空，
+ * shutdown不能在这之前关闭写端；客户端解压出来的数据要和发送的完全一样
+ * afterHello为false时服务端在连接建立时就发送，数据缓存在stage中等握手，shutdown也要等它
+ */
+static void testShutdownFlushes(uint16_t port, bool afterHello)
+{
+    const std::string large = randomBytes(8 * 1024 * 1024);
+    const std::string tail(1000, 't');
+    auto sendAndShutdown = [&](const TcpConnectionPtr &conn) {
+        conn->send(large);
+        conn->send(tail);
+        conn->shutdown();
+    };
+
+    EventLoop loop;
+    InetAddress addr(port);
+    TcpServer server(&loop, addr, "server");
+    server.addStage(CompressionStage::factory());
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected() && !afterHello)
+        {
+            sendAndShutdown(conn);
+        }
+    });
+    //客户端的请求到了说明握手已经完成
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+        if (afterHello)
+        {
+            sendAndShutdown(conn);
+        }
+    });
+    server.start();
+
+    std::string received;
+    bool closed = false;
+    TcpClient client(&loop, addr, "client");
+    client.addStage(CompressionStage::factory());
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->send("go");
+        }
+        else
+        {
+            closed = true;
+            loop.quit();
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        received.append(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+    });
+    client.connect();
+    loop.runAfter(10, [&loop]() {
+        fprintf(stderr, "timeout\n");
+        loop.quit();
+    });
+    loop.loop();
+
+    CHECK(closed);
+    CHECK(received.size() == large.size() + tail.size());
+    CHECK(received == large + tail);
+}
+
+int main()
+{
+    quietLogs();
+    testShutdownFlushes(19512, true);
+    testShutdownFlushes(19513, false);
+#ifdef MYMUDUO_HAVE_ZLIB
+    CHECK(CompressionStage::totalStats().compressedBytesIn > 0);
+#endif
+    printf("CompressionStage_unittest passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+#include "Arena.h"
+#include "TestCommon.h"
+
+#include <string.h>
+#include <string>
+
+static void append(Buffer *buf, const std::string &data)
+{
+    buf->append(data.data(), data.size());
+}
+
+//请求行、查询串、头部（名字忽略大小写、去掉两端空白）、keep-alive
+static void testSimpleGet()
+{
+    HttpContext context;
+    Buffer buf;
+    append(&buf, "GET /index.html?a=1&b=2 HTTP/1.1\r\nHost: example.com\r\nX-Padded:  \tvalue \t\r\n\r\n");
+    CHECK(context.parse(&buf, Timestamp::now()) == HttpContext::kGotRequest);
+    const HttpRequest &req = context.request();
+    CHECK(req.method() == "GET");
+    CHECK(req.path() == "/index.html");
+    CHECK(req.query() == "a=1&b=2");
+    CHECK(req.version() == HttpRequest::kHttp11);
+    CHECK(req.headers().size() == 2);
+    CHECK(req.getHeader("host") == "example.com");
+    CHECK(req.getHeader("x-padded") == "value");
+    CHECK(req.getHeader("Missing").empty());
+    CHECK(req.body().empty());
+    CHECK(req.keepAlive());
+
+    context.consume(&buf);
+    CHECK(buf.readableBytes() == 0);
+}
+
+//一次收到两个流水线请求，第二个带请求体，逐个解析逐个取走
+static void testPipelined()
+{
+    HttpContext context;
+    Buffer buf;
+    append(&buf, "GET /a HTTP/1.0\r\n\r\n"
+                 "POST /b HTTP/1.1\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello"
+                 "GET /c");
+    CHECK(context.parse(&buf, Timestamp::now()) == HttpContext::kGotRequest);
+    CHECK(context.request().path() == "/a");
+    CHECK(context.request().version() == HttpRequest::kHttp10);
+    CHECK(!context.request().keepAlive());
+    context.consume(&buf);
+
+    CHECK(context.parse(&buf, Timestamp::now()) == HttpContext::kGotRequest);
+    CHECK(context.request().method() == "POST");
+    CHECK(context.request().body() == "hello");
+    CHECK(!context.request().keepAlive());
+    context.consume(&buf);
+
+    CHECK(context.parse(&buf, Timestamp::now()) == HttpContext::kNeedMore);
+    CHECK(buf.readableBytes() == strlen("GET /c"));
+}
+
+//数据一个字节一个字节地到，"\r\n\r\n"跨在两次数据之间，请求体最后才收全
+static void testIncremental()
+{
+    const std::string request = "PUT /upload HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc";
+    HttpContext context;
+    Buffer buf;
+    for (size_t i = 0; i < request.size(); ++i)
+    {
+        buf.append(&request[i], 1);
+        HttpContext::ParseResult result = context.parse(&buf, Timestamp::now());
+        if (i + 1 < request.size())
+        {
+            CHECK(result == HttpContext::kNeedMore);
+        }
+        else
+        {
+            CHECK(result == HttpContext::kGotRequest);
+        }
+    }
+    CHECK(context.request().method() == "PUT");
+    CHECK(context.request().body() == "abc");
+}
+
+static HttpContext::ParseResult parseOnce(const std::string &data)
+{
+    HttpContext context;
+    Buffer buf;
+    append(&buf, data);
+    return context.parse(&buf, Timestamp::now());
+}
+
+static void testErrors()
+{
+    CHECK(parseOnce("GET /\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce("GET / HTTP/2.0\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce(" / HTTP/1.1\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce("GET / HTTP/1.1\r\nNoColon\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce("GET / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce("GET / HTTP/1.1\r\nContent-Length: -1\r\n\r\n") == HttpContext::kBadRequest);
+    CHECK(parseOnce("POST / HTTP/1.1\r\nContent-Length: 999999999\r\n\r\n") == HttpContext::kBodyTooLarge);
+    CHECK(parseOnce("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") == HttpContext::kNotImplemented);
+
+    //头部一直没结束，超过kMaxHeaderSize
+    std::string huge = "GET / HTTP/1.1\r\nX-Long: ";
+    huge.append(HttpContext::kMaxHeaderSize, 'x');
+    CHECK(parseOnce(huge) == HttpContext::kHeaderTooLarge);
+}
+
+//给了arena时头部列表从arena分配，reset以后下一个请求换新的列表
+static void testArena()
+{
+    Arena arena;
+    HttpContext context(&arena);
+    Buffer buf;
+    for (int i = 0; i < 3; ++i)
+    {
+        append(&buf, "GET /x HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\n\r\n");
+        CHECK(context.parse(&buf, Timestamp::now()) == HttpContext::kGotRequest);
+        CHECK(context.request().headers().get_allocator().arena() == &arena);
+        CHECK(context.request().headers().size() == 3);
+        CHECK(context.request().getHeader("c") == "3");
+        context.consume(&buf);
+        arena.reset();
+    }
+}
+
+int main()
+{
+    quietLogs();
+    testSimpleGet();
+    testPipelined();
+    testIncremental();
+    testErrors();
+    testArena();
+    printf("HttpContext_unittest passed\n");
+    return 0;
+}
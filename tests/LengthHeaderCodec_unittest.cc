@@ -0,0 +1,154 @@
+#include "LengthHeaderCodec.h"
+#include "BatchReply.h"
+#include "TestCommon.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//不经过连接，直接把字节喂给onMessage；回调里用不到连接，传空的TcpConnectionPtr
+
+//按send的格式组帧：消息体写进Buffer，长度头prepend在前面
+static void appendFrame(Buffer *wire, const std::string &message)
+{
+    Buffer frame;
+    frame.append(message.data(), message.size());
+    frame.prependInt32(static_cast<int32_t>(message.size()));
+    CHECK(frame.readableBytes() == LengthHeaderCodec::kHeaderLen + message.size());
+    wire->append(frame.peek(), frame.readableBytes());
+}
+
+//一次到达多个帧（包括空帧），逐个回调，取走以后Buffer为空
+static void testFrames()
+{
+    std::vector<std::string> got;
+    LengthHeaderCodec codec([&got](const TcpConnectionPtr&, StringPiece frame, Timestamp) {
+        got.push_back(frame.toString());
+    });
+    Buffer wire;
+    appendFrame(&wire, "hello");
+    appendFrame(&wire, "");
+    appendFrame(&wire, std::string(100000, 'z'));
+    codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    CHECK(got.size() == 3);
+    CHECK(got[0] == "hello");
+    CHECK(got[1].empty());
+    CHECK(got[2] == std::string(100000, 'z'));
+    CHECK(wire.readableBytes() == 0);
+}
+
+//帧一个字节一个字节地到，收全之前不回调，长度头收到以后为整个帧预留空间
+static void testPartial()
+{
+    std::vector<std::string> got;
+    LengthHeaderCodec codec([&got](const TcpConnectionPtr&, StringPiece frame, Timestamp) {
+        got.push_back(frame.toString());
+    });
+    Buffer wire;
+    appendFrame(&wire, "first");
+    appendFrame(&wire, "second");
+    std::string bytes = wire.retrieveAllAsString();
+
+    Buffer in;
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        in.append(&bytes[i], 1);
+        codec.onMessage(TcpConnectionPtr(), &in, Timestamp::now());
+        if (in.readableBytes() >= LengthHeaderCodec::kHeaderLen)
+        {
+            CHECK(in.readableBytes() + in.writableBytes() >= LengthHeaderCodec::kHeaderLen + static_cast<uint32_t>(in.peekInt32()));
+        }
+    }
+    CHECK(got.size() == 2);
+    CHECK(got[0] == "first");
+    CHECK(got[1] == "second");
+    CHECK(in.readableBytes() == 0);
+}
+
+//只收到一个很大的长度头时最多预留kMaxReserveSize，数据到了再扩容
+static void testReserveCap()
+{
+    std::string got;
+    LengthHeaderCodec codec([&got](const TcpConnectionPtr&, StringPiece frame, Timestamp) {
+        got = frame.toString();
+    });
+    const size_t kLarge = 4 * 1024 * 1024;
+    Buffer wire;
+    wire.appendInt32(static_cast<int32_t>(kLarge));
+    codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    CHECK(wire.readableBytes() == LengthHeaderCodec::kHeaderLen);
+    CHECK(wire.writableBytes() <= 2 * LengthHeaderCodec::kMaxReserveSize);
+
+    std::string body(kLarge, 'r');
+    for (size_t offset = 0; offset < body.size(); offset += 100000)
+    {
+        size_t n = std::min<size_t>(100000, body.size() - offset);
+        wire.append(body.data() + offset, n);
+        codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    }
+    CHECK(got == body);
+    CHECK(wire.readableBytes() == 0);
+}
+
+//长度头超过maxFrameSize时回调errorCallback，丢掉剩下的数据
+static void testTooLarge()
+{
+    int frames = 0;
+    size_t badLength = 0;
+    LengthHeaderCodec codec([&frames](const TcpConnectionPtr&, StringPiece, Timestamp) { ++frames; }, 16);
+    codec.setErrorCallback([&badLength](const TcpConnectionPtr&, size_t len) { badLength = len; });
+    Buffer wire;
+    appendFrame(&wire, "ok");
+    appendFrame(&wire, std::string(17, 'x'));
+    appendFrame(&wire, "never");
+    codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    CHECK(frames == 1);
+    CHECK(badLength == 17);
+    CHECK(wire.readableBytes() == 0);
+}
+
+//batchCallback一次拿到所有完整的帧，不完整的尾巴留在Buffer中
+static void testBatch()
+{
+    std::vector<std::vector<std::string>> batches;
+    LengthHeaderCodec codec([](const TcpConnectionPtr&, StringPiece, Timestamp) { CHECK(false); });
+    codec.setBatchCallback([&batches](const TcpConnectionPtr&, const std::vector<StringPiece> &frames,
+                                      BatchReply*, Timestamp) {
+        std::vector<std::string> batch;
+        for (const StringPiece &frame : frames)
+        {
+            batch.push_back(frame.toString());
+        }
+        batches.push_back(batch);
+    });
+    Buffer wire;
+    appendFrame(&wire, "a");
+    appendFrame(&wire, "bb");
+    appendFrame(&wire, "ccc");
+    Buffer tail;
+    appendFrame(&tail, "dddd");
+    wire.append(tail.peek(), 3);
+    codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    CHECK(batches.size() == 1);
+    CHECK(batches[0].size() == 3);
+    CHECK(batches[0][0] == "a" && batches[0][1] == "bb" && batches[0][2] == "ccc");
+    CHECK(wire.readableBytes() == 3);
+
+    wire.append(tail.peek() + 3, tail.readableBytes() - 3);
+    codec.onMessage(TcpConnectionPtr(), &wire, Timestamp::now());
+    CHECK(batches.size() == 2);
+    CHECK(batches[1].size() == 1 && batches[1][0] == "dddd");
+    CHECK(wire.readableBytes() == 0);
+}
+
+int main()
+{
+    quietLogs();
+    testFrames();
+    testPartial();
+    testReserveCap();
+    testTooLarge();
+    testBatch();
+    printf("LengthHeaderCodec_unittest passed\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "ObjectPool.h"
+#include "CurrentThread.h"
+#include "TestCommon.h"
+
+#include <thread>
+#include <vector>
+#include <memory>
+
+struct Object
+{
+    explicit Object(int v) : value(v) {}
+    int value;
+    char padding[200];
+};
+
+//所属线程释放的块放回空闲链表，下一次分配直接复用
+static void testLocalReuse()
+{
+    ObjectPool pool(CurrentThread::tid());
+    void *a = pool.allocate(64);
+    CHECK(pool.blockSize() == 64);
+    CHECK(pool.allocated() == 1);
+    pool.deallocate(a, 64);
+    CHECK(pool.cachedBlocks() == 1);
+    void *b = pool.allocate(64);
+    CHECK(b == a);
+    CHECK(pool.reused() == 1);
+    CHECK(pool.cachedBlocks() == 0);
+
+    //其他大小直接用operator new，不进空闲链表
+    void *other = pool.allocate(128);
+    pool.deallocate(other, 128);
+    CHECK(pool.cachedBlocks() == 0);
+    pool.deallocate(b, 64);
+}
+
+//其他线程释放的块先挂在无锁栈上，所属线程空闲链表用完时一次收回
+static void testRemoteFree()
+{
+    ObjectPool pool(CurrentThread::tid());
+    const int kBlocks = 1000;
+    std::vector<void*> blocks;
+    for (int i = 0; i < kBlocks; ++i)
+    {
+        blocks.push_back(pool.allocate(48));
+    }
+    std::thread freer([&]() {
+        for (void *p : blocks)
+        {
+            pool.deallocate(p, 48);
+        }
+    });
+    freer.join();
+    CHECK(pool.cachedBlocks() == 0);
+
+    for (int i = 0; i < kBlocks; ++i)
+    {
+        blocks[i] = pool.allocate(48);
+    }
+    CHECK(pool.reused() == static_cast<uint64_t>(kBlocks));
+    CHECK(pool.allocated() == static_cast<uint64_t>(kBlocks));
+    for (void *p : blocks)
+    {
+        pool.deallocate(p, 48);
+    }
+    CHECK(pool.cachedBlocks() == static_cast<size_t>(kBlocks));
+}
+
+//不在所属线程分配时不碰空闲链表
+static void testForeignAllocate()
+{
+    ObjectPool pool(CurrentThread::tid());
+    pool.deallocate(pool.allocate(32), 32);
+    CHECK(pool.cachedBlocks() == 1);
+    void *p = nullptr;
+    std::thread other([&]() { p = pool.allocate(32); });
+    other.join();
+    CHECK(p != nullptr);
+    CHECK(pool.cachedBlocks() == 1);
+    CHECK(pool.reused() == 0);
+    pool.deallocate(p, 32);
+    CHECK(pool.cachedBlocks() == 2);
+}
+
+//空闲链表最多缓存kMaxCached块
+static void testCacheLimit()
+{
+    ObjectPool pool(CurrentThread::tid());
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < ObjectPool::kMaxCached + 10; ++i)
+    {
+        blocks.push_back(pool.allocate(16));
+    }
+    for (void *p : blocks)
+    {
+        pool.deallocate(p, 16);
+    }
+    CHECK(pool.cachedBlocks() == ObjectPool::kMaxCached);
+}
+
+//allocate_shared的对象和控制块在同一块内存，释放以后复用
+static void testAllocateShared()
+{
+    ObjectPoolPtr pool = std::make_shared<ObjectPool>(CurrentThread::tid());
+    std::shared_ptr<Object> first = std::allocate_shared<Object>(PoolAllocator<Object>(pool), 1);
+    Object *address = first.get();
+    first.reset();
+    CHECK(pool->cachedBlocks() == 1);
+    std::shared_ptr<Object> second = std::allocate_shared<Object>(PoolAllocator<Object>(pool), 2);
+    CHECK(second.get() == address);
+    CHECK(second->value == 2);
+    CHECK(pool->reused() == 1);
+
+    //对象比持有池的代码活得久：allocator中的引用让池一直有效
+    std::weak_ptr<ObjectPool> weakPool(pool);
+    pool.reset();
+    CHECK(!weakPool.expired());
+    second.reset();
+    CHECK(weakPool.expired());
+}
+
+int main()
+{
+    testLocalReuse();
+    testRemoteFree();
+    testForeignAllocate();
+    testCacheLimit();
+    testAllocateShared();
+    printf("ObjectPool_unittest passed\n");
+    return 0;
+}
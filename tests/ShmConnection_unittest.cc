@@ -0,0 +1,112 @@
+#include "ShmConnection.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TestCommon.h"
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * 两个loop线程之间的共享内存连接，环只有64KB：
+ * 一条跨好几段的大消息加上大量长短不一的小消息，环反复写满、绕回，
+ * 对端原样回显，收到的消息边界和顺序都要和发送的一样；最后shutdown，两端都断开
+ */
+static const size_t kRingSize = 64 * 1024;
+static const int kMessages = 20000;
+
+int main()
+{
+    quietLogs();
+    int sv[2];
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == 0);
+
+    EventLoopThread peerThread;
+    EventLoop *peerLoop = peerThread.startLoop();
+    EventLoop loop;
+    ShmConnectionPtr conn = ShmConnection::create(&loop, "client", sv[0], kRingSize);
+    CHECK(conn);
+    CHECK(conn->maxChunkSize() == kRingSize / 4);
+
+    //对端在自己的loop线程中accept，逐条回显
+    std::atomic<bool> peerClosed(false);
+    std::promise<ShmConnectionPtr> accepted;
+    peerLoop->runInLoop([&]() {
+        ShmConnectionPtr peer = ShmConnection::accept(peerLoop, "server", sv[1]);
+        if (peer)
+        {
+            peer->setConnectionCallback([&peerClosed](const ShmConnectionPtr &c) {
+                if (!c->connected())
+                {
+                    peerClosed = true;
+                }
+            });
+            peer->setFrameCallback([](const ShmConnectionPtr &c, StringPiece frame, Timestamp) {
+                c->send(frame.data(), frame.size());
+            });
+            peer->start();
+        }
+        accepted.set_value(peer);
+    });
+    ShmConnectionPtr peer = accepted.get_future().get();
+    CHECK(peer);
+
+    std::vector<std::string> sent;
+    sent.push_back(std::string(3 * conn->maxChunkSize() + 123, 'H'));
+    for (int i = 0; i < kMessages; ++i)
+    {
+        sent.push_back("message " + std::to_string(i) + std::string(i % 300, 'z'));
+    }
+    sent.push_back(std::string());
+
+    size_t received = 0;
+    bool closed = false;
+    conn->setFrameCallback([&](const ShmConnectionPtr &c, StringPiece frame, Timestamp) {
+        CHECK(received < sent.size());
+        CHECK(frame == sent[received]);
+        if (++received == sent.size())
+        {
+            c->shutdown();
+        }
+    });
+    conn->setConnectionCallback([&](const ShmConnectionPtr &c) {
+        if (c->connected())
+        {
+            for (const std::string &message : sent)
+            {
+                CHECK(c->send(message));
+            }
+        }
+        else
+        {
+            closed = true;
+            loop.quit();
+        }
+    });
+    conn->start();
+    loop.runAfter(10, [&loop]() {
+        fprintf(stderr, "timeout\n");
+        loop.quit();
+    });
+    loop.loop();
+
+    CHECK(closed);
+    CHECK(received == sent.size());
+    CHECK(conn->messagesSent() == sent.size());
+    CHECK(conn->messagesReceived() == sent.size());
+    CHECK(conn->ringFullStalls() > 0);
+    CHECK(!conn->connected());
+    CHECK(!conn->send("late", 4));
+
+    //对端在自己的线程里断开，等它回调完
+    for (int i = 0; i < 1000 && !peerClosed; ++i)
+    {
+        ::usleep(1000);
+    }
+    CHECK(peerClosed);
+    printf("ShmConnection_unittest passed\n");
+    return 0;
+}
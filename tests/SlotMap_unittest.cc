@@ -0,0 +1,92 @@
+#include "SlotMap.h"
+#include "TestCommon.h"
+
+#include <memory>
+#include <vector>
+
+//删除以后旧id失效，槽位复用时代数不同，旧id不会找到新元素
+static void testReuse()
+{
+    SlotMap<int> map;
+    SlotMap<int>::Id a = map.insert(1);
+    SlotMap<int>::Id b = map.insert(2);
+    CHECK(a != 0 && b != 0 && a != b);
+    CHECK(map.size() == 2);
+    CHECK(*map.find(a) == 1 && *map.find(b) == 2);
+
+    CHECK(map.erase(a));
+    CHECK(!map.erase(a));
+    CHECK(map.find(a) == nullptr);
+    CHECK(map.size() == 1);
+
+    SlotMap<int>::Id c = map.insert(3);
+    CHECK(SlotMap<int>::indexOf(c) == SlotMap<int>::indexOf(a));
+    CHECK(SlotMap<int>::generationOf(c) == SlotMap<int>::generationOf(a) + 1);
+    CHECK(map.find(a) == nullptr);
+    CHECK(!map.erase(a));
+    CHECK(*map.find(c) == 3);
+    CHECK(map.find(0) == nullptr);
+    CHECK(map.find(SlotMap<int>::indexOf(c) + 100) == nullptr);
+}
+
+//erase释放元素持有的资源，forEach只访问在用的槽位
+static void testRelease()
+{
+    SlotMap<std::shared_ptr<int>> map;
+    std::shared_ptr<int> value = std::make_shared<int>(7);
+    std::vector<SlotMap<std::shared_ptr<int>>::Id> ids;
+    for (int i = 0; i < 100; ++i)
+    {
+        ids.push_back(map.insert(value));
+    }
+    CHECK(value.use_count() == 101);
+    for (size_t i = 0; i < ids.size(); i += 2)
+    {
+        CHECK(map.erase(ids[i]));
+    }
+    CHECK(value.use_count() == 51);
+    CHECK(map.size() == 50);
+    int visited = 0;
+    map.forEach([&visited](std::shared_ptr<int> &v) {
+        CHECK(*v == 7);
+        ++visited;
+    });
+    CHECK(visited == 50);
+
+    //空闲链表后进先出，槽位数不增长
+    for (int i = 0; i < 50; ++i)
+    {
+        map.insert(value);
+    }
+    CHECK(map.size() == 100);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        CHECK(SlotMap<std::shared_ptr<int>>::indexOf(ids[i]) < 100);
+    }
+}
+
+//同一个槽位反复释放，代数一直增长，旧id都找不到
+static void testGenerations()
+{
+    SlotMap<int> map;
+    SlotMap<int>::Id first = map.insert(0);
+    SlotMap<int>::Id id = first;
+    for (int i = 1; i < 1000; ++i)
+    {
+        CHECK(map.erase(id));
+        id = map.insert(i);
+        CHECK(SlotMap<int>::indexOf(id) == SlotMap<int>::indexOf(first));
+        CHECK(map.find(first) == nullptr);
+    }
+    CHECK(*map.find(id) == 999);
+    CHECK(map.size() == 1);
+}
+
+int main()
+{
+    testReuse();
+    testRelease();
+    testGenerations();
+    printf("SlotMap_unittest passed\n");
+    return 0;
+}
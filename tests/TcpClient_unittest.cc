@@ -0,0 +1,65 @@
+#include "TcpClient.h"
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "TestCommon.h"
+
+#include <memory>
+
+/**
+ * 连接建立以后析构TcpClient：TcpClient拥有这条连接，析构时要关掉它，
+ * 服务端收到断开，客户端的连接回调一次断开以后被销毁
+ */
+int main()
+{
+    quietLogs();
+    EventLoop loop;
+    InetAddress addr(19511);
+    TcpServer server(&loop, addr, "server");
+    bool serverConnected = false;
+    bool serverDisconnected = false;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            serverConnected = true;
+        }
+        else
+        {
+            serverDisconnected = true;
+            loop.quit();
+        }
+    });
+    server.start();
+
+    TcpClient *client = new TcpClient(&loop, addr, "client");
+    std::weak_ptr<TcpConnection> clientConn;//fd在连接析构时才关，这里不能延长它的寿命
+    int clientDisconnects = 0;
+    client->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            clientConn = conn;
+            //不在连接自己的回调里析构
+            loop.queueInLoop([&client]() {
+                delete client;
+                client = nullptr;
+            });
+        }
+        else
+        {
+            ++clientDisconnects;
+        }
+    });
+    client->connect();
+    loop.runAfter(10, [&loop]() {
+        fprintf(stderr, "timeout\n");
+        loop.quit();
+    });
+    loop.loop();
+
+    CHECK(client == nullptr);
+    CHECK(serverConnected);
+    CHECK(serverDisconnected);
+    CHECK(clientConn.expired());
+    CHECK(clientDisconnects == 1);
+    printf("TcpClient_unittest passed\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "TestCommon.h"
+
+#include <atomic>
+#include <future>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/**
+ * 连接已经在ioLoop中建立、还没到baseLoop登记时析构TcpServer：
+ * 这条连接要被销毁（用户收到断开，客户端读到EOF），之后到达的登记任务不能访问已经析构的TcpServer
+ */
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    struct timeval timeout = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0);
+    return fd;
+}
+
+int main()
+{
+    quietLogs();
+    const uint16_t kPort = 19514;
+    EventLoop loop;
+    TcpServer *server = new TcpServer(&loop, InetAddress(kPort), "server");
+    server->setThreadNum(1);
+    std::atomic<bool> connected(false);
+    std::atomic<bool> disconnected(false);
+    server->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            connected = true;
+        }
+        else
+        {
+            disconnected = true;
+        }
+    });
+    server->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+    });
+    server->start();
+
+    //先让ioLoop停住，baseLoop accept以后投递的创建任务排在后面
+    EventLoop *ioLoop = server->getAllLoops()[0];
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+    ioLoop->runInLoop([released]() { released.wait(); });
+
+    int fd = connectTo(kPort);
+    loop.runAfter(0.1, [&]() {
+        //ioLoop建立了连接，登记任务还在baseLoop的队列里，这一轮回调结束以后才执行
+        release.set_value();
+        for (int i = 0; i < 5000 && !connected; ++i)
+        {
+            ::usleep(1000);
+        }
+        CHECK(connected);
+        delete server;
+        server = nullptr;
+    });
+    loop.runAfter(0.2, [&loop]() { loop.quit(); });
+    loop.loop();
+
+    CHECK(server == nullptr);
+    CHECK(disconnected);
+    char buf[16];
+    CHECK(::read(fd, buf, sizeof buf) == 0);//连接已经关闭，不是超时
+    ::close(fd);
+    printf("TcpServer_unittest passed\n");
+    return 0;
+}
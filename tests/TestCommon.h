@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+
+//条件不成立时打印位置并以非0退出，ctest据此判断失败
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+//库的日志直接写std::cout，关掉以后测试只输出自己的结果
+inline void quietLogs()
+{
+    std::cout.setstate(std::ios::failbit);
+}